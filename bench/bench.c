@@ -0,0 +1,386 @@
+// Harness de benchmark do manga_manager
+//
+// Uso (dentro de um diretório de trabalho vazio):
+//   bench <catalogo.txt> [operações por tipo] [páginas do buffer pool]
+//
+// Importa o catálogo e mede, chamando as funções do programa diretamente, as
+// operações de busca por ISBN, busca exata, parcial (com e sem o cache de buscas)
+// e aproximada por título, filtro por editora e gênero, faixa de anos,
+// estatísticas da coleção, atualização, remoção, inserção e listagem completa. Para cada tipo de
+// operação são exibidos p50, p99, máximo e vazão, e no final os acertos dos caches.
+
+#define main manga_manager_main
+#include "../manga_manager.c"
+#undef main
+
+#define BENCH_DEFAULT_OPS 10000
+
+typedef struct {
+    const char *name;
+    double *samples; // latências em microssegundos
+    long count;
+    double total;
+} BenchResult;
+
+static double now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void bench_record(BenchResult *result, double start) {
+    double elapsed = now_us() - start;
+    result->samples[result->count++] = elapsed;
+    result->total += elapsed;
+}
+
+static void bench_report(BenchResult *result) {
+    if (result->count == 0) return;
+    qsort(result->samples, result->count, sizeof(double), compare_double);
+    double p50 = result->samples[(long)(result->count * 0.50)];
+    double p99 = result->samples[(long)(result->count * 0.99)];
+    fprintf(stderr, "%-22s %9ld %12.1f %12.1f %12.1f %14.0f\n", result->name, result->count,
+            p50, p99, result->samples[result->count - 1], result->count / (result->total / 1e6));
+}
+
+// Redirecionar a saída padrão (mensagens do programa) para /dev/null
+static int silence_stdout() {
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDOUT_FILENO);
+    close(null_fd);
+    return saved;
+}
+
+static void restore_stdout(int saved) {
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+}
+
+// Amostra de registros do catálogo (ISBN, título, editora e gênero) para montar as consultas
+typedef struct {
+    char isbn[ISBN_SIZE];
+    char title[MAX_TITLE];
+    char publisher[MAX_PUBLISHER];
+    char genre[MAX_GENRE];
+} BenchKey;
+
+static long load_sample(const char *filename, BenchKey **keys) {
+    FILE *file = fopen(filename, "r");
+    if (!file) return -1;
+
+    long capacity = 1024, count = 0;
+    *keys = malloc(capacity * sizeof(BenchKey));
+    char line[IMPORT_LINE_SIZE];
+    Manga manga;
+
+    while (fgets(line, sizeof(line), file)) {
+        if (!parse_manga_line(line, &manga)) continue;
+        if (count == capacity) {
+            capacity *= 2;
+            *keys = realloc(*keys, capacity * sizeof(BenchKey));
+        }
+        strcpy((*keys)[count].isbn, manga.isbn);
+        strcpy((*keys)[count].title, manga.title);
+        strcpy((*keys)[count].publisher, manga.publisher);
+        strcpy((*keys)[count].genre, manga.genre);
+        count++;
+    }
+    fclose(file);
+    return count;
+}
+
+// Embaralhar (Fisher-Yates) com semente fixa para execuções comparáveis
+static void shuffle(BenchKey *keys, long count) {
+    srand(12345);
+    for (long i = count - 1; i > 0; i--) {
+        long j = ((long)rand() * RAND_MAX + rand()) % (i + 1);
+        BenchKey tmp = keys[i];
+        keys[i] = keys[j];
+        keys[j] = tmp;
+    }
+}
+
+// Trecho do título usado na busca parcial: a palavra mais longa
+static void partial_term(const char *title, char *term) {
+    const char *best = title;
+    size_t best_len = 0;
+    for (const char *p = title; *p; ) {
+        size_t len = strcspn(p, " :");
+        if (len > best_len) {
+            best = p;
+            best_len = len;
+        }
+        p += len;
+        if (*p) p++;
+    }
+    memcpy(term, best, best_len);
+    term[best_len] = '\0';
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Uso: %s <catalogo.txt> [operações por tipo] [páginas do buffer pool]\n", argv[0]);
+        return 1;
+    }
+    long ops = argc > 2 ? atol(argv[2]) : BENCH_DEFAULT_OPS;
+    if (argc > 3 && data_pool_configure(atol(argv[3])) != 0) {
+        fprintf(stderr, "Número de páginas do buffer pool inválido: %s\n", argv[3]);
+        return 1;
+    }
+
+    BenchKey *keys;
+    long key_count = load_sample(argv[1], &keys);
+    if (key_count <= 0) {
+        fprintf(stderr, "Catálogo vazio ou inexistente: %s\n", argv[1]);
+        return 1;
+    }
+    shuffle(keys, key_count);
+    if (ops > key_count) ops = key_count;
+    long write_ops = ops / 10 > 0 ? ops / 10 : 1;
+
+    // Começar de um catálogo vazio no diretório atual
+    unlink("mangas.dat");
+    unlink("primary_index.dat");
+    unlink("primary_hash.dat");
+    unlink("secondary_index.dat");
+    unlink("secondary_runs.dat");
+    unlink("trigram_index.dat");
+    unlink("attribute_index.dat");
+    unlink("year_index.dat");
+    unlink("column_store.dat");
+    unlink("index.wal");
+
+    int saved = silence_stdout();
+    check_data_file();
+    if (open_data_file() != 0) {
+        restore_stdout(saved);
+        fprintf(stderr, "Erro ao abrir arquivo de dados!\n");
+        return 1;
+    }
+    load_indices();
+
+    BenchResult import = { "importação", malloc(sizeof(double)), 0, 0 };
+    double start = now_us();
+    int imported = bulk_import(argv[1]);
+    bench_record(&import, start);
+    restore_stdout(saved);
+
+    fprintf(stderr, "Catálogo: %d registros importados em %.2fs (%.0f registros/s)\n\n",
+            imported, import.total / 1e6, imported / (import.total / 1e6));
+
+    BenchResult results[] = {
+        { "busca por ISBN", malloc(ops * sizeof(double)), 0, 0 },
+        { "busca exata (título)", malloc(ops * sizeof(double)), 0, 0 },
+        { "busca parcial", malloc(ops * sizeof(double)), 0, 0 },
+        { "busca parcial s/cache", malloc(ops * sizeof(double)), 0, 0 },
+        { "busca aproximada", malloc(ops * sizeof(double)), 0, 0 },
+        { "filtro (atributos)", malloc(ops * sizeof(double)), 0, 0 },
+        { "filtro (anos)", malloc(ops * sizeof(double)), 0, 0 },
+        { "estatísticas", malloc(100 * sizeof(double)), 0, 0 },
+        { "atualização", malloc(write_ops * sizeof(double)), 0, 0 },
+        { "remoção", malloc(write_ops * sizeof(double)), 0, 0 },
+        { "inserção", malloc(write_ops * sizeof(double)), 0, 0 },
+        { "listagem completa", malloc(3 * sizeof(double)), 0, 0 },
+        { "reconstrução", malloc(sizeof(double)), 0, 0 },
+        { "inicialização", malloc(3 * sizeof(double)), 0, 0 },
+    };
+    Manga manga;
+    long misses = 0;
+
+    // Busca por ISBN (índice primário + leitura do registro)
+    for (long i = 0; i < ops; i++) {
+        start = now_us();
+        long offset = find_manga_by_isbn(keys[i].isbn);
+        if (offset == -1 || read_record(offset, &manga) != 0) misses++;
+        bench_record(&results[0], start);
+    }
+
+    // Busca exata por título (índice secundário)
+    for (long i = 0; i < ops; i++) {
+        start = now_us();
+        if (!find_isbn_by_title(keys[i].title)) misses++;
+        bench_record(&results[1], start);
+    }
+
+    // Busca parcial por uma palavra do título (os 10 mais relevantes, como no menu);
+    // os termos se repetem, então a maioria sai do cache de buscas
+    char term[MAX_TITLE];
+    TitleHit hits[10];
+    for (long i = 0; i < ops; i++) {
+        TitleCursor cursor;
+        partial_term(keys[i].title, term);
+        start = now_us();
+        title_cursor_init(&cursor, term);
+        search_titles(&cursor, hits, 10);
+        bench_record(&results[2], start);
+    }
+    long cache_hits, cache_misses, cache_evictions;
+    int cache_entries;
+    title_cache_stats(&cache_hits, &cache_misses, &cache_evictions, &cache_entries);
+
+    // A mesma busca com o cache esvaziado antes de cada consulta (fora da medição)
+    for (long i = 0; i < ops; i++) {
+        TitleCursor cursor;
+        partial_term(keys[i].title, term);
+        title_cache_clear();
+        start = now_us();
+        title_cursor_init(&cursor, term);
+        search_titles(&cursor, hits, 10);
+        bench_record(&results[3], start);
+    }
+
+    // Busca aproximada pela palavra mais longa do título com dois caracteres vizinhos
+    // invertidos (até 10 resultados, como a sugestão do menu)
+    for (long i = 0; i < ops; i++) {
+        partial_term(keys[i].title, term);
+        size_t len = strlen(term);
+        if (len >= 4) {
+            char c = term[len / 2];
+            term[len / 2] = term[len / 2 - 1];
+            term[len / 2 - 1] = c;
+        }
+        start = now_us();
+        find_similar_titles(term, hits, 10);
+        bench_record(&results[4], start);
+    }
+
+    // Filtro conjuntivo por editora e gênero (índices invertidos, até 10 resultados)
+    long offsets[10];
+    for (long i = 0; i < ops; i++) {
+        AttributeTerms terms;
+        terms.count = 0;
+        start = now_us();
+        attribute_terms_split(&terms, ATTRIBUTE_PUBLISHER, keys[i].publisher);
+        attribute_terms_split(&terms, ATTRIBUTE_GENRE, keys[i].genre);
+        long total = attribute_query(&terms, NULL, NULL, offsets, 10);
+        for (long j = 0; j < total && j < 10; j++) {
+            read_record(offsets[j], &manga);
+        }
+        if (total == 0) misses++;
+        bench_record(&results[5], start);
+    }
+
+    // Séries iniciadas em uma faixa de 5 anos e ainda em publicação (até 10 resultados)
+    AttributeTerms no_terms;
+    no_terms.count = 0;
+    for (long i = 0; i < ops; i++) {
+        YearRange ranges[2] = { { YEAR_START, 1960 + (int)(i % 60), 1964 + (int)(i % 60) }, { YEAR_END, -1, -1 } };
+        start = now_us();
+        long total = filter_query(&no_terms, ranges, 2, offsets, 10);
+        for (long j = 0; j < total && j < 10; j++) {
+            read_record(offsets[j], &manga);
+        }
+        bench_record(&results[6], start);
+    }
+
+    // Estatísticas da coleção: totais e agrupamentos por editora e revista (projeção colunar)
+    for (int i = 0; i < 100; i++) {
+        ColumnTotals totals;
+        uint32_t count;
+        start = now_us();
+        column_totals(&totals);
+        free(column_group_totals(COLUMN_PUBLISHER, &count));
+        free(column_group_totals(COLUMN_MAGAZINE, &count));
+        bench_record(&results[7], start);
+    }
+
+    saved = silence_stdout();
+
+    // Atualização: mais um volume adquirido e título alterado (com confirmação no log)
+    for (long i = 0; i < write_ops; i++) {
+        start = now_us();
+        long offset = find_manga_by_isbn(keys[i].isbn);
+        if (offset != -1 && read_record(offset, &manga) == 0) {
+            Manga old = manga;
+            snprintf(manga.title, MAX_TITLE, "%.80s (rev)", old.title);
+            manga_add_volume(&manga, manga.total_volumes + 1);
+            save_manga(offset, &manga, &old);
+            commit_index_changes();
+        } else {
+            misses++;
+        }
+        bench_record(&results[8], start);
+    }
+
+    // Remoção (com confirmação no log); os registros removidos são guardados
+    Manga *removed = malloc(write_ops * sizeof(Manga));
+    long removed_count = 0;
+    for (long i = write_ops; i < 2 * write_ops && i < key_count; i++) {
+        start = now_us();
+        long offset = find_manga_by_isbn(keys[i].isbn);
+        if (offset != -1 && read_record(offset, &manga) == 0) {
+            remove_manga(offset, &manga);
+            commit_index_changes();
+            removed[removed_count++] = manga;
+        } else {
+            misses++;
+        }
+        bench_record(&results[9], start);
+    }
+
+    // Inserção dos registros removidos (com confirmação no log)
+    for (long i = 0; i < removed_count; i++) {
+        start = now_us();
+        insert_manga(&removed[i]);
+        commit_index_changes();
+        bench_record(&results[10], start);
+    }
+    free(removed);
+
+    // Listagem completa (formatação incluída, saída descartada)
+    for (int i = 0; i < 3; i++) {
+        start = now_us();
+        list_all_mangas();
+        bench_record(&results[11], start);
+    }
+
+    // Reconstrução completa dos índices a partir de mangas.dat
+    start = now_us();
+    rebuild_indices_from_data();
+    bench_record(&results[12], start);
+
+    long pool_hits, pool_misses, pool_evictions, pool_writebacks;
+    int pool_pages, pool_dirty;
+    data_pool_stats(&pool_hits, &pool_misses, &pool_evictions, &pool_writebacks, &pool_pages, &pool_dirty);
+
+    close_indices();
+    close_data_file();
+
+    // Inicialização com os índices já gravados (abertura, mapeamento e conferência)
+    for (int i = 0; i < 3; i++) {
+        start = now_us();
+        open_data_file();
+        load_indices();
+        bench_record(&results[13], start);
+        close_indices();
+        close_data_file();
+    }
+    restore_stdout(saved);
+
+    fprintf(stderr, "%-22s %9s %12s %12s %12s %14s\n", "operação", "n", "p50 (µs)", "p99 (µs)", "máx (µs)", "ops/s");
+    for (int i = 0; i < (int)(sizeof(results) / sizeof(results[0])); i++) {
+        bench_report(&results[i]);
+        free(results[i].samples);
+    }
+    fprintf(stderr, "\nCache de buscas por título: %ld acertos, %ld faltas (%.1f%%) na busca parcial, %d termos\n",
+            cache_hits, cache_misses, 100.0 * cache_hits / (cache_hits + cache_misses), cache_entries);
+    fprintf(stderr, "Buffer pool de mangas.dat (%d páginas): %ld acertos, %ld faltas (%.1f%%), %ld substituições, "
+            "%ld páginas gravadas\n", data_pool.capacity, pool_hits, pool_misses,
+            pool_hits + pool_misses > 0 ? 100.0 * pool_hits / (pool_hits + pool_misses) : 0.0,
+            pool_evictions, pool_writebacks);
+    if (misses > 0) {
+        fprintf(stderr, "\nAviso: %ld consultas não encontraram o registro esperado.\n", misses);
+    }
+
+    free(import.samples);
+    free(keys);
+    return 0;
+}
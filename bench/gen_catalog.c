@@ -0,0 +1,197 @@
+#define _POSIX_C_SOURCE 200809L
+
+// Gerador de catálogos sintéticos no formato do mangas.txt
+//
+// Uso: gen_catalog <quantidade> [semente] > catalogo.txt
+//
+// Editoras, revistas, autores e gêneros seguem uma distribuição de Zipf (poucos
+// valores muito frequentes e uma cauda longa), a quantidade de volumes é
+// assimétrica (muitas séries curtas, poucas muito longas) e os títulos misturam
+// palavras com acentos e caracteres japoneses (UTF-8).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#define COUNT(array) ((int)(sizeof(array) / sizeof(array[0])))
+
+static const char *publishers[] = {
+    "Shueisha", "Kodansha", "Shogakukan", "Kadokawa", "Square Enix", "Hakusensha",
+    "Akita Shoten", "Futabasha", "Tokuma Shoten", "Ichijinsha", "Mag Garden", "Gentosha",
+    "Takeshobo", "Houbunsha", "Media Factory", "Enterbrain", "Shinchosha", "Ohta Publishing"
+};
+
+static const char *magazines[] = {
+    "Weekly Shōnen Jump", "Weekly Shōnen Magazine", "Weekly Shōnen Sunday", "Monthly Shōnen Ace",
+    "Young Jump", "Big Comic Spirits", "Afternoon", "Monthly Gangan", "Jump SQ", "Shōnen Jump+",
+    "Ribon", "Margaret", "Bessatsu Friend", "Hana to Yume", "Comic Beam", "Morning", "Ultra Jump",
+    "Champion RED", "Manga Time Kirara", "Comic Yuri Hime", "Young Animal", "Evening"
+};
+
+static const char *genres[] = {
+    "Ação", "Aventura", "Comédia", "Drama", "Fantasia", "Romance", "Ficção Científica",
+    "Sobrenatural", "Artes Marciais", "Esportes", "Mistério", "Horror", "Slice of Life",
+    "Psicológico", "Histórico", "Mecha", "Musical", "Culinária", "Escolar", "Isekai"
+};
+
+static const char *first_names[] = {
+    "Eiichiro", "Masashi", "Akira", "Naoki", "Hajime", "Kōhei", "Tatsuki", "Yoshihiro", "Rumiko",
+    "Hiromu", "Takehiko", "Kentaro", "Tite", "Gege", "Kazue", "Ai", "Chica", "Yūki", "Sui",
+    "Makoto", "Hiro", "Tsugumi", "Takeshi", "Jun", "Shūzō", "Kaoru", "Natsuki", "Ryō", "Sōichi"
+};
+
+static const char *last_names[] = {
+    "Oda", "Kishimoto", "Toriyama", "Urasawa", "Isayama", "Horikoshi", "Fujimoto", "Togashi",
+    "Takahashi", "Arakawa", "Inoue", "Miura", "Kubo", "Akutami", "Katō", "Yazawa", "Umino",
+    "Tabata", "Ishida", "Yukimura", "Mashima", "Ōba", "Obata", "Itō", "Oshimi", "Mori", "Nagai"
+};
+
+static const char *title_words[] = {
+    "Kimetsu", "Shingeki", "Kaijū", "Ōkami", "Tōkyō", "Kyōto", "Sakura", "Yūrei", "Shōjo", "Ninja",
+    "Samurai", "Dragão", "Coração", "Espada", "Revolução", "Crônicas", "Lâmina", "Guardião",
+    "Céu", "Mar", "Vento", "Estrela", "Sombra", "Fênix", "Lua", "Relâmpago", "Jardim", "Máscara",
+    "Caçador", "Alquimista", "Exorcista", "Demônio", "Espírito", "Academia", "Império", "Órfão",
+    "東京", "魔法", "少年", "物語", "の", "剣", "夢", "桜", "鬼", "星"
+};
+
+static const char *title_suffixes[] = {
+    "", "", "", "", " Gaiden", " Zero", " Next Generation", " Kanzenban", ": O Retorno",
+    ": Edição Definitiva", " Shippūden", " Chronicles", " Deluxe", " Omnibus"
+};
+
+// xorshift64*: rápido e suficiente para dados sintéticos
+static uint64_t rng_state = 88172645463325252ull;
+
+static uint64_t next_random() {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ull;
+}
+
+static double uniform() {
+    return (next_random() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Distribuição de Zipf sobre n valores (peso do k-ésimo proporcional a 1/k^s)
+typedef struct {
+    int n;
+    double *cumulative;
+} Zipf;
+
+static Zipf zipf_create(int n, double s) {
+    Zipf z = { n, malloc(n * sizeof(double)) };
+    double total = 0;
+    for (int k = 0; k < n; k++) {
+        total += 1.0 / pow(k + 1, s);
+        z.cumulative[k] = total;
+    }
+    for (int k = 0; k < n; k++) {
+        z.cumulative[k] /= total;
+    }
+    return z;
+}
+
+static int zipf_sample(const Zipf *z) {
+    double u = uniform();
+    int lo = 0, hi = z->n - 1;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (z->cumulative[mid] < u) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Uso: %s <quantidade> [semente]\n", argv[0]);
+        return 1;
+    }
+
+    long count = atol(argv[1]);
+    if (argc > 2) {
+        rng_state ^= strtoull(argv[2], NULL, 10) * 0x9E3779B97F4A7C15ull;
+        if (rng_state == 0) rng_state = 1;
+    }
+
+    // Autores: combinações de nome e sobrenome, com popularidade Zipf
+    int author_count = COUNT(first_names) * COUNT(last_names);
+    Zipf author_zipf = zipf_create(author_count, 1.1);
+    Zipf publisher_zipf = zipf_create(COUNT(publishers), 1.2);
+    Zipf magazine_zipf = zipf_create(COUNT(magazines), 1.0);
+    Zipf genre_zipf = zipf_create(COUNT(genres), 0.9);
+    Zipf word_zipf = zipf_create(COUNT(title_words), 0.7);
+
+    static char buffer[1 << 16];
+    setvbuf(stdout, buffer, _IOFBF, sizeof(buffer));
+
+    for (long i = 0; i < count; i++) {
+        // ISBN único e fora de ordem: i multiplicado por uma constante ímpar não múltipla
+        // de 5, seguido do dígito verificador do ISBN-13 (prefixo 978)
+        unsigned long long isbn = ((unsigned long long)i * 2654435761ull) % 1000000000ull;
+        int check = 9 + 3 * 7 + 8;
+        unsigned long long rest = isbn;
+        for (int d = 0; d < 9; d++, rest /= 10) {
+            check += (int)(rest % 10) * (d % 2 ? 1 : 3);
+        }
+        check = (10 - check % 10) % 10;
+
+        char title[128];
+        int words = 1 + (int)(next_random() % 3);
+        title[0] = '\0';
+        for (int w = 0; w < words; w++) {
+            if (w > 0) strcat(title, " ");
+            strcat(title, title_words[zipf_sample(&word_zipf)]);
+        }
+        if (next_random() % 4 == 0) {
+            char number[16];
+            snprintf(number, sizeof(number), " %d", (int)(next_random() % 1000));
+            strcat(title, number);
+        }
+        strcat(title, title_suffixes[next_random() % COUNT(title_suffixes)]);
+
+        int author = zipf_sample(&author_zipf);
+        int start_year = 1960 + (int)(next_random() % 64);
+        int finished = next_random() % 3 != 0;
+        int end_year = start_year + (int)(next_random() % 20);
+        if (end_year > 2024) finished = 0;
+
+        // Volumes: distribuição geométrica (média ~ 12), limitada a 150
+        int total = 1;
+        while (total < 150 && uniform() < 0.92) total++;
+        int acquired = (int)(next_random() % (total + 1));
+        if (acquired > 100) acquired = 100;
+
+        char genre[128] = "";
+        int genre_count = 1 + (int)(next_random() % 3);
+        int used[3] = { -1, -1, -1 };
+        for (int g = 0; g < genre_count; g++) {
+            int choice = zipf_sample(&genre_zipf);
+            if (choice == used[0] || choice == used[1]) continue;
+            used[g] = choice;
+            if (genre[0]) strcat(genre, ", ");
+            strcat(genre, genres[choice]);
+        }
+
+        printf("978-%09llu%d; %s; %s %s; %d; ", isbn, check, title,
+               first_names[author % COUNT(first_names)], last_names[author / COUNT(first_names)], start_year);
+        if (finished) printf("%d; ", end_year);
+        else printf("-; ");
+        printf("%s; %s; %s; %d; %d; %d; [", genre, magazines[zipf_sample(&magazine_zipf)],
+               publishers[zipf_sample(&publisher_zipf)], start_year + (int)(next_random() % 10), total, acquired);
+
+        // Volumes adquiridos: um subconjunto crescente de 1..total
+        int printed = 0;
+        for (int v = 1; v <= total && printed < acquired; v++) {
+            if ((long)(next_random() % (total - v + 1)) < acquired - printed) {
+                printf(printed++ ? ", %d" : "%d", v);
+            }
+        }
+        printf("]\n");
+    }
+
+    return 0;
+}
@@ -1,15 +1,117 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <signal.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #define MAX_TITLE 100
 #define MAX_AUTHOR 100
 #define MAX_GENRE 50
 #define MAX_MAGAZINE 50
 #define MAX_PUBLISHER 50
-#define MAX_VOLUMES 100
+#define LEGACY_MAX_VOLUMES 100 // lista de volumes do formato v1 (LegacyManga)
 #define ISBN_SIZE 20
+#define ISBN_UNCHECKED_KEY (1ULL << 63)
+#define MAX_VOLUME_NUMBER 4095
+#define VOLUME_BITMAP_BYTES ((MAX_VOLUME_NUMBER + 7) / 8)
+#define MAX_VOLUME_CHANGES 256 // alterações de volumes em um comando (+5 -3 +10..12)
+#define VOLUME_EVENTS_COMMIT 4096 // mangás entre confirmações do log em --volume-events
+
+// Identificação do arquivo de dados
+#define DATA_MAGIC "MMDT"
+#define DATA_VERSION 2
+
+// Parâmetros da importação em massa
+#define IMPORT_LINE_SIZE 1024
+#define IMPORT_BATCH_LINES 16384
+#define IMPORT_MAX_THREADS 16
+#define IMPORT_WRITE_BUFFER (1 << 20)
+
+// Modo em lote
+#define BATCH_MAX_RESULTS 100
+#define TITLE_CURSOR_SIZE (4 * MAX_TITLE + ISBN_SIZE + 32) // cursor de busca em texto
+
+// Cache de buscas por título: termos guardados e resultados por termo (a primeira página)
+#define TITLE_CACHE_SIZE 256
+#define TITLE_CACHE_HITS BATCH_MAX_RESULTS
+
+// Modo servidor
+#define SERVER_QUEUE_SIZE 64
+#define SERVER_MAX_THREADS 64
+
+// Buffer pool de mangas.dat (número de quadros padrão; muda com --pool-pages N)
+#define DATA_PAGE_SIZE 4096
+#define DATA_POOL_PAGES 1024
+#define DATA_POOL_MAX_PAGES (1 << 20)
+
+// Parâmetros da árvore B+ do índice primário
+#define BTREE_MAGIC "MMBT"
+#define BTREE_VERSION 2
+#define BTREE_PAGE_SIZE 4096
+#define BTREE_CACHE_PAGES 64
+
+// Tabela hash do índice primário (gravada junto com a árvore)
+#define PRIMARY_HASH_MAGIC "MMPH"
+#define PRIMARY_HASH_VERSION 1
+
+// Identificação do arquivo do índice secundário
+#define SECONDARY_MAGIC "MMSI"
+#define SECONDARY_VERSION 3
+
+// Memtable e runs de alterações do índice secundário
+#define SECONDARY_RUNS_MAGIC "MMSR"
+#define SECONDARY_RUNS_VERSION 2
+#define SECONDARY_MEMTABLE_SIZE 256
+#define SECONDARY_MAX_RUNS 16
+#define SECONDARY_BASE_RATIO 32
+
+// Índice de trigramas para busca parcial por título
+#define TRIGRAM_MAGIC "MMTG"
+#define TRIGRAM_VERSION 4
+#define TRIGRAM_MIN_DEAD 1024
+
+// Busca aproximada: distância de edição máxima e palavras do termo consideradas
+#define FUZZY_MAX_DISTANCE 2
+#define FUZZY_MAX_WORDS 8
+
+// Índices invertidos de autor, editora, revista e gênero
+#define ATTRIBUTE_MAGIC "MMAI"
+#define ATTRIBUTE_VERSION 3
+#define ATTRIBUTE_SKIP_INTERVAL 64
+#define ATTRIBUTE_MAX_TERMS 32
+
+// Índice de anos (faixas de ano de início, término e edição)
+#define YEAR_MAGIC "MMYI"
+#define YEAR_VERSION 2
+#define ZONE_BLOCK_SIZE 65536
+
+// Projeção colunar usada nas estatísticas da coleção
+#define COLUMN_MAGIC "MMCS"
+#define COLUMN_VERSION 2
+
+// Histogramas de latência: sub-faixas por potência de 2 (erro relativo de até 1/32)
+#define HISTOGRAM_SUB 32
+#define HISTOGRAM_BUCKETS (37 * HISTOGRAM_SUB)
+
+// Log de índices (write-ahead log) e frequência dos checkpoints
+#define WAL_MAGIC "MMWL"
+#define WAL_VERSION 1
+#define WAL_CHECKPOINT_RECORDS 1024
+#define WAL_CHECKPOINT_BYTES (4 << 20)
 
 // Estrutura para armazenar dados do mangá
 typedef struct {
@@ -23,733 +125,9052 @@ typedef struct {
     char publisher[MAX_PUBLISHER];
     int edition_year;
     int total_volumes;
-    int acquired_volumes;
-    int volumes_list[MAX_VOLUMES];
+    int acquired_volumes; // número de volumes em volumes
+    unsigned char volumes[VOLUME_BITMAP_BYTES]; // bit (v - 1) ligado = volume v adquirido
     int deleted; // 0 = ativo, 1 = deletado
 } Manga;
 
-// Estrutura para índice primário (ISBN)
+// Conjunto de volumes adquiridos de um mangá: o mesmo bitmap gravado no registro,
+// então cabem todos os volumes de 1 a MAX_VOLUME_NUMBER, em ordem e sem repetição
+
+int manga_has_volume(const Manga *manga, int volume) {
+    return volume >= 1 && volume <= MAX_VOLUME_NUMBER &&
+           (manga->volumes[(volume - 1) / 8] & (1 << ((volume - 1) % 8)));
+}
+
+// Incluir um volume; volumes fora de 1..MAX_VOLUME_NUMBER são ignorados
+void manga_add_volume(Manga *manga, int volume) {
+    if (volume >= 1 && volume <= MAX_VOLUME_NUMBER && !manga_has_volume(manga, volume)) {
+        manga->volumes[(volume - 1) / 8] |= 1 << ((volume - 1) % 8);
+        manga->acquired_volumes++;
+    }
+}
+
+void manga_remove_volume(Manga *manga, int volume) {
+    if (manga_has_volume(manga, volume)) {
+        manga->volumes[(volume - 1) / 8] &= ~(1 << ((volume - 1) % 8));
+        manga->acquired_volumes--;
+    }
+}
+
+void manga_clear_volumes(Manga *manga) {
+    memset(manga->volumes, 0, sizeof(manga->volumes));
+    manga->acquired_volumes = 0;
+}
+
+// Próximo volume adquirido depois de volume (0 = o primeiro); 0 quando não há mais
+int manga_next_volume(const Manga *manga, int volume) {
+    for (int v = volume + 1; v <= MAX_VOLUME_NUMBER; v++) {
+        if (!manga->volumes[(v - 1) / 8]) {
+            v = ((v - 1) / 8 + 1) * 8; // byte vazio: pula para o próximo
+            continue;
+        }
+        if (manga_has_volume(manga, v)) return v;
+    }
+    return 0;
+}
+
+// Estrutura para índice primário (ISBN empacotado em 64 bits, ver isbn_key)
 typedef struct {
-    char isbn[ISBN_SIZE];
+    uint64_t key;
     long offset;
 } PrimaryIndex;
 
+// Formato anterior do índice primário (ISBN como texto)
+typedef struct {
+    char isbn[ISBN_SIZE];
+    long offset;
+} LegacyPrimaryIndex;
+
 // Estrutura para índice secundário (Título)
+// A chave normalizada é calculada uma única vez na inserção e persistida
 typedef struct {
     char title[MAX_TITLE];
+    char key[MAX_TITLE];
     char isbn[ISBN_SIZE];
 } SecondaryIndex;
 
+// Resultado de uma busca por título, já com o título para exibição
+typedef enum {
+    MATCH_EXACT,     // título igual ao termo
+    MATCH_PREFIX,    // título começa com o termo
+    MATCH_WORD,      // alguma palavra começa com o termo
+    MATCH_SUBSTRING, // termo no meio de uma palavra
+    MATCH_SIMILAR    // busca aproximada (erros de digitação)
+} TitleMatch;
+
+typedef struct {
+    char isbn[ISBN_SIZE];
+    char title[MAX_TITLE];
+    int match;    // TitleMatch
+    int position; // posição do termo na chave normalizada
+    int distance; // soma das distâncias de edição (MATCH_SIMILAR)
+} TitleHit;
+
+// Posição de uma busca por título paginada: o termo e o último resultado
+// entregue, na ordem do ranking
+typedef struct {
+    char term[MAX_TITLE]; // termo normalizado
+    int started;          // 0 = primeira página
+    int match;
+    int position;
+    char key[MAX_TITLE];
+    char isbn[ISBN_SIZE];
+    long total;           // resultados do termo (preenchido pela busca)
+    long remaining;       // resultados depois da página devolvida
+} TitleCursor;
+
+// Formato anterior do índice secundário (sem chave normalizada)
+typedef struct {
+    char title[MAX_TITLE];
+    char isbn[ISBN_SIZE];
+} LegacySecondaryIndex;
+
 // Variáveis globais para os índices
-PrimaryIndex *primary_indices = NULL;
+// secondary_indices é só a base do índice secundário (ver secondary_cursor_init);
+// secondary_count conta os títulos vivos, com as alterações ainda fora da base
 SecondaryIndex *secondary_indices = NULL;
 int primary_count = 0;
 int secondary_count = 0;
 
-// Função para remover espaços extras e converter para lowercase
-void normalize_string(char *str) {
-    char temp[MAX_TITLE];
-    int i = 0, j = 0;
-    
-    // Remover espaços do início
-    while (str[i] && isspace(str[i])) {
-        i++;
+// Índice primário ou secundário inválido: reconstruir a partir de mangas.dat
+int catalog_indices_stale = 0;
+
+// Geração do catálogo: muda a cada alteração do índice de títulos e invalida o
+// cache de buscas (só muda com a trava de escrita no modo servidor)
+uint64_t catalog_generation = 0;
+
+// ----- Normalização de texto -----
+//
+// Títulos e termos de busca são comparados por uma forma normalizada: espaços das
+// pontas removidos e sequências de espaços reduzidas a um (inclusive U+00A0 e o
+// espaço ideográfico U+3000), letras em minúscula e sem acento ("Shōnen" vira
+// "shonen", "Pokémon" vira "pokemon", "×" vira "x"), formas de largura total
+// convertidas para ASCII ("ＯＮＥ" vira "one") e marcas diacríticas combinantes
+// descartadas. Outros caracteres e bytes que não formam UTF-8 válido são copiados
+// como estão. A saída nunca é maior que a entrada, então a normalização pode ser
+// feita no próprio buffer.
+
+// Letras latinas de U+00C0 a U+017F em minúscula e sem acento ("" = copiar)
+static const char fold_latin[192][3] = {
+    "a", "a", "a", "a", "a", "a", "ae", "c", "e", "e", "e", "e", "i", "i", "i", "i",   // U+00C0
+    "d", "n", "o", "o", "o", "o", "o", "x", "o", "u", "u", "u", "u", "y", "th", "ss",  // U+00D0
+    "a", "a", "a", "a", "a", "a", "ae", "c", "e", "e", "e", "e", "i", "i", "i", "i",   // U+00E0
+    "d", "n", "o", "o", "o", "o", "o", "", "o", "u", "u", "u", "u", "y", "th", "y",    // U+00F0
+    "a", "a", "a", "a", "a", "a", "c", "c", "c", "c", "c", "c", "c", "c", "d", "d",    // U+0100
+    "d", "d", "e", "e", "e", "e", "e", "e", "e", "e", "e", "e", "g", "g", "g", "g",    // U+0110
+    "g", "g", "g", "g", "h", "h", "h", "h", "i", "i", "i", "i", "i", "i", "i", "i",    // U+0120
+    "i", "i", "ij", "ij", "j", "j", "k", "k", "k", "l", "l", "l", "l", "l", "l", "l",  // U+0130
+    "l", "l", "l", "n", "n", "n", "n", "n", "n", "n", "n", "n", "o", "o", "o", "o",    // U+0140
+    "o", "o", "oe", "oe", "r", "r", "r", "r", "r", "r", "s", "s", "s", "s", "s", "s",  // U+0150
+    "s", "s", "t", "t", "t", "t", "t", "t", "u", "u", "u", "u", "u", "u", "u", "u",    // U+0160
+    "u", "u", "u", "u", "w", "w", "y", "y", "y", "z", "z", "z", "z", "z", "z", "s",    // U+0170
+};
+
+// Decodificar um caractere UTF-8 de 2 ou 3 bytes; retorna o tamanho ou 0 se a
+// sequência for inválida ou de outro tamanho
+static int utf8_decode(const unsigned char *s, size_t len, uint32_t *code) {
+    if (s[0] >= 0xC2 && s[0] <= 0xDF && len >= 2 && (s[1] & 0xC0) == 0x80) {
+        *code = (uint32_t)(s[0] & 0x1F) << 6 | (s[1] & 0x3F);
+        return 2;
     }
-    
-    // Copiar caracteres convertendo para lowercase e removendo espaços extras
-    while (str[i]) {
-        if (isspace(str[i])) {
-            // Adicionar apenas um espaço se não for o último caractere
-            if (j > 0 && temp[j-1] != ' ') {
-                temp[j++] = ' ';
+    if ((s[0] & 0xF0) == 0xE0 && len >= 3 && (s[1] & 0xC0) == 0x80 && (s[2] & 0xC0) == 0x80) {
+        *code = (uint32_t)(s[0] & 0x0F) << 12 | (uint32_t)(s[1] & 0x3F) << 6 | (s[2] & 0x3F);
+        return *code >= 0x800 ? 3 : 0;
+    }
+    return 0;
+}
+
+// Normalizar len bytes de src em dst (pode ser o mesmo buffer); retorna o
+// tamanho da saída, que recebe '\0' no fim
+size_t fold_text(const char *src, size_t len, char *dst) {
+    const unsigned char *s = (const unsigned char *)src;
+    size_t i = 0, j = 0;
+    int space = 0; // espaço pendente: só é escrito antes do próximo caractere
+
+    while (i < len) {
+        size_t end = len;
+#if defined(__SSE2__)
+        // Caminho rápido: 16 bytes de ASCII imprimível sem espaços seguidos só
+        // precisam de minúsculas. Um espaço no início só é aceito depois de um
+        // caractere já escrito, e um espaço no fim fica pendente
+        if (i + 16 <= len) {
+            __m128i chunk = _mm_loadu_si128((const __m128i *)(s + i));
+            // Na comparação com sinal, bytes >= 0x80 são negativos
+            __m128i other = _mm_or_si128(_mm_cmplt_epi8(chunk, _mm_set1_epi8(0x20)),
+                                         _mm_cmpeq_epi8(chunk, _mm_set1_epi8(0x7F)));
+            int spaces = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')));
+            if (_mm_movemask_epi8(other) == 0 && (spaces & spaces >> 1) == 0 &&
+                (!(spaces & 1) || (!space && j > 0))) {
+                __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(chunk, _mm_set1_epi8('A' - 1)),
+                                              _mm_cmplt_epi8(chunk, _mm_set1_epi8('Z' + 1)));
+                chunk = _mm_add_epi8(chunk, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+                if (space && j > 0) dst[j++] = ' ';
+                _mm_storeu_si128((__m128i *)(dst + j), chunk);
+                i += 16;
+                j += 16;
+                space = (spaces & 0x8000) != 0;
+                j -= space;
+                continue;
+            }
+            end = i + 16;
+        }
+#endif
+        // Um caractere por vez até o fim do bloco
+        while (i < end) {
+            char folded;
+            const char *out = &folded;
+            size_t out_len = 1;
+            unsigned char c = s[i];
+            uint32_t code;
+            int size;
+
+            if (c < 0x80) {
+                i++;
+                if (c == ' ' || (c >= '\t' && c <= '\r')) {
+                    space = 1;
+                    continue;
+                }
+                if (space && j > 0) dst[j++] = ' ';
+                space = 0;
+                dst[j++] = (char)(c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c);
+                continue;
+            } else if ((size = utf8_decode(s + i, len - i, &code)) == 0) {
+                folded = (char)c;
+                i++;
+            } else {
+                i += size;
+                if (code == 0xA0 || code == 0x3000) {
+                    space = 1;
+                    continue;
+                } else if (code >= 0x300 && code <= 0x36F) {
+                    continue;
+                } else if (code >= 0xC0 && code <= 0x17F && fold_latin[code - 0xC0][0]) {
+                    out = fold_latin[code - 0xC0];
+                    out_len = strlen(out);
+                } else if (code >= 0xFF01 && code <= 0xFF5E) {
+                    c = (unsigned char)(code - 0xFEE0);
+                    folded = (char)(c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c);
+                } else {
+                    out = src + i - size;
+                    out_len = size;
+                }
+            }
+
+            if (space && j > 0) dst[j++] = ' ';
+            space = 0;
+            // Cópia para frente: no próprio buffer, out nunca fica antes de dst + j
+            for (size_t k = 0; k < out_len; k++) {
+                dst[j++] = out[k];
             }
+        }
+    }
+    dst[j] = '\0';
+    return j;
+}
+
+// Normalizar uma string no próprio buffer
+void normalize_string(char *str) {
+    fold_text(str, strlen(str), str);
+}
+
+// Gerar a chave normalizada de um título (usada para ordenar e buscar)
+void make_title_key(const char *title, char *key) {
+    fold_text(title, strnlen(title, MAX_TITLE - 1), key);
+}
+
+// Normalizar e validar um ISBN-10 ou ISBN-13 (hífens e espaços são ignorados) e
+// empacotá-lo em 64 bits: a chave é o número do ISBN-13, e um ISBN-10 é convertido
+// para ISBN-13 (prefixo 978). Assim "978-4-08-883267-8" e "9784088832678" são o
+// mesmo livro. Retorna 0 se o ISBN for válido (dígito verificador conferido)
+int isbn_key(const char *isbn, uint64_t *key) {
+    int digits[13], count = 0;
+    for (const char *p = isbn; *p; p++) {
+        if (*p == '-' || *p == ' ') continue;
+        if (count == 13) return -1;
+        if (isdigit((unsigned char)*p)) {
+            digits[count++] = *p - '0';
+        } else if ((*p == 'X' || *p == 'x') && count == 9 && p[1] == '\0') {
+            digits[count++] = 10;
         } else {
-            temp[j++] = tolower(str[i]);
+            return -1;
         }
-        i++;
     }
-    
-    // Remover espaço do final
-    if (j > 0 && temp[j-1] == ' ') {
-        j--;
+
+    int sum = 0;
+    if (count == 10) {
+        for (int i = 0; i < 10; i++) sum += (10 - i) * digits[i];
+        if (sum % 11 != 0) return -1;
+
+        // ISBN-10 -> ISBN-13: prefixo 978 e novo dígito verificador
+        memmove(digits + 3, digits, 9 * sizeof(int));
+        digits[0] = 9, digits[1] = 7, digits[2] = 8;
+        sum = 0;
+        for (int i = 0; i < 12; i++) sum += digits[i] * (i % 2 ? 3 : 1);
+        digits[12] = (10 - sum % 10) % 10;
+    } else if (count == 13) {
+        for (int i = 0; i < 13; i++) sum += digits[i] * (i % 2 ? 3 : 1);
+        if (sum % 10 != 0 || digits[0] != 9 || digits[1] != 7 || (digits[2] != 8 && digits[2] != 9)) return -1;
+    } else {
+        return -1;
     }
-    
-    temp[j] = '\0';
-    strcpy(str, temp);
+
+    *key = 0;
+    for (int i = 0; i < 13; i++) *key = *key * 10 + digits[i];
+    return 0;
 }
 
-// Função para verificar se uma string contém outra (busca parcial)
-int contains_substring(const char *haystack, const char *needle) {
-    char normalized_haystack[MAX_TITLE], normalized_needle[MAX_TITLE];
-    
-    strcpy(normalized_haystack, haystack);
-    strcpy(normalized_needle, needle);
-    
-    normalize_string(normalized_haystack);
-    normalize_string(normalized_needle);
-    
-    return strstr(normalized_haystack, normalized_needle) != NULL;
+// Chave de um ISBN já cadastrado: além dos ISBNs válidos, aceita sequências de até
+// 17 dígitos com dígito verificador inválido (gravadas antes da validação). Essas
+// chaves têm o bit 63 ligado e o número de dígitos nos bits 57-62, para que
+// "0123" e "123" continuem diferentes. Retorna 0 se o ISBN puder ser indexado
+int isbn_stored_key(const char *isbn, uint64_t *key) {
+    if (isbn_key(isbn, key) == 0) {
+        return 0;
+    }
+
+    uint64_t value = 0;
+    int count = 0;
+    for (const char *p = isbn; *p; p++) {
+        if (*p == '-' || *p == ' ') continue;
+        if (!isdigit((unsigned char)*p) || count == 17) return -1;
+        value = value * 10 + (uint64_t)(*p - '0');
+        count++;
+    }
+    if (count == 0) return -1;
+    *key = ISBN_UNCHECKED_KEY | (uint64_t)count << 57 | value;
+    return 0;
 }
 
-// Função para comparar títulos de forma mais flexível
-int compare_titles(const char *title1, const char *title2) {
-    char normalized1[MAX_TITLE], normalized2[MAX_TITLE];
-    
-    strcpy(normalized1, title1);
-    strcpy(normalized2, title2);
-    
-    normalize_string(normalized1);
-    normalize_string(normalized2);
-    
-    return strcmp(normalized1, normalized2);
+// Função para verificar se uma string contém outra (busca parcial)
+// Ambas as strings já devem estar normalizadas
+int contains_substring(const char *normalized_haystack, const char *normalized_needle) {
+    return strstr(normalized_haystack, normalized_needle) != NULL;
 }
 
-// Função para comparar índices primários (por ISBN)
+// Função para comparar índices primários (pela chave do ISBN)
 int compare_primary(const void *a, const void *b) {
-    return strcmp(((PrimaryIndex*)a)->isbn, ((PrimaryIndex*)b)->isbn);
+    uint64_t x = ((const PrimaryIndex*)a)->key, y = ((const PrimaryIndex*)b)->key;
+    return (x > y) - (x < y);
 }
 
-// Função para comparar índices secundários (por título)
+// Função para comparar índices secundários (por chave normalizada e ISBN)
 int compare_secondary(const void *a, const void *b) {
-    return compare_titles(((SecondaryIndex*)a)->title, ((SecondaryIndex*)b)->title);
+    const SecondaryIndex *x = a, *y = b;
+    int result = strcmp(x->key, y->key);
+    return result != 0 ? result : strcmp(x->isbn, y->isbn);
 }
 
-// Carregar índices primários do arquivo
-void load_primary_indices() {
-    FILE *file = fopen("primary_index.dat", "rb");
-    if (!file) {
-        primary_count = 0;
-        return;
+// ===================== MÉTRICAS DE LATÊNCIA E E/S =====================
+//
+// Cada operação do catálogo (comandos do modo em lote e do servidor e as opções
+// do menu, sem o tempo de digitação) e as etapas internas de confirmação
+// (commit, checkpoint, fsync) alimentam um histograma de latências em escala
+// log-linear, como o HDR Histogram: os valores em nanossegundos caem em
+// HISTOGRAM_SUB faixas por potência de 2, então os percentis têm erro relativo
+// de no máximo 1/HISTOGRAM_SUB com memória fixa. As chamadas de E/S do programa
+// passam pelos invólucros io_* abaixo, que contam aberturas, leituras, gravações
+// e bytes; sort_array conta as ordenações. O relatório em JSON sai pela opção 12
+// do menu, por `stats metrics` ou ao sair com --stats-on-exit.
+
+typedef enum {
+    METRIC_GET,
+    METRIC_SEARCH,
+    METRIC_NEXT,
+    METRIC_FUZZY,
+    METRIC_FILTER,
+    METRIC_STATS,
+    METRIC_PUT,
+    METRIC_UPDATE,
+    METRIC_DELETE,
+    METRIC_VOLUMES,
+    METRIC_LIST,
+    METRIC_IMPORT,
+    METRIC_COMPACT,
+    METRIC_REBUILD,
+    METRIC_COMMIT,
+    METRIC_CHECKPOINT,
+    METRIC_FSYNC,
+    METRIC_OPERATIONS
+} MetricOperation;
+
+static const char *metric_names[METRIC_OPERATIONS] = {
+    "get", "search", "next", "fuzzy", "filter", "stats", "put", "update", "delete",
+    "volumes", "list", "import", "compact", "rebuild", "commit", "checkpoint", "fsync"
+};
+
+typedef enum {
+    COUNTER_FILE_OPENS,
+    COUNTER_READS,
+    COUNTER_BYTES_READ,
+    COUNTER_WRITES,
+    COUNTER_BYTES_WRITTEN,
+    COUNTER_INDEX_SAVES,
+    COUNTER_SORTS,
+    COUNTERS
+} MetricCounter;
+
+static const char *counter_names[COUNTERS] = {
+    "file_opens", "reads", "bytes_read", "writes", "bytes_written", "index_saves", "sorts"
+};
+
+typedef struct {
+    uint64_t count;
+    uint64_t total;
+    uint64_t max;
+    uint64_t buckets[HISTOGRAM_BUCKETS];
+} Histogram;
+
+struct {
+    Histogram histograms[METRIC_OPERATIONS];
+    uint64_t counters[COUNTERS];
+    uint64_t started;
+    int dump_on_exit;
+    pthread_mutex_t lock;
+} metrics = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+// Relógio monotônico em nanossegundos
+uint64_t metrics_clock() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Faixa do valor: abaixo de HISTOGRAM_SUB uma por valor; depois, HISTOGRAM_SUB
+// faixas de mesma largura em cada potência de 2
+static int histogram_bucket(uint64_t value) {
+    int exponent = 0;
+    while ((value >> exponent) >= 2 * HISTOGRAM_SUB) exponent++;
+    int bucket = value < HISTOGRAM_SUB ? (int)value : (exponent + 1) * HISTOGRAM_SUB + (int)((value >> exponent) - HISTOGRAM_SUB);
+    return bucket < HISTOGRAM_BUCKETS ? bucket : HISTOGRAM_BUCKETS - 1;
+}
+
+// Maior valor que cai na faixa
+static uint64_t histogram_bucket_limit(int bucket) {
+    int group = bucket / HISTOGRAM_SUB;
+    if (group <= 1) return (uint64_t)bucket;
+    int exponent = group - 1;
+    return (((uint64_t)(HISTOGRAM_SUB + bucket % HISTOGRAM_SUB) + 1) << exponent) - 1;
+}
+
+// Valor abaixo do qual fica a fração quantile das amostras (limitado ao máximo)
+static uint64_t histogram_percentile(const Histogram *histogram, double quantile) {
+    uint64_t target = (uint64_t)(quantile * histogram->count + 0.999999);
+    uint64_t seen = 0;
+    if (target == 0) target = 1;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if (seen >= target) {
+            uint64_t limit = histogram_bucket_limit(i);
+            return limit < histogram->max ? limit : histogram->max;
+        }
     }
-    
-    fread(&primary_count, sizeof(int), 1, file);
-    if (primary_count > 0) {
-        primary_indices = malloc(primary_count * sizeof(PrimaryIndex));
-        fread(primary_indices, sizeof(PrimaryIndex), primary_count, file);
+    return histogram->max;
+}
+
+// Registrar a duração de uma operação iniciada em start (metrics_clock)
+void metrics_record(MetricOperation operation, uint64_t start) {
+    uint64_t elapsed = metrics_clock() - start;
+    Histogram *histogram = &metrics.histograms[operation];
+    pthread_mutex_lock(&metrics.lock);
+    histogram->count++;
+    histogram->total += elapsed;
+    if (elapsed > histogram->max) histogram->max = elapsed;
+    histogram->buckets[histogram_bucket(elapsed)]++;
+    pthread_mutex_unlock(&metrics.lock);
+}
+
+// Registrar um comando do modo em lote pelo nome (nomes desconhecidos são ignorados)
+void metrics_record_command(const char *command, uint64_t start) {
+    for (int i = 0; i <= METRIC_VOLUMES; i++) {
+        if (strcmp(command, metric_names[i]) == 0) {
+            metrics_record((MetricOperation)i, start);
+            return;
+        }
     }
-    fclose(file);
 }
 
-// Salvar índices primários no arquivo
-void save_primary_indices() {
-    FILE *file = fopen("primary_index.dat", "wb");
-    if (!file) {
-        printf("Erro ao salvar índices primários!\n");
-        return;
+void metrics_count(MetricCounter counter, uint64_t amount) {
+    pthread_mutex_lock(&metrics.lock);
+    metrics.counters[counter] += amount;
+    pthread_mutex_unlock(&metrics.lock);
+}
+
+// Invólucros contados das chamadas de E/S e de qsort
+int io_open(const char *path, int flags, mode_t mode) {
+    int fd = open(path, flags, mode);
+    if (fd >= 0) metrics_count(COUNTER_FILE_OPENS, 1);
+    return fd;
+}
+
+FILE *io_fopen(const char *path, const char *mode) {
+    FILE *file = fopen(path, mode);
+    if (file) metrics_count(COUNTER_FILE_OPENS, 1);
+    return file;
+}
+
+ssize_t io_pread(int fd, void *buffer, size_t size, off_t offset) {
+    ssize_t n = pread(fd, buffer, size, offset);
+    pthread_mutex_lock(&metrics.lock);
+    metrics.counters[COUNTER_READS]++;
+    if (n > 0) metrics.counters[COUNTER_BYTES_READ] += n;
+    pthread_mutex_unlock(&metrics.lock);
+    return n;
+}
+
+ssize_t io_pwrite(int fd, const void *buffer, size_t size, off_t offset) {
+    ssize_t n = pwrite(fd, buffer, size, offset);
+    pthread_mutex_lock(&metrics.lock);
+    metrics.counters[COUNTER_WRITES]++;
+    if (n > 0) metrics.counters[COUNTER_BYTES_WRITTEN] += n;
+    pthread_mutex_unlock(&metrics.lock);
+    return n;
+}
+
+size_t io_fread(void *buffer, size_t size, size_t count, FILE *file) {
+    size_t n = fread(buffer, size, count, file);
+    pthread_mutex_lock(&metrics.lock);
+    metrics.counters[COUNTER_READS]++;
+    metrics.counters[COUNTER_BYTES_READ] += n * size;
+    pthread_mutex_unlock(&metrics.lock);
+    return n;
+}
+
+size_t io_fwrite(const void *buffer, size_t size, size_t count, FILE *file) {
+    size_t n = fwrite(buffer, size, count, file);
+    pthread_mutex_lock(&metrics.lock);
+    metrics.counters[COUNTER_WRITES]++;
+    metrics.counters[COUNTER_BYTES_WRITTEN] += n * size;
+    pthread_mutex_unlock(&metrics.lock);
+    return n;
+}
+
+int io_fsync(int fd) {
+    uint64_t start = metrics_clock();
+    int result = fsync(fd);
+    metrics_record(METRIC_FSYNC, start);
+    return result;
+}
+
+int io_fdatasync(int fd) {
+    uint64_t start = metrics_clock();
+    int result = fdatasync(fd);
+    metrics_record(METRIC_FSYNC, start);
+    return result;
+}
+
+void sort_array(void *base, size_t count, size_t size, int (*compare)(const void *, const void *)) {
+    metrics_count(COUNTER_SORTS, 1);
+    qsort(base, count, size, compare);
+}
+
+// Relatório em JSON (campos de um objeto, sem as chaves): histogramas das
+// operações executadas (em microssegundos) e contadores de E/S
+void metrics_print_json(FILE *out) {
+    pthread_mutex_lock(&metrics.lock);
+    fprintf(out, "\"uptime\":%.3f,\"operations\":{", metrics.started ? (metrics_clock() - metrics.started) / 1e9 : 0.0);
+    int printed = 0;
+    for (int i = 0; i < METRIC_OPERATIONS; i++) {
+        const Histogram *h = &metrics.histograms[i];
+        if (h->count == 0) continue;
+        fprintf(out, "%s\"%s\":{\"count\":%llu,\"mean_us\":%.1f,\"p50_us\":%.1f,\"p90_us\":%.1f,\"p99_us\":%.1f,\"max_us\":%.1f}",
+                printed++ ? "," : "", metric_names[i], (unsigned long long)h->count, h->total / 1e3 / h->count,
+                histogram_percentile(h, 0.5) / 1e3, histogram_percentile(h, 0.9) / 1e3,
+                histogram_percentile(h, 0.99) / 1e3, h->max / 1e3);
     }
-    
-    fwrite(&primary_count, sizeof(int), 1, file);
-    if (primary_count > 0) {
-        fwrite(primary_indices, sizeof(PrimaryIndex), primary_count, file);
+    fprintf(out, "},\"io\":{");
+    for (int i = 0; i < COUNTERS; i++) {
+        fprintf(out, "%s\"%s\":%llu", i ? "," : "", counter_names[i], (unsigned long long)metrics.counters[i]);
     }
-    fclose(file);
+    fprintf(out, "}");
+    pthread_mutex_unlock(&metrics.lock);
 }
 
-// Carregar índices secundários do arquivo
-void load_secondary_indices() {
-    FILE *file = fopen("secondary_index.dat", "rb");
-    if (!file) {
-        secondary_count = 0;
-        return;
+// Relatório da saída do programa (--stats-on-exit), na saída de erros
+static void metrics_dump_at_exit() {
+    fflush(stdout);
+    fprintf(stderr, "{");
+    metrics_print_json(stderr);
+    fprintf(stderr, "}\n");
+}
+
+// ===================== ARQUIVOS MAPEADOS EM MEMÓRIA =====================
+//
+// mangas.dat e primary_index.dat são mapeados somente para leitura (MAP_SHARED).
+// As gravações continuam sendo feitas com pwrite no mesmo descritor e ficam
+// visíveis no mapeamento pelo cache de páginas do sistema. O mapeamento reserva
+// uma folga além do fim do arquivo e só é refeito quando o arquivo passa dela.
+// Mapeamentos antigos só são desfeitos no fechamento, pois leitores em outras
+// threads (modo servidor) podem ainda estar usando ponteiros para eles.
+
+typedef struct {
+    int fd;
+    unsigned char *base;
+    size_t size;     // bytes válidos (tamanho do arquivo)
+    size_t capacity; // bytes mapeados; o que passa de size não é acessado
+    void **retired;  // mapeamentos antigos
+    size_t *retired_sizes;
+    int retired_count;
+} MappedFile;
+
+static pthread_mutex_t map_lock = PTHREAD_MUTEX_INITIALIZER;
+
+MappedFile data_map = { .fd = -1 };
+
+// Atualizar o mapeamento com o tamanho atual do arquivo
+int map_file_remap(MappedFile *map) {
+    struct stat st;
+    int result = 0;
+
+    pthread_mutex_lock(&map_lock);
+    if (fstat(map->fd, &st) != 0) {
+        result = -1;
+    } else if ((size_t)st.st_size <= map->capacity || st.st_size == 0) {
+        map->size = st.st_size;
+    } else {
+        // Folga de 50% para o crescimento, arredondada para páginas
+        long page = sysconf(_SC_PAGESIZE);
+        size_t capacity = (size_t)st.st_size + st.st_size / 2;
+        capacity = (capacity + page - 1) / page * page;
+
+        void *base = mmap(NULL, capacity, PROT_READ, MAP_SHARED, map->fd, 0);
+        if (base == MAP_FAILED) {
+            result = -1;
+        } else {
+            if (map->base) {
+                map->retired = realloc(map->retired, (map->retired_count + 1) * sizeof(void *));
+                map->retired_sizes = realloc(map->retired_sizes, (map->retired_count + 1) * sizeof(size_t));
+                map->retired[map->retired_count] = map->base;
+                map->retired_sizes[map->retired_count++] = map->capacity;
+            }
+            map->base = base;
+            map->capacity = capacity;
+            map->size = st.st_size;
+        }
     }
-    
-    fread(&secondary_count, sizeof(int), 1, file);
-    if (secondary_count > 0) {
-        secondary_indices = malloc(secondary_count * sizeof(SecondaryIndex));
-        fread(secondary_indices, sizeof(SecondaryIndex), secondary_count, file);
+    pthread_mutex_unlock(&map_lock);
+    return result;
+}
+
+// Mapear um descritor já aberto
+int map_file_attach(MappedFile *map, int fd, int advice) {
+    memset(map, 0, sizeof(MappedFile));
+    map->fd = fd;
+    if (map_file_remap(map) != 0) {
+        return -1;
     }
-    fclose(file);
+    if (map->base) {
+        posix_madvise(map->base, map->size, advice);
+    }
+    return 0;
 }
 
-// Salvar índices secundários no arquivo
-void save_secondary_indices() {
-    FILE *file = fopen("secondary_index.dat", "wb");
-    if (!file) {
-        printf("Erro ao salvar índices secundários!\n");
-        return;
+void map_file_detach(MappedFile *map) {
+    if (map->base) {
+        munmap(map->base, map->capacity);
     }
-    
-    fwrite(&secondary_count, sizeof(int), 1, file);
-    if (secondary_count > 0) {
-        fwrite(secondary_indices, sizeof(SecondaryIndex), secondary_count, file);
+    for (int i = 0; i < map->retired_count; i++) {
+        munmap(map->retired[i], map->retired_sizes[i]);
     }
-    fclose(file);
+    free(map->retired);
+    free(map->retired_sizes);
+    memset(map, 0, sizeof(MappedFile));
+    map->fd = -1;
 }
 
-// Buscar manga por ISBN no índice primário
-long find_manga_by_isbn(const char *isbn) {
-    PrimaryIndex key;
-    strcpy(key.isbn, isbn);
-    
-    PrimaryIndex *result = bsearch(&key, primary_indices, primary_count, 
-                                   sizeof(PrimaryIndex), compare_primary);
-    
-    return result ? result->offset : -1;
+// Verificar se [offset, offset + length) está dentro do mapeamento
+// Quem aumenta o arquivo chama map_file_remap; leitores nunca alteram o mapeamento
+static int map_file_covers(const MappedFile *map, size_t offset, size_t length) {
+    return offset + length <= map->size;
 }
 
-// Buscar ISBN por título no índice secundário (busca exata e parcial)
-char* find_isbn_by_title(const char *title) {
-    char normalized_search[MAX_TITLE];
-    strcpy(normalized_search, title);
-    normalize_string(normalized_search);
-    
-    // Primeiro: busca exata
-    for (int i = 0; i < secondary_count; i++) {
-        char normalized_title[MAX_TITLE];
-        strcpy(normalized_title, secondary_indices[i].title);
-        normalize_string(normalized_title);
-        
-        if (strcmp(normalized_search, normalized_title) == 0) {
-            return secondary_indices[i].isbn;
-        }
+// Sincronizar um diretório (torna duráveis os rename feitos nele)
+void sync_directory(const char *path) {
+    int fd = io_open(path, O_RDONLY, 0);
+    if (fd >= 0) {
+        io_fsync(fd);
+        close(fd);
     }
-    
-    // Segundo: busca parcial (substring)
-    for (int i = 0; i < secondary_count; i++) {
-        if (contains_substring(secondary_indices[i].title, title)) {
-            return secondary_indices[i].isbn;
-        }
+}
+
+// Concluir a gravação de um arquivo temporário e colocá-lo no lugar do original
+// (rename é atômico: após uma queda fica a versão antiga ou a nova, nunca uma parcial)
+int replace_file(FILE *file, const char *temp_name, const char *filename) {
+    int failed = fflush(file) != 0 || io_fsync(fileno(file)) != 0;
+    failed |= fclose(file) != 0;
+    if (failed || rename(temp_name, filename) != 0) {
+        unlink(temp_name);
+        return -1;
     }
-    
-    return NULL;
+    return 0;
 }
 
-// Buscar múltiplos ISBNs por título parcial
-void find_multiple_by_partial_title(const char *search_term, char results[][ISBN_SIZE], int *count, int max_results) {
-    *count = 0;
-    
-    for (int i = 0; i < secondary_count && *count < max_results; i++) {
-        if (contains_substring(secondary_indices[i].title, search_term)) {
-            strcpy(results[*count], secondary_indices[i].isbn);
-            (*count)++;
-        }
+// ===================== BUFFER POOL DE mangas.dat =====================
+//
+// As leituras e gravações pontuais de registros (busca, atualização e remoção)
+// passam por um conjunto fixo de quadros com páginas de DATA_PAGE_SIZE bytes do
+// arquivo de dados, localizados por uma tabela hash do número da página. Uma
+// página ausente é copiada do mapeamento para um quadro escolhido pelo relógio:
+// cada acesso liga o bit de referência do quadro, e o ponteiro do relógio dá uma
+// segunda chance a quem está com ele ligado; quadros fixados nunca são escolhidos.
+// Uma gravação só altera o quadro, que fica sujo e vai para o arquivo quando é
+// escolhido como vítima, no commit (antes do fdatasync de mangas.dat) ou antes de
+// uma varredura que lê o mapeamento diretamente (data_pool_flush). Acréscimos no
+// fim do arquivo continuam sendo feitos com pwrite e são copiados para o quadro
+// da última página, se ele estiver carregado. No modo servidor várias consultas
+// usam o pool ao mesmo tempo, então ele tem uma trava própria.
+
+typedef struct {
+    long page_no;     // -1 = quadro livre
+    int pin_count;
+    int dirty;
+    int referenced;   // bit de referência do relógio
+    int hash_next;    // próximo quadro do mesmo balde + 1 (0 = último)
+    uint32_t valid;   // bytes da página que existem no arquivo
+    unsigned char data[DATA_PAGE_SIZE];
+} DataFrame;
+
+struct {
+    DataFrame *frames;
+    int *buckets;      // quadro + 1 (0 = balde vazio)
+    int capacity;
+    int bucket_count;  // potência de 2
+    int used;
+    int hand;          // ponteiro do relógio
+    int dirty;
+    long hits, misses, evictions, writebacks;
+    pthread_mutex_t lock;
+    pthread_cond_t unpinned;
+} data_pool = { .capacity = DATA_POOL_PAGES, .lock = PTHREAD_MUTEX_INITIALIZER, .unpinned = PTHREAD_COND_INITIALIZER };
+
+static void data_pool_io_error() {
+    printf("Erro de E/S ao gravar mangas.dat!\n");
+    exit(1);
+}
+
+// Definir o número de quadros (antes do primeiro acesso); retorna -1 se for inválido
+int data_pool_configure(long pages) {
+    if (pages < 1 || pages > DATA_POOL_MAX_PAGES || data_pool.frames) {
+        return -1;
     }
+    data_pool.capacity = (int)pages;
+    return 0;
 }
 
-// Adicionar índice primário
-void add_primary_index(const char *isbn, long offset) {
-    primary_indices = realloc(primary_indices, (primary_count + 1) * sizeof(PrimaryIndex));
-    strcpy(primary_indices[primary_count].isbn, isbn);
-    primary_indices[primary_count].offset = offset;
-    primary_count++;
-    
-    qsort(primary_indices, primary_count, sizeof(PrimaryIndex), compare_primary);
+static uint32_t data_pool_hash(long page_no) {
+    return (uint32_t)(((uint64_t)page_no * 0x9E3779B97F4A7C15ull) >> 32) & (data_pool.bucket_count - 1);
 }
 
-// Adicionar índice secundário
-void add_secondary_index(const char *title, const char *isbn) {
-    secondary_indices = realloc(secondary_indices, (secondary_count + 1) * sizeof(SecondaryIndex));
-    strcpy(secondary_indices[secondary_count].title, title);
-    strcpy(secondary_indices[secondary_count].isbn, isbn);
-    secondary_count++;
-    
-    qsort(secondary_indices, secondary_count, sizeof(SecondaryIndex), compare_secondary);
+// Gravar um quadro sujo no arquivo (com a trava do pool)
+static void data_pool_write_back(DataFrame *frame) {
+    if (io_pwrite(data_map.fd, frame->data, frame->valid, (off_t)frame->page_no * DATA_PAGE_SIZE) != (ssize_t)frame->valid) {
+        data_pool_io_error();
+    }
+    frame->dirty = 0;
+    data_pool.dirty--;
+    data_pool.writebacks++;
 }
 
-// Remover índice primário
-void remove_primary_index(const char *isbn) {
-    for (int i = 0; i < primary_count; i++) {
-        if (strcmp(primary_indices[i].isbn, isbn) == 0) {
-            for (int j = i; j < primary_count - 1; j++) {
-                primary_indices[j] = primary_indices[j + 1];
-            }
-            primary_count--;
-            primary_indices = realloc(primary_indices, primary_count * sizeof(PrimaryIndex));
-            break;
+// Escolher um quadro para uma página nova pelo relógio (com a trava do pool)
+// Retorna -1 se todos estiverem fixados
+static int data_pool_victim() {
+    if (data_pool.used < data_pool.capacity) {
+        return data_pool.used++;
+    }
+    for (int step = 0; step < 2 * data_pool.capacity; step++) {
+        int index = data_pool.hand;
+        DataFrame *frame = &data_pool.frames[index];
+        data_pool.hand = (data_pool.hand + 1) % data_pool.capacity;
+        if (frame->pin_count > 0) continue;
+        if (frame->referenced) {
+            frame->referenced = 0;
+            continue;
+        }
+
+        // Tirar a página antiga do quadro (gravando-a se estiver suja)
+        if (frame->dirty) {
+            data_pool_write_back(frame);
+        }
+        int *link = &data_pool.buckets[data_pool_hash(frame->page_no)];
+        while (*link != index + 1) {
+            link = &data_pool.frames[*link - 1].hash_next;
         }
+        *link = frame->hash_next;
+        data_pool.evictions++;
+        return index;
     }
+    return -1;
 }
 
-// Remover índice secundário
-void remove_secondary_index(const char *title) {
-    for (int i = 0; i < secondary_count; i++) {
-        if (strcmp(secondary_indices[i].title, title) == 0) {
-            for (int j = i; j < secondary_count - 1; j++) {
-                secondary_indices[j] = secondary_indices[j + 1];
-            }
-            secondary_count--;
-            secondary_indices = realloc(secondary_indices, secondary_count * sizeof(SecondaryIndex));
-            break;
+static DataFrame *data_pool_find(long page_no) {
+    for (int i = data_pool.buckets[data_pool_hash(page_no)]; i; i = data_pool.frames[i - 1].hash_next) {
+        if (data_pool.frames[i - 1].page_no == page_no) {
+            return &data_pool.frames[i - 1];
         }
     }
+    return NULL;
 }
 
-// Função para debug - mostra todos os títulos indexados
-void debug_titles() {
-    printf("\n=== DEBUG: TÍTULOS INDEXADOS ===\n");
-    for (int i = 0; i < secondary_count; i++) {
-        char normalized[MAX_TITLE];
-        strcpy(normalized, secondary_indices[i].title);
-        normalize_string(normalized);
-        printf("%d. Original: '%s'\n", i+1, secondary_indices[i].title);
-        printf("   Normalizado: '%s'\n", normalized);
-        printf("   ISBN: %s\n\n", secondary_indices[i].isbn);
+// Obter o quadro da página, carregando-a do mapeamento se necessário (fica fixado)
+// Retorna NULL se a página está além do fim do arquivo
+static DataFrame *data_pool_pin(long page_no) {
+    size_t page_offset = (size_t)page_no * DATA_PAGE_SIZE;
+
+    pthread_mutex_lock(&data_pool.lock);
+    if (!data_pool.frames) {
+        data_pool.bucket_count = 1;
+        while (data_pool.bucket_count < 2 * data_pool.capacity) data_pool.bucket_count *= 2;
+        data_pool.frames = malloc((size_t)data_pool.capacity * sizeof(DataFrame));
+        data_pool.buckets = calloc(data_pool.bucket_count, sizeof(int));
+        if (!data_pool.frames || !data_pool.buckets) {
+            printf("Erro: memória insuficiente para o buffer pool!\n");
+            exit(1);
+        }
+    }
+
+    DataFrame *frame;
+    int index;
+    for (;;) {
+        if ((frame = data_pool_find(page_no)) != NULL) {
+            frame->pin_count++;
+            frame->referenced = 1;
+            data_pool.hits++;
+            pthread_mutex_unlock(&data_pool.lock);
+            return frame;
+        }
+        if (!map_file_covers(&data_map, page_offset, 1)) {
+            pthread_mutex_unlock(&data_pool.lock);
+            return NULL;
+        }
+        if ((index = data_pool_victim()) >= 0) break;
+        pthread_cond_wait(&data_pool.unpinned, &data_pool.lock);
     }
+
+    data_pool.misses++;
+    frame = &data_pool.frames[index];
+    frame->page_no = page_no;
+    frame->pin_count = 1;
+    frame->dirty = 0;
+    frame->referenced = 1;
+    frame->valid = data_map.size - page_offset < DATA_PAGE_SIZE ? data_map.size - page_offset : DATA_PAGE_SIZE;
+    memcpy(frame->data, data_map.base + page_offset, frame->valid);
+    uint32_t bucket = data_pool_hash(page_no);
+    frame->hash_next = data_pool.buckets[bucket];
+    data_pool.buckets[bucket] = index + 1;
+    pthread_mutex_unlock(&data_pool.lock);
+    return frame;
 }
 
-// Exibir dados de um mangá
-void display_manga(const Manga *manga) {
-    printf("\n=== DADOS DO MANGÁ ===\n");
-    printf("ISBN: %s\n", manga->isbn);
-    printf("Título: %s\n", manga->title);
-    printf("Autor(es): %s\n", manga->author);
-    printf("Ano de início: %d\n", manga->start_year);
-    if (manga->end_year == -1) {
-        printf("Ano de fim: Em publicação\n");
-    } else {
-        printf("Ano de fim: %d\n", manga->end_year);
+// Liberar um quadro fixado (com a trava do pool)
+static void data_pool_release(DataFrame *frame) {
+    if (--frame->pin_count == 0) {
+        pthread_cond_broadcast(&data_pool.unpinned);
     }
-    printf("Gênero: %s\n", manga->genre);
-    printf("Revista: %s\n", manga->magazine);
+}
+
+static void data_pool_unpin(DataFrame *frame) {
+    pthread_mutex_lock(&data_pool.lock);
+    data_pool_release(frame);
+    pthread_mutex_unlock(&data_pool.lock);
+}
+
+// Fixar a página de offset e devolver um ponteiro para offset dentro do quadro;
+// em *available fica quantos bytes do arquivo há a partir dele na página
+// Retorna NULL (sem fixar) se offset está além do fim do arquivo
+static const unsigned char *data_pool_view(long offset, DataFrame **frame, size_t *available) {
+    size_t start = (size_t)offset % DATA_PAGE_SIZE;
+    *frame = data_pool_pin(offset / DATA_PAGE_SIZE);
+    if (!*frame) return NULL;
+    if (start >= (*frame)->valid) {
+        data_pool_unpin(*frame);
+        return NULL;
+    }
+    *available = (*frame)->valid - start;
+    return (*frame)->data + start;
+}
+
+// Copiar length bytes a partir de offset (o trecho pode ocupar mais de uma página)
+// Retorna 0, ou -1 se o trecho passa do fim do arquivo
+int data_pool_read(long offset, unsigned char *buffer, size_t length) {
+    while (length > 0) {
+        size_t start = (size_t)offset % DATA_PAGE_SIZE;
+        size_t chunk = DATA_PAGE_SIZE - start < length ? DATA_PAGE_SIZE - start : length;
+        DataFrame *frame = data_pool_pin(offset / DATA_PAGE_SIZE);
+        if (!frame) return -1;
+
+        int ok = start + chunk <= frame->valid;
+        if (ok) memcpy(buffer, frame->data + start, chunk);
+        data_pool_unpin(frame);
+        if (!ok) return -1;
+
+        offset += chunk;
+        buffer += chunk;
+        length -= chunk;
+    }
+    return 0;
+}
+
+// Alterar length bytes a partir de offset; as páginas ficam sujas no pool
+// Retorna 0, ou -1 se o trecho passa do fim do arquivo
+int data_pool_write(long offset, const unsigned char *buffer, size_t length) {
+    while (length > 0) {
+        size_t start = (size_t)offset % DATA_PAGE_SIZE;
+        size_t chunk = DATA_PAGE_SIZE - start < length ? DATA_PAGE_SIZE - start : length;
+        DataFrame *frame = data_pool_pin(offset / DATA_PAGE_SIZE);
+        if (!frame) return -1;
+
+        // A cópia é feita com a trava: um commit em outra thread pode estar gravando o quadro
+        pthread_mutex_lock(&data_pool.lock);
+        int ok = start + chunk <= frame->valid;
+        if (ok) {
+            memcpy(frame->data + start, buffer, chunk);
+            if (!frame->dirty) {
+                frame->dirty = 1;
+                data_pool.dirty++;
+            }
+        }
+        data_pool_release(frame);
+        pthread_mutex_unlock(&data_pool.lock);
+        if (!ok) return -1;
+
+        offset += chunk;
+        buffer += chunk;
+        length -= chunk;
+    }
+    return 0;
+}
+
+// Copiar bytes acrescentados ao fim do arquivo (offset = tamanho anterior) para o
+// quadro da última página, se estiver carregado; as páginas seguintes ainda não
+// estavam no arquivo, então não estão no pool
+void data_pool_appended(long offset, const unsigned char *buffer, size_t length) {
+    pthread_mutex_lock(&data_pool.lock);
+    DataFrame *frame = data_pool.frames ? data_pool_find(offset / DATA_PAGE_SIZE) : NULL;
+    size_t start = (size_t)offset % DATA_PAGE_SIZE;
+    if (frame && frame->valid == start) {
+        size_t chunk = DATA_PAGE_SIZE - start < length ? DATA_PAGE_SIZE - start : length;
+        memcpy(frame->data + start, buffer, chunk);
+        frame->valid += chunk;
+    }
+    pthread_mutex_unlock(&data_pool.lock);
+}
+
+// Gravar no arquivo as páginas sujas (sem fdatasync; ver wal_commit)
+void data_pool_flush() {
+    pthread_mutex_lock(&data_pool.lock);
+    for (int i = 0; i < data_pool.used && data_pool.dirty > 0; i++) {
+        if (data_pool.frames[i].dirty) {
+            data_pool_write_back(&data_pool.frames[i]);
+        }
+    }
+    pthread_mutex_unlock(&data_pool.lock);
+}
+
+// Gravar as páginas sujas e esvaziar o pool (o arquivo foi alterado ou trocado
+// por fora dele); os contadores continuam
+void data_pool_reset() {
+    data_pool_flush();
+    pthread_mutex_lock(&data_pool.lock);
+    if (data_pool.buckets) {
+        memset(data_pool.buckets, 0, data_pool.bucket_count * sizeof(int));
+    }
+    data_pool.used = 0;
+    data_pool.hand = 0;
+    pthread_mutex_unlock(&data_pool.lock);
+}
+
+// Contadores do buffer pool (acessos a páginas)
+void data_pool_stats(long *hits, long *misses, long *evictions, long *writebacks, int *pages, int *dirty) {
+    pthread_mutex_lock(&data_pool.lock);
+    *hits = data_pool.hits;
+    *misses = data_pool.misses;
+    *evictions = data_pool.evictions;
+    *writebacks = data_pool.writebacks;
+    *pages = data_pool.used;
+    *dirty = data_pool.dirty;
+    pthread_mutex_unlock(&data_pool.lock);
+}
+
+// ===================== ARQUIVOS DE ÍNDICE MAPEADOS =====================
+//
+// Os arquivos dos índices guardam os vetores no mesmo formato da memória: um
+// cabeçalho fixo seguido das seções, cada uma alinhada em 8 bytes. Na carga o
+// arquivo é mapeado e os vetores do índice passam a apontar para dentro do
+// mapeamento, sem alocação, cópia ou decodificação. O checksum ainda lê o
+// conteúdo inteiro uma vez, porque os vetores são usados sem conferência por
+// entrada; o custo da inicialização é essa leitura sequencial. O mapeamento é
+// somente leitura: um vetor que precisa crescer ou ser alterado no lugar é
+// copiado para fora dele na primeira vez (mapping_realloc e mapping_own), e os
+// que só são lidos continuam no arquivo.
+//
+//   cabeçalho (64 bytes): magic, u32 versão, u64 inode do arquivo indexado,
+//                         u64 bytes do conteúdo, u64 checksum do conteúdo,
+//                         u64 contadores[4] (definidos por cada índice)
+//
+// Um arquivo truncado, de tamanho diferente do anunciado ou com checksum que não
+// confere é recusado na carga, e o índice é reconstruído.
+
+#define INDEX_FILE_ALIGN 8
+#define INDEX_FILE_COUNTS 4
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t inode;
+    uint64_t payload_size;
+    uint64_t checksum;
+    uint64_t counts[INDEX_FILE_COUNTS];
+} IndexFileHeader;
+
+typedef struct {
+    unsigned char *base;
+    size_t size;
+} IndexMapping;
+
+// Checksum de 64 bits em quatro faixas independentes de 8 bytes: as faixas não
+// dependem umas das outras, o que mantém o laço perto da velocidade de leitura da
+// memória. Cada passo é inversível, então uma palavra alterada muda o resultado
+typedef struct {
+    uint64_t lanes[4];
+    unsigned char block[32];
+    size_t pending;
+    uint64_t size;
+} IndexChecksum;
+
+static void checksum_block(uint64_t *lanes, const unsigned char *block) {
+    for (int i = 0; i < 4; i++) {
+        uint64_t word;
+        memcpy(&word, block + 8 * i, sizeof(uint64_t));
+        lanes[i] = (lanes[i] ^ word) * 0x9E3779B97F4A7C15ULL;
+        lanes[i] ^= lanes[i] >> 29;
+    }
+}
+
+void index_checksum_init(IndexChecksum *checksum) {
+    static const uint64_t seeds[4] = {
+        0x243F6A8885A308D3ULL, 0x13198A2E03707344ULL, 0xA4093822299F31D0ULL, 0x082EFA98EC4E6C89ULL
+    };
+    memcpy(checksum->lanes, seeds, sizeof(seeds));
+    checksum->pending = 0;
+    checksum->size = 0;
+}
+
+void index_checksum_update(IndexChecksum *checksum, const void *data, size_t size) {
+    const unsigned char *p = data;
+    checksum->size += size;
+    if (checksum->pending > 0) {
+        size_t take = 32 - checksum->pending < size ? 32 - checksum->pending : size;
+        memcpy(checksum->block + checksum->pending, p, take);
+        checksum->pending += take;
+        p += take;
+        size -= take;
+        if (checksum->pending < 32) return;
+        checksum_block(checksum->lanes, checksum->block);
+        checksum->pending = 0;
+    }
+    for (; size >= 32; p += 32, size -= 32) {
+        checksum_block(checksum->lanes, p);
+    }
+    memcpy(checksum->block, p, size);
+    checksum->pending = size;
+}
+
+uint64_t index_checksum_final(IndexChecksum *checksum) {
+    if (checksum->pending > 0) {
+        memset(checksum->block + checksum->pending, 0, 32 - checksum->pending);
+        checksum_block(checksum->lanes, checksum->block);
+    }
+    uint64_t hash = checksum->size;
+    for (int i = 0; i < 4; i++) {
+        hash = (hash ^ checksum->lanes[i]) * 0x9E3779B97F4A7C15ULL;
+        hash ^= hash >> 32;
+    }
+    return hash;
+}
+
+// Gravação de um arquivo de índice: o cabeçalho é completado no fechamento
+typedef struct {
+    FILE *file;
+    IndexFileHeader header;
+    IndexChecksum checksum;
+} IndexWriter;
+
+int index_writer_open(IndexWriter *writer, const char *temp_name, const char *magic, uint32_t version, uint64_t inode) {
+    writer->file = io_fopen(temp_name, "wb");
+    if (!writer->file) {
+        return -1;
+    }
+    memset(&writer->header, 0, sizeof(IndexFileHeader));
+    memcpy(writer->header.magic, magic, 4);
+    writer->header.version = version;
+    writer->header.inode = inode;
+    index_checksum_init(&writer->checksum);
+    io_fwrite(&writer->header, sizeof(IndexFileHeader), 1, writer->file);
+    return 0;
+}
+
+void index_write(IndexWriter *writer, const void *data, size_t size) {
+    if (size == 0) return;
+    io_fwrite(data, 1, size, writer->file);
+    index_checksum_update(&writer->checksum, data, size);
+}
+
+// Completar a seção atual com zeros até o próximo múltiplo de INDEX_FILE_ALIGN
+void index_write_align(IndexWriter *writer) {
+    static const unsigned char zeros[INDEX_FILE_ALIGN] = { 0 };
+    size_t used = writer->checksum.size % INDEX_FILE_ALIGN;
+    if (used > 0) {
+        index_write(writer, zeros, INDEX_FILE_ALIGN - used);
+    }
+}
+
+int index_writer_close(IndexWriter *writer, const char *temp_name, const char *filename) {
+    writer->header.payload_size = writer->checksum.size;
+    writer->header.checksum = index_checksum_final(&writer->checksum);
+    if (fseek(writer->file, 0, SEEK_SET) != 0 ||
+        io_fwrite(&writer->header, sizeof(IndexFileHeader), 1, writer->file) != 1) {
+        fclose(writer->file);
+        unlink(temp_name);
+        return -1;
+    }
+    if (replace_file(writer->file, temp_name, filename) != 0) {
+        return -1;
+    }
+    metrics_count(COUNTER_INDEX_SAVES, 1);
+    return 0;
+}
+
+// Mapear um arquivo de índice, conferindo cabeçalho, tamanho e checksum
+// Retorna 0 se o arquivo for válido, -1 se não existir ou for de outra versão
+// e -2 se estiver corrompido (o aviso já foi exibido)
+int index_file_map(const char *filename, const char *magic, uint32_t version,
+                   IndexFileHeader *header, IndexMapping *mapping) {
+    memset(mapping, 0, sizeof(IndexMapping));
+    int fd = io_open(filename, O_RDONLY, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || io_pread(fd, header, sizeof(IndexFileHeader), 0) != sizeof(IndexFileHeader) ||
+        memcmp(header->magic, magic, 4) != 0 || header->version != version) {
+        close(fd);
+        return -1;
+    }
+
+    int valid = header->payload_size == (uint64_t)st.st_size - sizeof(IndexFileHeader);
+    void *base = valid ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (base != MAP_FAILED) {
+        IndexChecksum checksum;
+        index_checksum_init(&checksum);
+        index_checksum_update(&checksum, (unsigned char *)base + sizeof(IndexFileHeader), header->payload_size);
+        if (index_checksum_final(&checksum) == header->checksum) {
+            mapping->base = base;
+            mapping->size = st.st_size;
+            return 0;
+        }
+        munmap(base, st.st_size);
+    }
+    printf("Aviso: %s está truncado ou corrompido; o índice será reconstruído.\n", filename);
+    return -2;
+}
+
+// Tamanho de uma seção com o preenchimento de index_write_align
+static size_t index_align(size_t size) {
+    return (size + INDEX_FILE_ALIGN - 1) / INDEX_FILE_ALIGN * INDEX_FILE_ALIGN;
+}
+
+// Conteúdo do arquivo mapeado (logo após o cabeçalho)
+static unsigned char *mapping_payload(const IndexMapping *mapping) {
+    return mapping->base + sizeof(IndexFileHeader);
+}
+
+// O fim do mapeamento também conta: um vetor vazio no fim do arquivo aponta para lá
+static int mapping_contains(const IndexMapping *mapping, const void *p) {
+    uintptr_t address = (uintptr_t)p, base = (uintptr_t)mapping->base;
+    return mapping->base && address >= base && address <= base + mapping->size;
+}
+
+// realloc para vetores que podem estar no mapeamento: na primeira vez que crescem
+// são copiados (used bytes) para um bloco alocado
+void *mapping_realloc(const IndexMapping *mapping, void *p, size_t used, size_t size) {
+    if (!mapping_contains(mapping, p)) {
+        return realloc(p, size);
+    }
+    void *copy = malloc(size);
+    if (copy && used > 0) {
+        memcpy(copy, p, used < size ? used : size);
+    }
+    return copy;
+}
+
+// Copiar para um bloco alocado um vetor do mapeamento (size bytes) que vai ser
+// alterado no lugar; um vetor que já está fora dele é devolvido como está
+void *mapping_own(const IndexMapping *mapping, void *p, size_t size) {
+    return mapping_contains(mapping, p) ? mapping_realloc(mapping, p, size, size) : p;
+}
+
+void mapping_free(const IndexMapping *mapping, void *p) {
+    if (!mapping_contains(mapping, p)) {
+        free(p);
+    }
+}
+
+void mapping_release(IndexMapping *mapping) {
+    if (mapping->base) {
+        munmap(mapping->base, mapping->size);
+    }
+    memset(mapping, 0, sizeof(IndexMapping));
+}
+
+// Inode de um descritor (0 se não estiver aberto)
+static uint64_t file_inode(int fd) {
+    struct stat st;
+    return fd >= 0 && fstat(fd, &st) == 0 ? (uint64_t)st.st_ino : 0;
+}
+
+// ===================== ÍNDICE PRIMÁRIO: ÁRVORE B+ EM DISCO =====================
+//
+// O arquivo primary_index.dat é dividido em páginas de BTREE_PAGE_SIZE bytes.
+// A página 0 guarda o cabeçalho; as demais são nós da árvore. As folhas guardam
+// entradas PrimaryIndex ordenadas pela chave de 64 bits do ISBN e são encadeadas
+// da esquerda para a direita. Nos nós internos, o filho first_child recebe as
+// chaves menores que a primeira chave, e entries[i].child recebe as chaves >=
+// entries[i].key.
+// As páginas passam por um pequeno cache (LRU) e só as páginas alteradas são
+// regravadas no disco.
+
+// Cabeçalho do arquivo (página 0)
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t page_size;
+    uint32_t root;
+    uint32_t page_count;
+    uint32_t free_head;
+    uint32_t height;
+    uint32_t reserved;
+    int64_t entry_count;
+} BTreeHeader;
+
+// Cabeçalho de cada nó
+typedef struct {
+    uint16_t is_leaf;
+    uint16_t count;
+    uint32_t next;        // folhas: próxima folha (0 = nenhuma)
+    uint32_t first_child; // nós internos: filho mais à esquerda
+    uint32_t reserved;
+} BTreeNode;
+
+// Entrada de nó interno
+typedef struct {
+    uint64_t key;
+    uint32_t child;
+} BTreeInternalEntry;
+
+#define BTREE_LEAF_MAX ((int)((BTREE_PAGE_SIZE - sizeof(BTreeNode)) / sizeof(PrimaryIndex)))
+#define BTREE_LEAF_MIN (BTREE_LEAF_MAX / 2)
+#define BTREE_INTERNAL_MAX ((int)((BTREE_PAGE_SIZE - sizeof(BTreeNode)) / sizeof(BTreeInternalEntry)))
+#define BTREE_INTERNAL_MIN (BTREE_INTERNAL_MAX / 2)
+
+#define NODE(page) ((BTreeNode*)(page))
+#define LEAF_ENTRIES(page) ((PrimaryIndex*)((page) + sizeof(BTreeNode)))
+#define INTERNAL_ENTRIES(page) ((BTreeInternalEntry*)((page) + sizeof(BTreeNode)))
+
+// Quadro do cache de páginas
+typedef struct {
+    uint32_t page_no; // 0 = quadro livre
+    int pin_count;
+    int dirty;
+    unsigned long last_used;
+    unsigned char data[BTREE_PAGE_SIZE];
+} BTreeFrame;
+
+typedef struct {
+    int fd;
+    MappedFile map; // leitura das páginas que não estão no cache
+    BTreeHeader header;
+    int header_dirty;
+    BTreeFrame **frames;
+    int frame_count;
+    unsigned long clock;
+} BTree;
+
+BTree primary_tree = { .fd = -1 };
+static pthread_mutex_t btree_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void btree_io_error() {
+    printf("Erro de E/S no índice primário!\n");
+    exit(1);
+}
+
+static void btree_write_page(uint32_t page_no, const unsigned char *data) {
+    if (io_pwrite(primary_tree.fd, data, BTREE_PAGE_SIZE, (off_t)page_no * BTREE_PAGE_SIZE) != BTREE_PAGE_SIZE) {
+        btree_io_error();
+    }
+}
+
+// Obter um quadro para a página, carregando do disco se necessário (fica fixado)
+// Páginas alteradas só vão para o disco no checkpoint (ver o log de índices), por
+// isso nunca são removidas do cache: sem quadro limpo disponível, o cache cresce.
+// O cache tem uma trava própria porque leitores concorrentes também fixam páginas
+static unsigned char *btree_pin_frame(uint32_t page_no, int load) {
+    BTreeFrame *victim = NULL;
+
+    pthread_mutex_lock(&btree_cache_lock);
+    for (int i = 0; i < primary_tree.frame_count; i++) {
+        BTreeFrame *frame = primary_tree.frames[i];
+        if (frame->page_no == page_no) {
+            frame->pin_count++;
+            frame->last_used = ++primary_tree.clock;
+            pthread_mutex_unlock(&btree_cache_lock);
+            return frame->data;
+        }
+        if (frame->pin_count == 0 && !frame->dirty &&
+            (!victim || frame->page_no == 0 || (victim->page_no != 0 && frame->last_used < victim->last_used))) {
+            victim = frame;
+        }
+    }
+
+    if (!victim || (victim->page_no != 0 && primary_tree.frame_count < BTREE_CACHE_PAGES)) {
+        primary_tree.frames = realloc(primary_tree.frames, (primary_tree.frame_count + 1) * sizeof(BTreeFrame *));
+        victim = calloc(1, sizeof(BTreeFrame));
+        if (!primary_tree.frames || !victim) {
+            printf("Erro: memória insuficiente para o cache do índice primário!\n");
+            exit(1);
+        }
+        primary_tree.frames[primary_tree.frame_count++] = victim;
+    }
+
+    victim->page_no = page_no;
+    victim->pin_count = 1;
+    victim->dirty = 0;
+    victim->last_used = ++primary_tree.clock;
+
+    if (load) {
+        size_t page_offset = (size_t)page_no * BTREE_PAGE_SIZE;
+        if (map_file_covers(&primary_tree.map, page_offset, BTREE_PAGE_SIZE)) {
+            memcpy(victim->data, primary_tree.map.base + page_offset, BTREE_PAGE_SIZE);
+        } else if (io_pread(primary_tree.fd, victim->data, BTREE_PAGE_SIZE, page_offset) != BTREE_PAGE_SIZE) {
+            btree_io_error();
+        }
+    } else {
+        memset(victim->data, 0, BTREE_PAGE_SIZE);
+    }
+
+    pthread_mutex_unlock(&btree_cache_lock);
+    return victim->data;
+}
+
+static unsigned char *btree_pin(uint32_t page_no) {
+    return btree_pin_frame(page_no, 1);
+}
+
+static void btree_unpin(uint32_t page_no, int dirty) {
+    pthread_mutex_lock(&btree_cache_lock);
+    for (int i = 0; i < primary_tree.frame_count; i++) {
+        BTreeFrame *frame = primary_tree.frames[i];
+        if (frame->page_no == page_no) {
+            frame->pin_count--;
+            if (dirty) frame->dirty = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&btree_cache_lock);
+}
+
+// Alocar uma página nova (reaproveitando a lista de páginas livres); retorna fixada
+static uint32_t btree_alloc_page(unsigned char **data) {
+    uint32_t page_no;
+
+    if (primary_tree.header.free_head) {
+        page_no = primary_tree.header.free_head;
+        unsigned char *page = btree_pin(page_no);
+        memcpy(&primary_tree.header.free_head, page, sizeof(uint32_t));
+        memset(page, 0, BTREE_PAGE_SIZE);
+        *data = page;
+    } else {
+        page_no = primary_tree.header.page_count++;
+        *data = btree_pin_frame(page_no, 0);
+    }
+
+    primary_tree.header_dirty = 1;
+    return page_no;
+}
+
+// Devolver uma página (fixada) para a lista de páginas livres e liberá-la
+static void btree_free_page(uint32_t page_no, unsigned char *data) {
+    memset(data, 0, BTREE_PAGE_SIZE);
+    memcpy(data, &primary_tree.header.free_head, sizeof(uint32_t));
+    primary_tree.header.free_head = page_no;
+    primary_tree.header_dirty = 1;
+    btree_unpin(page_no, 1);
+}
+
+// Número de páginas alteradas que ainda não foram gravadas
+int btree_dirty_pages() {
+    pthread_mutex_lock(&btree_cache_lock);
+    int dirty = primary_tree.header_dirty;
+    for (int i = 0; i < primary_tree.frame_count; i++) {
+        dirty += primary_tree.frames[i]->dirty;
+    }
+    pthread_mutex_unlock(&btree_cache_lock);
+    return dirty;
+}
+
+// Visitar as páginas alteradas (o cabeçalho é entregue como página 0)
+void btree_for_each_dirty(void (*callback)(uint32_t page_no, const unsigned char *data, void *context), void *context) {
+    for (int i = 0; i < primary_tree.frame_count; i++) {
+        BTreeFrame *frame = primary_tree.frames[i];
+        if (frame->page_no != 0 && frame->dirty) {
+            callback(frame->page_no, frame->data, context);
+        }
+    }
+
+    if (primary_tree.header_dirty) {
+        unsigned char page[BTREE_PAGE_SIZE];
+        memset(page, 0, BTREE_PAGE_SIZE);
+        memcpy(page, &primary_tree.header, sizeof(BTreeHeader));
+        callback(0, page, context);
+    }
+}
+
+static void btree_flush_page(uint32_t page_no, const unsigned char *data, void *context) {
+    (void)context;
+    btree_write_page(page_no, data);
+}
+
+// Gravar no disco as páginas alteradas e o cabeçalho; o cache volta ao tamanho normal
+void btree_flush() {
+    btree_for_each_dirty(btree_flush_page, NULL);
+    primary_tree.header_dirty = 0;
+
+    int kept = 0;
+    for (int i = 0; i < primary_tree.frame_count; i++) {
+        BTreeFrame *frame = primary_tree.frames[i];
+        frame->dirty = 0;
+        if (kept < BTREE_CACHE_PAGES || frame->pin_count > 0) {
+            primary_tree.frames[kept++] = frame;
+        } else {
+            free(frame);
+        }
+    }
+    primary_tree.frame_count = kept;
+    map_file_remap(&primary_tree.map);
+}
+
+void btree_close() {
+    if (primary_tree.fd < 0) return;
+    btree_flush();
+    map_file_detach(&primary_tree.map);
+    close(primary_tree.fd);
+    primary_tree.fd = -1;
+    for (int i = 0; i < primary_tree.frame_count; i++) {
+        free(primary_tree.frames[i]);
+    }
+    free(primary_tree.frames);
+    primary_tree.frames = NULL;
+    primary_tree.frame_count = 0;
+}
+
+// Posição da primeira entrada da folha com chave >= key
+static int leaf_lower_bound(const unsigned char *page, uint64_t key) {
+    const PrimaryIndex *entries = LEAF_ENTRIES(page);
+    int lo = 0, hi = NODE(page)->count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (entries[mid].key < key) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Índice do filho (0 = first_child, i = entries[i-1].child) que cobre a chave
+static int internal_child_index(const unsigned char *page, uint64_t key) {
+    const BTreeInternalEntry *entries = INTERNAL_ENTRIES(page);
+    int lo = 0, hi = NODE(page)->count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (entries[mid].key <= key) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static uint32_t internal_child(const unsigned char *page, int index) {
+    return index == 0 ? NODE(page)->first_child : INTERNAL_ENTRIES(page)[index - 1].child;
+}
+
+// Buscar o offset de uma chave; retorna -1 se não existir
+long btree_find(uint64_t key) {
+    uint32_t page_no = primary_tree.header.root;
+
+    for (;;) {
+        unsigned char *page = btree_pin(page_no);
+
+        if (NODE(page)->is_leaf) {
+            int pos = leaf_lower_bound(page, key);
+            long offset = -1;
+            if (pos < NODE(page)->count && LEAF_ENTRIES(page)[pos].key == key) {
+                offset = LEAF_ENTRIES(page)[pos].offset;
+            }
+            btree_unpin(page_no, 0);
+            return offset;
+        }
+
+        uint32_t child = internal_child(page, internal_child_index(page, key));
+        btree_unpin(page_no, 0);
+        page_no = child;
+    }
+}
+
+// Inserção recursiva; se o nó dividir, devolve a chave separadora e a nova página
+// Retorna 1 se a chave foi inserida, 0 se já existia (offset atualizado)
+static int btree_insert_rec(uint32_t page_no, uint64_t key, long offset,
+                            uint64_t *split_key, uint32_t *split_page) {
+    unsigned char *page = btree_pin(page_no);
+    BTreeNode *node = NODE(page);
+    *split_page = 0;
+
+    if (node->is_leaf) {
+        PrimaryIndex *entries = LEAF_ENTRIES(page);
+        int pos = leaf_lower_bound(page, key);
+
+        if (pos < node->count && entries[pos].key == key) {
+            entries[pos].offset = offset;
+            btree_unpin(page_no, 1);
+            return 0;
+        }
+
+        if (node->count < BTREE_LEAF_MAX) {
+            memmove(&entries[pos + 1], &entries[pos], (node->count - pos) * sizeof(PrimaryIndex));
+            entries[pos].key = key;
+            entries[pos].offset = offset;
+            node->count++;
+            btree_unpin(page_no, 1);
+            return 1;
+        }
+
+        // Dividir a folha: metade superior vai para uma página nova
+        unsigned char *right_page;
+        uint32_t right_no = btree_alloc_page(&right_page);
+        BTreeNode *right = NODE(right_page);
+        PrimaryIndex *right_entries = LEAF_ENTRIES(right_page);
+        int mid = node->count / 2;
+
+        right->is_leaf = 1;
+        right->count = node->count - mid;
+        memcpy(right_entries, &entries[mid], right->count * sizeof(PrimaryIndex));
+        node->count = mid;
+        right->next = node->next;
+        node->next = right_no;
+
+        unsigned char *target = pos <= mid ? page : right_page;
+        int target_pos = pos <= mid ? pos : pos - mid;
+        PrimaryIndex *target_entries = LEAF_ENTRIES(target);
+        memmove(&target_entries[target_pos + 1], &target_entries[target_pos],
+                (NODE(target)->count - target_pos) * sizeof(PrimaryIndex));
+        target_entries[target_pos].key = key;
+        target_entries[target_pos].offset = offset;
+        NODE(target)->count++;
+
+        *split_key = right_entries[0].key;
+        *split_page = right_no;
+        btree_unpin(right_no, 1);
+        btree_unpin(page_no, 1);
+        return 1;
+    }
+
+    int index = internal_child_index(page, key);
+    uint32_t child = internal_child(page, index);
+    btree_unpin(page_no, 0);
+
+    uint64_t child_key;
+    uint32_t child_split;
+    int inserted = btree_insert_rec(child, key, offset, &child_key, &child_split);
+    if (!child_split) {
+        return inserted;
+    }
+
+    // O filho dividiu: inserir a nova chave separadora neste nó
+    page = btree_pin(page_no);
+    node = NODE(page);
+    BTreeInternalEntry *entries = INTERNAL_ENTRIES(page);
+
+    if (node->count < BTREE_INTERNAL_MAX) {
+        memmove(&entries[index + 1], &entries[index], (node->count - index) * sizeof(BTreeInternalEntry));
+        entries[index].key = child_key;
+        entries[index].child = child_split;
+        node->count++;
+        btree_unpin(page_no, 1);
+        return inserted;
+    }
+
+    // Dividir o nó interno: a entrada do meio sobe para o pai
+    BTreeInternalEntry all[BTREE_INTERNAL_MAX + 1];
+    memcpy(all, entries, index * sizeof(BTreeInternalEntry));
+    all[index].key = child_key;
+    all[index].child = child_split;
+    memcpy(&all[index + 1], &entries[index], (node->count - index) * sizeof(BTreeInternalEntry));
+    int total = node->count + 1;
+    int mid = total / 2;
+
+    unsigned char *right_page;
+    uint32_t right_no = btree_alloc_page(&right_page);
+    BTreeNode *right = NODE(right_page);
+
+    node->count = mid;
+    memcpy(entries, all, mid * sizeof(BTreeInternalEntry));
+    right->is_leaf = 0;
+    right->first_child = all[mid].child;
+    right->count = total - mid - 1;
+    memcpy(INTERNAL_ENTRIES(right_page), &all[mid + 1], right->count * sizeof(BTreeInternalEntry));
+
+    *split_key = all[mid].key;
+    *split_page = right_no;
+    btree_unpin(right_no, 1);
+    btree_unpin(page_no, 1);
+    return inserted;
+}
+
+// Inserir (ou atualizar) uma chave; retorna 1 se for uma chave nova
+int btree_insert(uint64_t key, long offset) {
+    uint64_t split_key;
+    uint32_t split_page;
+
+    int inserted = btree_insert_rec(primary_tree.header.root, key, offset, &split_key, &split_page);
+
+    if (split_page) {
+        // A raiz dividiu: a árvore cresce um nível
+        unsigned char *root_page;
+        uint32_t root_no = btree_alloc_page(&root_page);
+        NODE(root_page)->is_leaf = 0;
+        NODE(root_page)->count = 1;
+        NODE(root_page)->first_child = primary_tree.header.root;
+        INTERNAL_ENTRIES(root_page)[0].key = split_key;
+        INTERNAL_ENTRIES(root_page)[0].child = split_page;
+        btree_unpin(root_no, 1);
+
+        primary_tree.header.root = root_no;
+        primary_tree.header.height++;
+    }
+
+    if (inserted) {
+        primary_tree.header.entry_count++;
+    }
+    primary_tree.header_dirty = 1;
+    return inserted;
+}
+
+// Remover a entrada de índice `index` de um nó interno (e o filho à sua direita)
+static void internal_remove_entry(unsigned char *page, int index) {
+    BTreeInternalEntry *entries = INTERNAL_ENTRIES(page);
+    memmove(&entries[index], &entries[index + 1], (NODE(page)->count - index - 1) * sizeof(BTreeInternalEntry));
+    NODE(page)->count--;
+}
+
+// Rebalancear o filho `index` de um nó interno após uma remoção (empréstimo ou fusão)
+static void btree_fix_child(unsigned char *parent, int index) {
+    BTreeInternalEntry *separators = INTERNAL_ENTRIES(parent);
+    uint32_t child_no = internal_child(parent, index);
+    unsigned char *child = btree_pin(child_no);
+    int is_leaf = NODE(child)->is_leaf;
+    int min = is_leaf ? BTREE_LEAF_MIN : BTREE_INTERNAL_MIN;
+
+    if (NODE(child)->count >= min) {
+        btree_unpin(child_no, 0);
+        return;
+    }
+
+    uint32_t left_no = index > 0 ? internal_child(parent, index - 1) : 0;
+    uint32_t right_no = index < NODE(parent)->count ? internal_child(parent, index + 1) : 0;
+    unsigned char *left = left_no ? btree_pin(left_no) : NULL;
+    unsigned char *right = right_no ? btree_pin(right_no) : NULL;
+
+    if (left && NODE(left)->count > min) {
+        // Emprestar a última entrada do irmão esquerdo
+        if (is_leaf) {
+            PrimaryIndex *entries = LEAF_ENTRIES(child);
+            memmove(&entries[1], &entries[0], NODE(child)->count * sizeof(PrimaryIndex));
+            entries[0] = LEAF_ENTRIES(left)[NODE(left)->count - 1];
+            separators[index - 1].key = entries[0].key;
+        } else {
+            BTreeInternalEntry *entries = INTERNAL_ENTRIES(child);
+            BTreeInternalEntry *last = &INTERNAL_ENTRIES(left)[NODE(left)->count - 1];
+            memmove(&entries[1], &entries[0], NODE(child)->count * sizeof(BTreeInternalEntry));
+            entries[0].key = separators[index - 1].key;
+            entries[0].child = NODE(child)->first_child;
+            NODE(child)->first_child = last->child;
+            separators[index - 1].key = last->key;
+        }
+        NODE(left)->count--;
+        NODE(child)->count++;
+        btree_unpin(left_no, 1);
+        btree_unpin(child_no, 1);
+        if (right) btree_unpin(right_no, 0);
+        return;
+    }
+
+    if (right && NODE(right)->count > min) {
+        // Emprestar a primeira entrada do irmão direito
+        if (is_leaf) {
+            PrimaryIndex *right_entries = LEAF_ENTRIES(right);
+            LEAF_ENTRIES(child)[NODE(child)->count] = right_entries[0];
+            memmove(&right_entries[0], &right_entries[1], (NODE(right)->count - 1) * sizeof(PrimaryIndex));
+            NODE(right)->count--;
+            separators[index].key = right_entries[0].key;
+        } else {
+            BTreeInternalEntry *right_entries = INTERNAL_ENTRIES(right);
+            BTreeInternalEntry *slot = &INTERNAL_ENTRIES(child)[NODE(child)->count];
+            slot->key = separators[index].key;
+            slot->child = NODE(right)->first_child;
+            separators[index].key = right_entries[0].key;
+            NODE(right)->first_child = right_entries[0].child;
+            internal_remove_entry(right, 0);
+        }
+        NODE(child)->count++;
+        btree_unpin(right_no, 1);
+        btree_unpin(child_no, 1);
+        if (left) btree_unpin(left_no, 0);
+        return;
+    }
+
+    // Fundir com um irmão: o nó da direita é incorporado ao da esquerda
+    unsigned char *dst = left ? left : child;
+    unsigned char *src = left ? child : right;
+    uint32_t dst_no = left ? left_no : child_no;
+    uint32_t src_no = left ? child_no : right_no;
+    int separator = left ? index - 1 : index;
+
+    if (is_leaf) {
+        memcpy(&LEAF_ENTRIES(dst)[NODE(dst)->count], LEAF_ENTRIES(src), NODE(src)->count * sizeof(PrimaryIndex));
+        NODE(dst)->count += NODE(src)->count;
+        NODE(dst)->next = NODE(src)->next;
+    } else {
+        BTreeInternalEntry *slot = &INTERNAL_ENTRIES(dst)[NODE(dst)->count];
+        slot->key = separators[separator].key;
+        slot->child = NODE(src)->first_child;
+        memcpy(slot + 1, INTERNAL_ENTRIES(src), NODE(src)->count * sizeof(BTreeInternalEntry));
+        NODE(dst)->count += NODE(src)->count + 1;
+    }
+    internal_remove_entry(parent, separator);
+
+    if (left && right) btree_unpin(right_no, 0);
+    btree_unpin(dst_no, 1);
+    btree_free_page(src_no, src);
+}
+
+// Remoção recursiva; retorna 1 se a chave foi encontrada
+static int btree_delete_rec(uint32_t page_no, uint64_t key) {
+    unsigned char *page = btree_pin(page_no);
+
+    if (NODE(page)->is_leaf) {
+        PrimaryIndex *entries = LEAF_ENTRIES(page);
+        int pos = leaf_lower_bound(page, key);
+        if (pos >= NODE(page)->count || entries[pos].key != key) {
+            btree_unpin(page_no, 0);
+            return 0;
+        }
+        memmove(&entries[pos], &entries[pos + 1], (NODE(page)->count - pos - 1) * sizeof(PrimaryIndex));
+        NODE(page)->count--;
+        btree_unpin(page_no, 1);
+        return 1;
+    }
+
+    int index = internal_child_index(page, key);
+    int found = btree_delete_rec(internal_child(page, index), key);
+    if (found) {
+        btree_fix_child(page, index);
+    }
+    btree_unpin(page_no, found);
+    return found;
+}
+
+// Remover uma chave; retorna 1 se existia
+int btree_delete(uint64_t key) {
+    if (!btree_delete_rec(primary_tree.header.root, key)) {
+        return 0;
+    }
+
+    // Raiz interna sem chaves: a árvore perde um nível
+    uint32_t root_no = primary_tree.header.root;
+    unsigned char *root = btree_pin(root_no);
+    if (!NODE(root)->is_leaf && NODE(root)->count == 0) {
+        primary_tree.header.root = NODE(root)->first_child;
+        primary_tree.header.height--;
+        btree_free_page(root_no, root);
+    } else {
+        btree_unpin(root_no, 0);
+    }
+
+    primary_tree.header.entry_count--;
+    primary_tree.header_dirty = 1;
+    return 1;
+}
+
+// Percorrer todas as entradas em ordem de chave (folhas encadeadas)
+void btree_for_each(void (*callback)(const PrimaryIndex *entry, void *context), void *context) {
+    uint32_t page_no = primary_tree.header.root;
+
+    for (;;) {
+        unsigned char *page = btree_pin(page_no);
+        if (NODE(page)->is_leaf) {
+            btree_unpin(page_no, 0);
+            break;
+        }
+        uint32_t child = NODE(page)->first_child;
+        btree_unpin(page_no, 0);
+        page_no = child;
+    }
+
+    while (page_no) {
+        unsigned char *page = btree_pin(page_no);
+        for (int i = 0; i < NODE(page)->count; i++) {
+            callback(&LEAF_ENTRIES(page)[i], context);
+        }
+        uint32_t next = NODE(page)->next;
+        btree_unpin(page_no, 0);
+        page_no = next;
+    }
+}
+
+// Construir uma árvore nova de baixo para cima a partir de entradas ordenadas
+// (usado na importação em massa e na conversão do formato antigo)
+int btree_build(const char *filename, const PrimaryIndex *entries, long count) {
+    char temp_name[256];
+    snprintf(temp_name, sizeof(temp_name), "%s.tmp", filename);
+
+    int fd = io_open(temp_name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+
+    BTreeHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BTREE_MAGIC, 4);
+    header.version = BTREE_VERSION;
+    header.page_size = BTREE_PAGE_SIZE;
+    header.page_count = 1;
+    header.height = 1;
+    header.entry_count = count;
+
+    unsigned char page[BTREE_PAGE_SIZE];
+    long level_count = count > 0 ? (count + BTREE_LEAF_MAX - 1) / BTREE_LEAF_MAX : 1;
+
+    // Chaves e páginas do nível sendo construído
+    uint64_t *keys = malloc(level_count * sizeof(uint64_t));
+    uint32_t *pages = malloc(level_count * sizeof(uint32_t));
+
+    // Folhas, distribuindo as entradas por igual
+    long pos = 0;
+    for (long i = 0; i < level_count; i++) {
+        long n = count / level_count + (i < count % level_count ? 1 : 0);
+        memset(page, 0, BTREE_PAGE_SIZE);
+        NODE(page)->is_leaf = 1;
+        NODE(page)->count = (uint16_t)n;
+        NODE(page)->next = i + 1 < level_count ? header.page_count + 1 : 0;
+        if (n > 0) {
+            memcpy(LEAF_ENTRIES(page), &entries[pos], n * sizeof(PrimaryIndex));
+            keys[i] = entries[pos].key;
+        } else {
+            keys[i] = 0;
+        }
+        pages[i] = header.page_count++;
+        pos += n;
+
+        if (io_pwrite(fd, page, BTREE_PAGE_SIZE, (off_t)pages[i] * BTREE_PAGE_SIZE) != BTREE_PAGE_SIZE) {
+            goto fail;
+        }
+    }
+
+    // Níveis internos até sobrar um único nó (a raiz)
+    while (level_count > 1) {
+        long fanout = BTREE_INTERNAL_MAX + 1;
+        long parents = (level_count + fanout - 1) / fanout;
+        long child = 0;
+
+        for (long i = 0; i < parents; i++) {
+            long n = level_count / parents + (i < level_count % parents ? 1 : 0);
+            memset(page, 0, BTREE_PAGE_SIZE);
+            NODE(page)->is_leaf = 0;
+            NODE(page)->count = (uint16_t)(n - 1);
+            NODE(page)->first_child = pages[child];
+            for (long j = 1; j < n; j++) {
+                INTERNAL_ENTRIES(page)[j - 1].key = keys[child + j];
+                INTERNAL_ENTRIES(page)[j - 1].child = pages[child + j];
+            }
+
+            // As listas são reaproveitadas: o nó i substitui seu primeiro filho
+            keys[i] = keys[child];
+            pages[i] = header.page_count++;
+            child += n;
+
+            if (io_pwrite(fd, page, BTREE_PAGE_SIZE, (off_t)pages[i] * BTREE_PAGE_SIZE) != BTREE_PAGE_SIZE) {
+                goto fail;
+            }
+        }
+
+        level_count = parents;
+        header.height++;
+    }
+
+    header.root = pages[0];
+    memset(page, 0, BTREE_PAGE_SIZE);
+    memcpy(page, &header, sizeof(header));
+    if (io_pwrite(fd, page, BTREE_PAGE_SIZE, 0) != BTREE_PAGE_SIZE) {
+        goto fail;
+    }
+
+    if (io_fsync(fd) != 0) {
+        goto fail;
+    }
+
+    free(keys);
+    free(pages);
+    close(fd);
+    return rename(temp_name, filename);
+
+fail:
+    free(keys);
+    free(pages);
+    close(fd);
+    unlink(temp_name);
+    return -1;
+}
+
+// Construir a árvore a partir de entradas com o ISBN como texto (formatos
+// anteriores), convertendo cada ISBN para a chave de 64 bits
+static int btree_build_legacy(const char *filename, const LegacyPrimaryIndex *legacy, long count) {
+    PrimaryIndex *entries = malloc((count + 1) * sizeof(PrimaryIndex));
+    long converted = 0, skipped = 0;
+    for (long i = 0; i < count; i++) {
+        char isbn[ISBN_SIZE];
+        memcpy(isbn, legacy[i].isbn, ISBN_SIZE);
+        isbn[ISBN_SIZE - 1] = '\0';
+        if (isbn_stored_key(isbn, &entries[converted].key) == 0) {
+            entries[converted++].offset = legacy[i].offset;
+        } else {
+            skipped++;
+        }
+    }
+    sort_array(entries, converted, sizeof(PrimaryIndex), compare_primary);
+
+    // ISBNs que diferiam só na formatação passam a ser a mesma chave: fica o primeiro
+    long unique = 0;
+    for (long i = 0; i < converted; i++) {
+        if (unique == 0 || entries[unique - 1].key != entries[i].key) {
+            entries[unique++] = entries[i];
+        } else {
+            skipped++;
+        }
+    }
+    if (skipped > 0) {
+        printf("Aviso: %ld ISBNs inválidos ou repetidos ficaram fora do índice primário.\n", skipped);
+    }
+
+    int result = btree_build(filename, entries, unique);
+    free(entries);
+    return result;
+}
+
+// Converter um primary_index.dat no formato antigo (contador + vetor ordenado)
+static int btree_convert_legacy(const char *filename) {
+    FILE *file = io_fopen(filename, "rb");
+    if (!file) return -1;
+
+    int count = 0;
+    LegacyPrimaryIndex *entries = NULL;
+    if (io_fread(&count, sizeof(int), 1, file) == 1 && count > 0) {
+        entries = malloc(count * sizeof(LegacyPrimaryIndex));
+        if (io_fread(entries, sizeof(LegacyPrimaryIndex), count, file) != (size_t)count) {
+            count = 0;
+        }
+    }
+    fclose(file);
+
+    int result = btree_build_legacy(filename, entries, count < 0 ? 0 : count);
+    free(entries);
+    return result;
+}
+
+// Converter uma árvore da versão 1 (ISBN como texto nas folhas), percorrendo as
+// folhas encadeadas a partir da mais à esquerda
+static int btree_convert_v1(const char *filename, int fd, const BTreeHeader *header) {
+    unsigned char page[BTREE_PAGE_SIZE];
+    long capacity = header->entry_count > 0 ? header->entry_count : 1, count = 0;
+    LegacyPrimaryIndex *entries = malloc(capacity * sizeof(LegacyPrimaryIndex));
+    uint32_t page_no = header->root;
+    int ok = 1;
+
+    for (uint32_t level = 0; ok; level++) {
+        ok = level < header->height && page_no > 0 && page_no < header->page_count &&
+             io_pread(fd, page, BTREE_PAGE_SIZE, (off_t)page_no * BTREE_PAGE_SIZE) == BTREE_PAGE_SIZE;
+        if (!ok || NODE(page)->is_leaf) break;
+        page_no = NODE(page)->first_child;
+    }
+    for (uint32_t visited = 0; ok && page_no; visited++) {
+        ok = visited < header->page_count && page_no < header->page_count &&
+             io_pread(fd, page, BTREE_PAGE_SIZE, (off_t)page_no * BTREE_PAGE_SIZE) == BTREE_PAGE_SIZE &&
+             NODE(page)->is_leaf &&
+             NODE(page)->count <= (BTREE_PAGE_SIZE - sizeof(BTreeNode)) / sizeof(LegacyPrimaryIndex);
+        if (!ok) break;
+        if (count + NODE(page)->count > capacity) {
+            capacity = 2 * capacity + NODE(page)->count;
+            entries = realloc(entries, capacity * sizeof(LegacyPrimaryIndex));
+        }
+        memcpy(&entries[count], page + sizeof(BTreeNode), NODE(page)->count * sizeof(LegacyPrimaryIndex));
+        count += NODE(page)->count;
+        page_no = NODE(page)->next;
+    }
+
+    int result = ok ? btree_build_legacy(filename, entries, count) : -1;
+    free(entries);
+    return result;
+}
+
+// Abrir o índice primário, criando uma árvore vazia se o arquivo não existir
+// Retorna 0 em caso de sucesso, -1 em erro e -2 se o arquivo estiver truncado
+int btree_open(const char *filename) {
+    int fd = io_open(filename, O_RDWR, 0);
+    if (fd < 0) {
+        if (btree_build(filename, NULL, 0) != 0) return -1;
+        fd = io_open(filename, O_RDWR, 0);
+        if (fd < 0) return -1;
+    }
+
+    BTreeHeader header;
+    if (io_pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+        memcmp(header.magic, BTREE_MAGIC, 4) != 0) {
+        close(fd);
+        printf("Convertendo índice primário para o formato de árvore B+...\n");
+        if (btree_convert_legacy(filename) != 0) return -1;
+        return btree_open(filename);
+    }
+
+    if (header.version == 1 && header.page_size == BTREE_PAGE_SIZE) {
+        printf("Convertendo índice primário para chaves de ISBN de 64 bits...\n");
+        int result = btree_convert_v1(filename, fd, &header);
+        close(fd);
+        if (result != 0) return -1;
+        return btree_open(filename);
+    }
+
+    if (header.version != BTREE_VERSION || header.page_size != BTREE_PAGE_SIZE) {
+        printf("Versão do índice primário não suportada!\n");
+        close(fd);
+        return -1;
+    }
+
+    // Um arquivo truncado ou com cabeçalho incoerente é recusado sem ler as páginas
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (uint64_t)header.page_count * BTREE_PAGE_SIZE > (uint64_t)st.st_size ||
+        header.root == 0 || header.root >= header.page_count || header.height < 1 || header.entry_count < 0) {
+        close(fd);
+        return -2;
+    }
+
+    memset(&primary_tree, 0, sizeof(primary_tree));
+    primary_tree.fd = fd;
+    primary_tree.header = header;
+    if (map_file_attach(&primary_tree.map, fd, POSIX_MADV_RANDOM) != 0) {
+        // Sem mapeamento as páginas são lidas com pread
+        primary_tree.map.fd = fd;
+    }
+    return 0;
+}
+
+// ===================== TABELA HASH DO ÍNDICE PRIMÁRIO =====================
+//
+// Buscas pontuais por ISBN não precisam da ordem da árvore: uma tabela hash em
+// memória (endereçamento aberto, sondagem linear) leva a chave ao offset com um
+// único acesso, sem descer pelas páginas. A árvore continua sendo a cópia
+// persistente; a tabela é montada a partir dela ao carregar e mantida junto com
+// ela em add_primary_index/remove_primary_index. A chave 0 marca posição vazia
+// (nenhum ISBN tem chave 0).
+//
+// A tabela é gravada em primary_hash.dat nos checkpoints e mapeada na carga, desde
+// que corresponda à árvore (mesmo inode de primary_index.dat e mesmo número de
+// entradas); caso contrário é remontada a partir das folhas.
+//
+//   primary_hash.dat: cabeçalho de índice mapeado (contadores: capacidade,
+//                     entradas), vetor de PrimaryHashEntry
+
+typedef struct {
+    uint64_t key;
+    int64_t offset;
+} PrimaryHashEntry;
+
+typedef struct {
+    PrimaryHashEntry *slots;
+    size_t mask;                // capacidade - 1 (capacidade é potência de 2)
+    size_t count;
+    int dirty;                  // alterada desde a última gravação
+    IndexMapping mapping;
+} PrimaryHash;
+
+PrimaryHash primary_hash = { NULL, 0, 0, 0, { NULL, 0 } };
+
+static size_t primary_hash_slot(uint64_t key) {
+    return (size_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & primary_hash.mask;
+}
+
+void primary_hash_clear() {
+    mapping_free(&primary_hash.mapping, primary_hash.slots);
+    mapping_release(&primary_hash.mapping);
+    primary_hash.slots = NULL;
+    primary_hash.mask = 0;
+    primary_hash.count = 0;
+    primary_hash.dirty = 0;
+}
+
+// Redimensionar para comportar count chaves com fator de carga <= 0,5
+static void primary_hash_reserve(size_t count) {
+    size_t capacity = 16;
+    while (capacity < 2 * count) capacity *= 2;
+    if (primary_hash.slots && capacity <= primary_hash.mask + 1) return;
+
+    PrimaryHashEntry *old = primary_hash.slots;
+    size_t old_capacity = old ? primary_hash.mask + 1 : 0;
+    primary_hash.slots = calloc(capacity, sizeof(PrimaryHashEntry));
+    primary_hash.mask = capacity - 1;
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old[i].key == 0) continue;
+        size_t slot = primary_hash_slot(old[i].key);
+        while (primary_hash.slots[slot].key != 0) slot = (slot + 1) & primary_hash.mask;
+        primary_hash.slots[slot] = old[i];
+    }
+    mapping_free(&primary_hash.mapping, old);
+}
+
+long primary_hash_find(uint64_t key) {
+    if (!primary_hash.slots) return -1;
+    for (size_t slot = primary_hash_slot(key); primary_hash.slots[slot].key != 0;
+         slot = (slot + 1) & primary_hash.mask) {
+        if (primary_hash.slots[slot].key == key) return (long)primary_hash.slots[slot].offset;
+    }
+    return -1;
+}
+
+// Copiar para fora do mapeamento a tabela, antes de alterá-la no lugar
+static void primary_hash_own() {
+    primary_hash.slots = mapping_own(&primary_hash.mapping, primary_hash.slots,
+                                     (primary_hash.mask + 1) * sizeof(PrimaryHashEntry));
+}
+
+void primary_hash_put(uint64_t key, long offset) {
+    primary_hash_reserve(primary_hash.count + 1);
+    primary_hash_own();
+    size_t slot = primary_hash_slot(key);
+    while (primary_hash.slots[slot].key != 0 && primary_hash.slots[slot].key != key) {
+        slot = (slot + 1) & primary_hash.mask;
+    }
+    if (primary_hash.slots[slot].key == 0) primary_hash.count++;
+    primary_hash.slots[slot].key = key;
+    primary_hash.slots[slot].offset = offset;
+    primary_hash.dirty = 1;
+}
+
+// Remover uma chave, puxando de volta as entradas seguintes da mesma sequência
+// para que nenhuma busca pare antes da hora (sem marcadores de remoção)
+void primary_hash_delete(uint64_t key) {
+    if (!primary_hash.slots) return;
+    size_t slot = primary_hash_slot(key);
+    while (primary_hash.slots[slot].key != key) {
+        if (primary_hash.slots[slot].key == 0) return;
+        slot = (slot + 1) & primary_hash.mask;
+    }
+
+    primary_hash_own();
+    size_t hole = slot;
+    for (size_t next = (hole + 1) & primary_hash.mask; primary_hash.slots[next].key != 0;
+         next = (next + 1) & primary_hash.mask) {
+        size_t home = primary_hash_slot(primary_hash.slots[next].key);
+        // A entrada pode ocupar o buraco se a sua posição ideal não fica entre o buraco e ela
+        if (((next - home) & primary_hash.mask) >= ((next - hole) & primary_hash.mask)) {
+            primary_hash.slots[hole] = primary_hash.slots[next];
+            hole = next;
+        }
+    }
+    primary_hash.slots[hole].key = 0;
+    primary_hash.count--;
+    primary_hash.dirty = 1;
+}
+
+static void primary_hash_collect(const PrimaryIndex *entry, void *context) {
+    (void)context;
+    primary_hash_put(entry->key, entry->offset);
+}
+
+// Montar a tabela a partir das folhas da árvore
+void primary_hash_rebuild() {
+    primary_hash_clear();
+    primary_hash_reserve(primary_tree.header.entry_count);
+    btree_for_each(primary_hash_collect, NULL);
+    primary_hash.dirty = 1;
+}
+
+// Gravar a tabela (só se foi alterada)
+void save_primary_hash() {
+    if (!primary_hash.dirty || !primary_hash.slots) {
+        return;
+    }
+    IndexWriter writer;
+    if (index_writer_open(&writer, "primary_hash.dat.tmp", PRIMARY_HASH_MAGIC, PRIMARY_HASH_VERSION,
+                          file_inode(primary_tree.fd)) != 0) {
+        printf("Erro ao salvar a tabela hash do índice primário!\n");
+        return;
+    }
+    writer.header.counts[0] = primary_hash.mask + 1;
+    writer.header.counts[1] = primary_hash.count;
+    index_write(&writer, primary_hash.slots, (primary_hash.mask + 1) * sizeof(PrimaryHashEntry));
+    if (index_writer_close(&writer, "primary_hash.dat.tmp", "primary_hash.dat") != 0) {
+        printf("Erro ao salvar a tabela hash do índice primário!\n");
+        return;
+    }
+    primary_hash.dirty = 0;
+}
+
+// Mapear a tabela gravada, se ela corresponder à árvore aberta; senão remontá-la
+void load_primary_hash() {
+    IndexFileHeader header;
+    primary_hash_clear();
+    if (index_file_map("primary_hash.dat", PRIMARY_HASH_MAGIC, PRIMARY_HASH_VERSION, &header,
+                       &primary_hash.mapping) == 0) {
+        uint64_t capacity = header.counts[0];
+        if (header.inode == file_inode(primary_tree.fd) && header.counts[1] == (uint64_t)primary_tree.header.entry_count &&
+            capacity >= 16 && (capacity & (capacity - 1)) == 0 && 2 * header.counts[1] <= capacity &&
+            header.payload_size == capacity * sizeof(PrimaryHashEntry)) {
+            primary_hash.slots = (PrimaryHashEntry *)mapping_payload(&primary_hash.mapping);
+            primary_hash.mask = capacity - 1;
+            primary_hash.count = header.counts[1];
+            return;
+        }
+        mapping_release(&primary_hash.mapping);
+    }
+    primary_hash_rebuild();
+    save_primary_hash();
+}
+
+// Carregar índices primários do arquivo
+void load_primary_indices() {
+    int result = btree_open("primary_index.dat");
+    if (result == -2) {
+        printf("Aviso: primary_index.dat está truncado ou corrompido; o índice será reconstruído.\n");
+        catalog_indices_stale = 1;
+        unlink("primary_index.dat");
+        result = btree_open("primary_index.dat");
+    }
+    if (result != 0) {
+        printf("Erro ao abrir índices primários!\n");
+        exit(1);
+    }
+    primary_count = (int)primary_tree.header.entry_count;
+    load_primary_hash();
+}
+
+// Salvar índices primários no arquivo (apenas as páginas alteradas)
+void save_primary_indices() {
+    btree_flush();
+    if (primary_tree.fd >= 0 && io_fsync(primary_tree.fd) != 0) {
+        btree_io_error();
+    }
+    save_primary_hash();
+}
+
+// Mapeamento de secondary_index.dat (secondary_indices pode apontar para ele)
+IndexMapping secondary_mapping;
+
+// Converter índices secundários no formato anterior, calculando as chaves
+static void load_legacy_secondary_indices(FILE *file) {
+    rewind(file);
+    if (io_fread(&secondary_count, sizeof(int), 1, file) != 1 || secondary_count <= 0) {
+        secondary_count = 0;
+        return;
+    }
+
+    LegacySecondaryIndex *legacy = malloc(secondary_count * sizeof(LegacySecondaryIndex));
+    secondary_count = (int)io_fread(legacy, sizeof(LegacySecondaryIndex), secondary_count, file);
+    secondary_indices = malloc((secondary_count + 1) * sizeof(SecondaryIndex));
+
+    for (int i = 0; i < secondary_count; i++) {
+        strcpy(secondary_indices[i].title, legacy[i].title);
+        strcpy(secondary_indices[i].isbn, legacy[i].isbn);
+        make_title_key(legacy[i].title, secondary_indices[i].key);
+    }
+    free(legacy);
+
+    sort_array(secondary_indices, secondary_count, sizeof(SecondaryIndex), compare_secondary);
+}
+
+// ===================== ÍNDICE SECUNDÁRIO: MEMTABLE E RUNS ORDENADAS =====================
+//
+// As alterações do índice secundário não mexem no vetor ordenado principal (a
+// base, secondary_indices). Elas entram em uma memtable pequena e ordenada; quando
+// ela enche, vira uma run: um vetor ordenado e imutável de SecondaryChange. Uma
+// remoção é gravada como lápide (removed = 1). Para cada par (chave, ISBN) vale a
+// versão mais nova: memtable, runs da mais nova para a mais antiga e, por fim, a
+// base. Inserir ou remover custa uma busca binária por camada e um deslocamento
+// dentro da memtable, em vez de deslocar o vetor inteiro.
+//
+// Runs de tamanhos parecidos são intercaladas por uma thread em segundo plano, e
+// quando as alterações passam de 1/SECONDARY_BASE_RATIO da base elas são
+// intercaladas na própria base (a thread também grava a nova base em
+// secondary_index.dat.new). As entradas de uma intercalação são imutáveis, então
+// as buscas continuam enquanto ela corre; o resultado só toma o lugar delas na
+// próxima alteração ou no checkpoint, quando não há leitores (no modo servidor
+// quem altera o catálogo segura catalog_lock para escrita).
+//
+//   secondary_runs.dat: cabeçalho de índice mapeado (contador: alterações),
+//                       vetor de SecondaryChange ordenado (runs e memtable
+//                       intercaladas no checkpoint, lápides incluídas)
+
+typedef struct {
+    SecondaryIndex entry;
+    int32_t removed;
+} SecondaryChange;
+
+typedef struct {
+    SecondaryChange *changes;
+    int count;
+} SecondaryRun;
+
+// Uma camada percorrida pelo cursor: uma run (changes) ou a base (base)
+typedef struct {
+    const SecondaryChange *changes;
+    const SecondaryIndex *base;
+    int pos;
+    int count;
+} SecondarySource;
+
+// Cursor que intercala as camadas em ordem; as fontes vão da mais nova para a mais antiga
+typedef struct {
+    SecondarySource sources[SECONDARY_MAX_RUNS + 2];
+    int count;
+} SecondaryCursor;
+
+// Intercalação em segundo plano de runs[first..last] (e da base, se into_base)
+typedef struct {
+    pthread_t thread;
+    int active;         // iniciada e ainda não instalada
+    int threaded;       // pthread_create funcionou (senão rodou na hora)
+    int done;           // protegido por secondary_lsm.lock
+    int first, last, into_base;
+    SecondaryCursor input;
+    SecondaryRun run;      // resultado quando !into_base
+    SecondaryIndex *base;  // resultado quando into_base
+    int base_count;
+    int base_saved;        // a nova base já está em secondary_index.dat.new
+} SecondaryMerge;
+
+static struct {
+    SecondaryChange memtable[SECONDARY_MEMTABLE_SIZE];
+    int memtable_count;
+    SecondaryRun runs[SECONDARY_MAX_RUNS]; // da mais antiga para a mais nova
+    int run_count;
+    int base_count;      // entradas em secondary_indices
+    int base_dirty;      // base alterada e ainda não gravada
+    int base_prepared;   // secondary_index.dat.new guarda a base atual
+    IndexMapping runs_mapping; // secondary_runs.dat (runs[0] pode apontar para ele)
+    SecondaryMerge merge;
+    pthread_mutex_t lock;
+} secondary_lsm = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static const SecondaryIndex *source_at(const SecondarySource *source, int pos) {
+    return source->changes ? &source->changes[pos].entry : &source->base[pos];
+}
+
+// Primeira posição da camada com entrada >= probe
+static int source_seek(const SecondarySource *source, const SecondaryIndex *probe) {
+    int lo = 0, hi = source->count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (compare_secondary(source_at(source, mid), probe) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static void cursor_add(SecondaryCursor *cursor, const SecondaryChange *changes, const SecondaryIndex *base,
+                       int count, const SecondaryIndex *probe) {
+    SecondarySource *source = &cursor->sources[cursor->count++];
+    source->changes = changes;
+    source->base = base;
+    source->count = count;
+    source->pos = probe ? source_seek(source, probe) : 0;
+}
+
+// Posicionar o cursor na primeira entrada com chave >= key (NULL: início do índice)
+void secondary_cursor_init(SecondaryCursor *cursor, const char *key) {
+    SecondaryIndex probe;
+    if (key) {
+        strcpy(probe.key, key);
+        probe.isbn[0] = '\0';
+    }
+    cursor->count = 0;
+    cursor_add(cursor, secondary_lsm.memtable, NULL, secondary_lsm.memtable_count, key ? &probe : NULL);
+    for (int i = secondary_lsm.run_count - 1; i >= 0; i--) {
+        cursor_add(cursor, secondary_lsm.runs[i].changes, NULL, secondary_lsm.runs[i].count, key ? &probe : NULL);
+    }
+    cursor_add(cursor, NULL, secondary_indices, secondary_lsm.base_count, key ? &probe : NULL);
+}
+
+// Próxima versão em ordem, lápides incluídas; as versões mais antigas do mesmo
+// par são descartadas
+static const SecondaryIndex *secondary_cursor_step(SecondaryCursor *cursor, int *removed) {
+    const SecondaryIndex *best = NULL;
+    int winner = -1;
+    for (int i = 0; i < cursor->count; i++) {
+        SecondarySource *source = &cursor->sources[i];
+        if (source->pos < source->count &&
+            (!best || compare_secondary(source_at(source, source->pos), best) < 0)) {
+            best = source_at(source, source->pos);
+            winner = i;
+        }
+    }
+    if (!best) {
+        return NULL;
+    }
+    SecondarySource *source = &cursor->sources[winner];
+    *removed = source->changes && source->changes[source->pos].removed;
+    for (int i = winner; i < cursor->count; i++) {
+        source = &cursor->sources[i];
+        if (source->pos < source->count && compare_secondary(source_at(source, source->pos), best) == 0) {
+            source->pos++;
+        }
+    }
+    return best;
+}
+
+// Próxima entrada viva em ordem de chave e ISBN
+const SecondaryIndex *secondary_cursor_next(SecondaryCursor *cursor) {
+    const SecondaryIndex *entry;
+    int removed;
+    while ((entry = secondary_cursor_step(cursor, &removed)) && removed) {
+    }
+    return entry;
+}
+
+// Versão atual do par (chave, ISBN); NULL se ausente ou removido
+const SecondaryIndex *secondary_find(const char *key, const char *isbn) {
+    SecondaryIndex probe;
+    strcpy(probe.key, key);
+    strcpy(probe.isbn, isbn);
+
+    SecondarySource source = { secondary_lsm.memtable, NULL, 0, secondary_lsm.memtable_count };
+    for (int i = secondary_lsm.run_count; i >= 0; i--) {
+        int pos = source_seek(&source, &probe);
+        if (pos < source.count && compare_secondary(&source.changes[pos].entry, &probe) == 0) {
+            return source.changes[pos].removed ? NULL : &source.changes[pos].entry;
+        }
+        if (i > 0) {
+            source.changes = secondary_lsm.runs[i - 1].changes;
+            source.count = secondary_lsm.runs[i - 1].count;
+        }
+    }
+
+    SecondarySource base = { NULL, secondary_indices, 0, secondary_lsm.base_count };
+    int pos = source_seek(&base, &probe);
+    return pos < base.count && compare_secondary(&secondary_indices[pos], &probe) == 0 ? &secondary_indices[pos] : NULL;
+}
+
+// Gravar uma base completa em filename (via temp_name)
+static int secondary_write_base(const SecondaryIndex *base, int count, const char *temp_name, const char *filename) {
+    IndexWriter writer;
+    if (index_writer_open(&writer, temp_name, SECONDARY_MAGIC, SECONDARY_VERSION, 0) != 0) {
+        return -1;
+    }
+    writer.header.counts[0] = count;
+    index_write(&writer, base, (size_t)count * sizeof(SecondaryIndex));
+    return index_writer_close(&writer, temp_name, filename);
+}
+
+// Corpo da intercalação (thread em segundo plano); só lê camadas imutáveis
+static void *secondary_merge_run(void *arg) {
+    SecondaryMerge *merge = arg;
+    long capacity = 1;
+    for (int i = 0; i < merge->input.count; i++) {
+        capacity += merge->input.sources[i].count;
+    }
+
+    const SecondaryIndex *entry;
+    int removed;
+    if (merge->into_base) {
+        merge->base = malloc(capacity * sizeof(SecondaryIndex));
+        if (merge->base) {
+            while ((entry = secondary_cursor_next(&merge->input))) {
+                merge->base[merge->base_count++] = *entry;
+            }
+            merge->base_saved = secondary_write_base(merge->base, merge->base_count,
+                                                     "secondary_index.dat.new.tmp", "secondary_index.dat.new") == 0;
+        }
+    } else {
+        merge->run.changes = malloc(capacity * sizeof(SecondaryChange));
+        if (merge->run.changes) {
+            while ((entry = secondary_cursor_step(&merge->input, &removed))) {
+                merge->run.changes[merge->run.count].entry = *entry;
+                merge->run.changes[merge->run.count++].removed = removed;
+            }
+        }
+    }
+
+    pthread_mutex_lock(&secondary_lsm.lock);
+    merge->done = 1;
+    pthread_mutex_unlock(&secondary_lsm.lock);
+    return NULL;
+}
+
+static void secondary_merge_start(int first, int last, int into_base) {
+    SecondaryMerge *merge = &secondary_lsm.merge;
+    memset(merge, 0, sizeof(SecondaryMerge));
+    merge->active = 1;
+    merge->first = first;
+    merge->last = last;
+    merge->into_base = into_base;
+    for (int i = last; i >= first; i--) {
+        cursor_add(&merge->input, secondary_lsm.runs[i].changes, NULL, secondary_lsm.runs[i].count, NULL);
+    }
+    if (into_base) {
+        cursor_add(&merge->input, NULL, secondary_indices, secondary_lsm.base_count, NULL);
+    }
+    merge->threaded = pthread_create(&merge->thread, NULL, secondary_merge_run, merge) == 0;
+    if (!merge->threaded) {
+        secondary_merge_run(merge);
+    }
+}
+
+// Trocar as entradas da intercalação concluída pelo resultado (sem leitores ativos)
+static void secondary_merge_install() {
+    SecondaryMerge *merge = &secondary_lsm.merge;
+    if (!merge->active) return;
+    if (merge->threaded) {
+        pthread_join(merge->thread, NULL);
+    }
+    merge->active = 0;
+    if (merge->into_base ? !merge->base : !merge->run.changes) {
+        return; // sem memória: as entradas continuam valendo
+    }
+
+    int mapped = 0;
+    for (int i = merge->first; i <= merge->last; i++) {
+        mapped |= mapping_contains(&secondary_lsm.runs_mapping, secondary_lsm.runs[i].changes);
+        mapping_free(&secondary_lsm.runs_mapping, secondary_lsm.runs[i].changes);
+    }
+    if (mapped) {
+        mapping_release(&secondary_lsm.runs_mapping);
+    }
+
+    int next = merge->first;
+    if (merge->into_base) {
+        mapping_free(&secondary_mapping, secondary_indices);
+        mapping_release(&secondary_mapping);
+        secondary_indices = merge->base;
+        secondary_lsm.base_count = merge->base_count;
+        secondary_lsm.base_prepared = merge->base_saved;
+        secondary_lsm.base_dirty = !merge->base_saved;
+    } else if (merge->run.count > 0) {
+        secondary_lsm.runs[next++] = merge->run;
+    } else {
+        free(merge->run.changes);
+    }
+    memmove(&secondary_lsm.runs[next], &secondary_lsm.runs[merge->last + 1],
+            (secondary_lsm.run_count - merge->last - 1) * sizeof(SecondaryRun));
+    secondary_lsm.run_count -= merge->last + 1 - next;
+}
+
+// Iniciar uma intercalação, se nenhuma estiver em andamento e houver o que juntar.
+// As runs formam camadas de tamanho crescente: a mais nova é juntada às anteriores
+// enquanto elas não forem muito maiores (cada entrada é copiada O(log n) vezes);
+// com muitas alterações, elas vão para a base
+static void secondary_merge_schedule(int force) {
+    if (secondary_lsm.merge.active || secondary_lsm.run_count == 0) return;
+
+    long delta = 0;
+    for (int i = 0; i < secondary_lsm.run_count; i++) {
+        delta += secondary_lsm.runs[i].count;
+    }
+    int last = secondary_lsm.run_count - 1;
+    if (delta >= SECONDARY_MEMTABLE_SIZE && delta * SECONDARY_BASE_RATIO >= secondary_lsm.base_count) {
+        secondary_merge_start(0, last, 1);
+        return;
+    }
+
+    int first = last;
+    long total = secondary_lsm.runs[last].count;
+    while (first > 0 && (force || secondary_lsm.runs[first - 1].count <= 2 * total)) {
+        total += secondary_lsm.runs[--first].count;
+    }
+    if (first < last) {
+        secondary_merge_start(first, last, 0);
+    }
+}
+
+// Instalar a intercalação em segundo plano se ela já terminou
+static void secondary_merge_poll() {
+    if (!secondary_lsm.merge.active) return;
+    pthread_mutex_lock(&secondary_lsm.lock);
+    int done = secondary_lsm.merge.done;
+    pthread_mutex_unlock(&secondary_lsm.lock);
+    if (done) {
+        secondary_merge_install();
+        secondary_merge_schedule(0);
+    }
+}
+
+// Transformar a memtable cheia em uma run
+static void secondary_flush_memtable() {
+    if (secondary_lsm.run_count == SECONDARY_MAX_RUNS) {
+        secondary_merge_install();
+        if (secondary_lsm.run_count == SECONDARY_MAX_RUNS) {
+            secondary_merge_schedule(1);
+            secondary_merge_install();
+        }
+    }
+
+    SecondaryRun run;
+    run.count = secondary_lsm.memtable_count;
+    run.changes = malloc(run.count * sizeof(SecondaryChange));
+    if (!run.changes) {
+        printf("Erro: memória insuficiente para o índice secundário!\n");
+        exit(1);
+    }
+    memcpy(run.changes, secondary_lsm.memtable, run.count * sizeof(SecondaryChange));
+    secondary_lsm.runs[secondary_lsm.run_count++] = run;
+    secondary_lsm.memtable_count = 0;
+    secondary_merge_schedule(0);
+}
+
+// Registrar uma inserção ou remoção na memtable; retorna 1 se o par já estava
+// presente (remoção de um par ausente não faz nada)
+static int secondary_put(const SecondaryIndex *entry, int removed) {
+    secondary_merge_poll();
+    int present = secondary_find(entry->key, entry->isbn) != NULL;
+    if (removed && !present) {
+        return 0;
+    }
+
+    if (secondary_lsm.memtable_count == SECONDARY_MEMTABLE_SIZE) {
+        secondary_flush_memtable();
+    }
+    SecondarySource memtable = { secondary_lsm.memtable, NULL, 0, secondary_lsm.memtable_count };
+    int pos = source_seek(&memtable, entry);
+    SecondaryChange *change = &secondary_lsm.memtable[pos];
+    if (pos == memtable.count || compare_secondary(&change->entry, entry) != 0) {
+        memmove(change + 1, change, (memtable.count - pos) * sizeof(SecondaryChange));
+        secondary_lsm.memtable_count++;
+    }
+    change->entry = *entry;
+    change->removed = removed;
+    secondary_count += !removed - present;
+    catalog_generation++;
+    return present;
+}
+
+// Liberar o índice secundário (base, runs e memtable)
+void secondary_clear() {
+    secondary_merge_install();
+    for (int i = 0; i < secondary_lsm.run_count; i++) {
+        mapping_free(&secondary_lsm.runs_mapping, secondary_lsm.runs[i].changes);
+    }
+    mapping_release(&secondary_lsm.runs_mapping);
+    secondary_lsm.run_count = 0;
+    secondary_lsm.memtable_count = 0;
+
+    mapping_free(&secondary_mapping, secondary_indices);
+    mapping_release(&secondary_mapping);
+    secondary_indices = NULL;
+    secondary_lsm.base_count = 0;
+    secondary_lsm.base_dirty = 0;
+    secondary_lsm.base_prepared = 0;
+    secondary_count = 0;
+    catalog_generation++;
+}
+
+// Substituir todo o índice secundário por um vetor ordenado (gravado no próximo checkpoint)
+void secondary_set_base(SecondaryIndex *base, int count) {
+    secondary_clear();
+    secondary_indices = base;
+    secondary_lsm.base_count = secondary_count = count;
+    secondary_lsm.base_dirty = 1;
+}
+
+// Carregar secondary_runs.dat sobre a base já carregada e recontar os títulos vivos
+static void load_secondary_runs() {
+    IndexFileHeader header;
+    int status = index_file_map("secondary_runs.dat", SECONDARY_RUNS_MAGIC, SECONDARY_RUNS_VERSION,
+                                &header, &secondary_lsm.runs_mapping);
+    if (status != 0 || header.counts[0] > INT32_MAX ||
+        header.payload_size != header.counts[0] * sizeof(SecondaryChange)) {
+        mapping_release(&secondary_lsm.runs_mapping);
+        if (status != -1) {
+            catalog_indices_stale = 1;
+        }
+        return;
+    }
+
+    SecondaryRun run = { (SecondaryChange *)mapping_payload(&secondary_lsm.runs_mapping), (int)header.counts[0] };
+    SecondarySource base = { NULL, secondary_indices, 0, secondary_lsm.base_count };
+    for (int i = 0; i < run.count; i++) {
+        int pos = source_seek(&base, &run.changes[i].entry);
+        int in_base = pos < base.count && compare_secondary(&secondary_indices[pos], &run.changes[i].entry) == 0;
+        secondary_count += !run.changes[i].removed - in_base;
+    }
+    if (run.count > 0) {
+        secondary_lsm.runs[secondary_lsm.run_count++] = run;
+    }
+}
+
+// Gravar as runs e a memtable intercaladas em secondary_runs.dat
+static int save_secondary_runs() {
+    IndexWriter writer;
+    if (index_writer_open(&writer, "secondary_runs.dat.tmp", SECONDARY_RUNS_MAGIC, SECONDARY_RUNS_VERSION, 0) != 0) {
+        return -1;
+    }
+
+    SecondaryCursor cursor;
+    cursor.count = 0;
+    cursor_add(&cursor, secondary_lsm.memtable, NULL, secondary_lsm.memtable_count, NULL);
+    for (int i = secondary_lsm.run_count - 1; i >= 0; i--) {
+        cursor_add(&cursor, secondary_lsm.runs[i].changes, NULL, secondary_lsm.runs[i].count, NULL);
+    }
+
+    SecondaryChange change;
+    const SecondaryIndex *entry;
+    int removed;
+    while ((entry = secondary_cursor_step(&cursor, &removed))) {
+        change.entry = *entry;
+        change.removed = removed;
+        index_write(&writer, &change, sizeof(change));
+        writer.header.counts[0]++;
+    }
+    return index_writer_close(&writer, "secondary_runs.dat.tmp", "secondary_runs.dat");
+}
+
+// ===================== ÍNDICE DE TRIGRAMAS (BUSCA PARCIAL) =====================
+//
+// Cada título normalizado do índice secundário vira um documento com um
+// identificador sequencial. Para cada trigrama (3 bytes consecutivos da chave)
+// guardamos a lista ordenada dos documentos que o contêm. Uma busca parcial
+// intersecta as listas dos trigramas do termo e só confere com strstr os poucos
+// candidatos que sobram. Documentos removidos ficam marcados como mortos até a
+// próxima reconstrução.
+//
+// O mesmo índice guarda um dicionário ordenado das palavras dos títulos, cada uma
+// com a lista dos documentos que a contêm, usado pela busca aproximada (erros de
+// digitação).
+
+typedef struct {
+    uint32_t key_offset; // posição da chave normalizada em `keys`
+    char isbn[ISBN_SIZE];
+    uint32_t alive;
+} TrigramDoc;
+
+typedef struct {
+    uint32_t trigram; // 0 = posição vazia
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t *ids;
+} TrigramPosting;
+
+typedef struct {
+    uint32_t text_offset; // posição da palavra (terminada em '\0') em `word_text`
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t *ids;
+} TrigramWord;
+
+typedef struct {
+    TrigramDoc *docs;
+    uint32_t doc_count;
+    uint32_t doc_capacity;
+    uint32_t dead_count;
+    char *keys;
+    uint64_t keys_size;
+    uint64_t keys_capacity;
+    TrigramPosting *table;
+    uint32_t table_capacity;
+    uint32_t table_count;
+    TrigramWord *words; // ordenadas pelo texto
+    uint32_t word_count;
+    uint32_t word_capacity;
+    char *word_text;
+    uint64_t word_text_size;
+    uint64_t word_text_capacity;
+    IndexMapping mapping; // docs, keys, textos e listas podem apontar para trigram_index.dat
+} TrigramIndex;
+
+TrigramIndex trigram_index;
+
+static uint32_t trigram_hash(uint32_t trigram) {
+    return trigram * 2654435761U;
+}
+
+// Localizar a lista de um trigrama na tabela hash (criando se pedido)
+static TrigramPosting *trigram_slot(uint32_t trigram, int create) {
+    if (create && (trigram_index.table_count + 1) * 4 > trigram_index.table_capacity * 3) {
+        uint32_t old_capacity = trigram_index.table_capacity;
+        TrigramPosting *old_table = trigram_index.table;
+
+        trigram_index.table_capacity = old_capacity ? old_capacity * 2 : 4096;
+        trigram_index.table = calloc(trigram_index.table_capacity, sizeof(TrigramPosting));
+        uint32_t mask = trigram_index.table_capacity - 1;
+
+        for (uint32_t i = 0; i < old_capacity; i++) {
+            if (old_table[i].trigram) {
+                uint32_t pos = trigram_hash(old_table[i].trigram) & mask;
+                while (trigram_index.table[pos].trigram) pos = (pos + 1) & mask;
+                trigram_index.table[pos] = old_table[i];
+            }
+        }
+        free(old_table);
+    }
+
+    if (trigram_index.table_capacity == 0) {
+        return NULL;
+    }
+
+    uint32_t mask = trigram_index.table_capacity - 1;
+    uint32_t pos = trigram_hash(trigram) & mask;
+    while (trigram_index.table[pos].trigram) {
+        if (trigram_index.table[pos].trigram == trigram) {
+            return &trigram_index.table[pos];
+        }
+        pos = (pos + 1) & mask;
+    }
+
+    if (!create) {
+        return NULL;
+    }
+    trigram_index.table[pos].trigram = trigram;
+    trigram_index.table_count++;
+    return &trigram_index.table[pos];
+}
+
+static int compare_uint32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Extrair os trigramas distintos de uma chave normalizada (em ordem crescente)
+static int extract_trigrams(const char *key, uint32_t *trigrams) {
+    const unsigned char *bytes = (const unsigned char*)key;
+    int count = 0;
+
+    for (int i = 0; bytes[i] && bytes[i + 1] && bytes[i + 2]; i++) {
+        trigrams[count++] = ((uint32_t)bytes[i] << 16) | ((uint32_t)bytes[i + 1] << 8) | bytes[i + 2];
+    }
+
+    sort_array(trigrams, count, sizeof(uint32_t), compare_uint32);
+    int unique = 0;
+    for (int i = 0; i < count; i++) {
+        if (unique == 0 || trigrams[unique - 1] != trigrams[i]) {
+            trigrams[unique++] = trigrams[i];
+        }
+    }
+    return unique;
+}
+
+static const char *trigram_doc_key(uint32_t id) {
+    return trigram_index.keys + trigram_index.docs[id].key_offset;
+}
+
+static const char *trigram_word_text(uint32_t word) {
+    return trigram_index.word_text + trigram_index.words[word].text_offset;
+}
+
+// Próxima palavra de uma chave normalizada a partir de *p (letras, dígitos e bytes
+// UTF-8; espaços e pontuação separam); devolve o tamanho, ou 0 no fim da chave
+static int next_title_word(const char **p, const char **word) {
+    const unsigned char *s = (const unsigned char *)*p;
+    while (*s && *s < 0x80 && !isalnum(*s)) s++;
+    const unsigned char *start = s;
+    while (*s && (*s >= 0x80 || isalnum(*s))) s++;
+    *word = (const char *)start;
+    *p = (const char *)s;
+    return (int)(s - start);
+}
+
+// Comparar a palavra do dicionário com word[0..len)
+static int compare_word_text(const char *text, const char *word, int len) {
+    int result = strncmp(text, word, len);
+    return result != 0 ? result : text[len] != '\0';
+}
+
+// Localizar uma palavra no dicionário ordenado (inserindo na posição, se pedido)
+static TrigramWord *trigram_word_slot(const char *word, int len, int create) {
+    uint32_t lo = 0, hi = trigram_index.word_count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (compare_word_text(trigram_word_text(mid), word, len) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo < trigram_index.word_count && compare_word_text(trigram_word_text(lo), word, len) == 0) {
+        return &trigram_index.words[lo];
+    }
+    if (!create) {
+        return NULL;
+    }
+
+    if (trigram_index.word_text_size + len + 1 > trigram_index.word_text_capacity) {
+        while (trigram_index.word_text_size + len + 1 > trigram_index.word_text_capacity) {
+            trigram_index.word_text_capacity = trigram_index.word_text_capacity ? trigram_index.word_text_capacity * 2 : 65536;
+        }
+        trigram_index.word_text = mapping_realloc(&trigram_index.mapping, trigram_index.word_text,
+                                                  trigram_index.word_text_size, trigram_index.word_text_capacity);
+    }
+    if (trigram_index.word_count == trigram_index.word_capacity) {
+        trigram_index.word_capacity = trigram_index.word_capacity ? trigram_index.word_capacity * 2 : 1024;
+        trigram_index.words = realloc(trigram_index.words, trigram_index.word_capacity * sizeof(TrigramWord));
+    }
+
+    TrigramWord *slot = &trigram_index.words[lo];
+    memmove(slot + 1, slot, (trigram_index.word_count - lo) * sizeof(TrigramWord));
+    trigram_index.word_count++;
+    slot->text_offset = (uint32_t)trigram_index.word_text_size;
+    slot->count = slot->capacity = 0;
+    slot->ids = NULL;
+    memcpy(trigram_index.word_text + trigram_index.word_text_size, word, len);
+    trigram_index.word_text[trigram_index.word_text_size + len] = '\0';
+    trigram_index.word_text_size += len + 1;
+    return slot;
+}
+
+// Adicionar um título (já normalizado) ao índice de trigramas
+void trigram_add(const char *key, const char *isbn) {
+    if (trigram_index.doc_count == trigram_index.doc_capacity) {
+        trigram_index.doc_capacity = trigram_index.doc_capacity ? trigram_index.doc_capacity * 2 : 1024;
+        trigram_index.docs = mapping_realloc(&trigram_index.mapping, trigram_index.docs,
+                                             trigram_index.doc_count * sizeof(TrigramDoc),
+                                             trigram_index.doc_capacity * sizeof(TrigramDoc));
+    }
+
+    size_t key_len = strlen(key) + 1;
+    if (trigram_index.keys_size + key_len > trigram_index.keys_capacity) {
+        while (trigram_index.keys_size + key_len > trigram_index.keys_capacity) {
+            trigram_index.keys_capacity = trigram_index.keys_capacity ? trigram_index.keys_capacity * 2 : 65536;
+        }
+        trigram_index.keys = mapping_realloc(&trigram_index.mapping, trigram_index.keys, trigram_index.keys_size,
+                                             trigram_index.keys_capacity);
+    }
+
+    uint32_t id = trigram_index.doc_count++;
+    TrigramDoc *doc = &trigram_index.docs[id];
+    doc->key_offset = (uint32_t)trigram_index.keys_size;
+    strcpy(doc->isbn, isbn);
+    doc->alive = 1;
+    memcpy(trigram_index.keys + trigram_index.keys_size, key, key_len);
+    trigram_index.keys_size += key_len;
+
+    // Os identificadores são crescentes, então as listas continuam ordenadas
+    uint32_t trigrams[MAX_TITLE];
+    int count = extract_trigrams(key, trigrams);
+    for (int i = 0; i < count; i++) {
+        TrigramPosting *posting = trigram_slot(trigrams[i], 1);
+        if (posting->count == posting->capacity) {
+            posting->capacity = posting->capacity ? posting->capacity * 2 : 4;
+            posting->ids = mapping_realloc(&trigram_index.mapping, posting->ids, posting->count * sizeof(uint32_t),
+                                           posting->capacity * sizeof(uint32_t));
+        }
+        posting->ids[posting->count++] = id;
+    }
+
+    // Palavras do título (uma palavra repetida entra uma vez na lista)
+    const char *p = key, *word;
+    int len;
+    while ((len = next_title_word(&p, &word)) > 0) {
+        TrigramWord *entry = trigram_word_slot(word, len, 1);
+        if (entry->count > 0 && entry->ids[entry->count - 1] == id) {
+            continue;
+        }
+        if (entry->count == entry->capacity) {
+            entry->capacity = entry->capacity ? entry->capacity * 2 : 4;
+            entry->ids = mapping_realloc(&trigram_index.mapping, entry->ids, entry->count * sizeof(uint32_t),
+                                         entry->capacity * sizeof(uint32_t));
+        }
+        entry->ids[entry->count++] = id;
+    }
+}
+
+// Liberar toda a memória do índice de trigramas
+void trigram_clear() {
+    for (uint32_t i = 0; i < trigram_index.table_capacity; i++) {
+        mapping_free(&trigram_index.mapping, trigram_index.table[i].ids);
+    }
+    free(trigram_index.table);
+    for (uint32_t i = 0; i < trigram_index.word_count; i++) {
+        mapping_free(&trigram_index.mapping, trigram_index.words[i].ids);
+    }
+    free(trigram_index.words);
+    mapping_free(&trigram_index.mapping, trigram_index.word_text);
+    mapping_free(&trigram_index.mapping, trigram_index.docs);
+    mapping_free(&trigram_index.mapping, trigram_index.keys);
+    mapping_release(&trigram_index.mapping);
+    memset(&trigram_index, 0, sizeof(trigram_index));
+}
+
+// Reconstruir o índice de trigramas a partir do índice secundário
+void trigram_rebuild() {
+    trigram_clear();
+    SecondaryCursor cursor;
+    const SecondaryIndex *entry;
+    secondary_cursor_init(&cursor, NULL);
+    while ((entry = secondary_cursor_next(&cursor))) {
+        trigram_add(entry->key, entry->isbn);
+    }
+}
+
+// Intersectar as listas dos trigramas da chave; devolve os candidatos (vivos)
+// em um vetor alocado. A conferência final com strstr fica a cargo de quem chama
+static uint32_t trigram_candidates(const char *key, uint32_t **out) {
+    uint32_t trigrams[MAX_TITLE];
+    TrigramPosting *lists[MAX_TITLE];
+    int count = extract_trigrams(key, trigrams);
+
+    *out = NULL;
+    if (count == 0) {
+        return 0;
+    }
+    for (int i = 0; i < count; i++) {
+        lists[i] = trigram_slot(trigrams[i], 0);
+        if (!lists[i]) {
+            return 0;
+        }
+    }
+
+    // Começar pela lista mais curta
+    for (int i = 1; i < count; i++) {
+        for (int j = i; j > 0 && lists[j]->count < lists[j - 1]->count; j--) {
+            TrigramPosting *tmp = lists[j];
+            lists[j] = lists[j - 1];
+            lists[j - 1] = tmp;
+        }
+    }
+
+    uint32_t *result = malloc((lists[0]->count + 1) * sizeof(uint32_t));
+    uint32_t result_count = 0;
+    for (uint32_t i = 0; i < lists[0]->count; i++) {
+        if (trigram_index.docs[lists[0]->ids[i]].alive) {
+            result[result_count++] = lists[0]->ids[i];
+        }
+    }
+
+    for (int l = 1; l < count && result_count > 0; l++) {
+        const uint32_t *ids = lists[l]->ids;
+        uint32_t n = lists[l]->count, lo = 0, kept = 0;
+
+        for (uint32_t i = 0; i < result_count; i++) {
+            // Busca binária a partir da última posição (as duas listas são crescentes)
+            uint32_t hi = n;
+            while (lo < hi) {
+                uint32_t mid = lo + (hi - lo) / 2;
+                if (ids[mid] < result[i]) lo = mid + 1;
+                else hi = mid;
+            }
+            if (lo < n && ids[lo] == result[i]) {
+                result[kept++] = result[i];
+            }
+        }
+        result_count = kept;
+    }
+
+    *out = result;
+    return result_count;
+}
+
+// Marcar como morto o documento de um título removido do índice secundário
+void trigram_remove(const char *key, const char *isbn) {
+    uint32_t *candidates;
+    uint32_t count;
+
+    if (strlen(key) >= 3) {
+        count = trigram_candidates(key, &candidates);
+    } else {
+        candidates = malloc((trigram_index.doc_count + 1) * sizeof(uint32_t));
+        count = 0;
+        for (uint32_t i = 0; i < trigram_index.doc_count; i++) {
+            if (trigram_index.docs[i].alive) candidates[count++] = i;
+        }
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        TrigramDoc *doc = &trigram_index.docs[candidates[i]];
+        if (strcmp(doc->isbn, isbn) == 0 && strcmp(trigram_doc_key(candidates[i]), key) == 0) {
+            trigram_index.docs = mapping_own(&trigram_index.mapping, trigram_index.docs,
+                                             trigram_index.doc_count * sizeof(TrigramDoc));
+            trigram_index.docs[candidates[i]].alive = 0;
+            trigram_index.dead_count++;
+            break;
+        }
+    }
+    free(candidates);
+
+    // Muitos documentos mortos: reconstruir para encurtar as listas
+    if (trigram_index.dead_count > TRIGRAM_MIN_DEAD && trigram_index.dead_count * 2 > trigram_index.doc_count) {
+        trigram_rebuild();
+    }
+}
+
+// Documentos cujo título contém o termo (já normalizado, com 3 ou mais bytes),
+// em ordem de identificador; *out fica NULL se não houver candidatos
+uint32_t trigram_matches(const char *normalized_search, uint32_t **out) {
+    uint32_t count = trigram_candidates(normalized_search, out);
+    uint32_t matches = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (strstr(trigram_doc_key((*out)[i]), normalized_search)) {
+            (*out)[matches++] = (*out)[i];
+        }
+    }
+    return matches;
+}
+
+// ----- Busca aproximada (distância de edição) -----
+
+typedef struct {
+    uint32_t id;       // palavra do dicionário ou documento
+    uint32_t distance;
+} FuzzyMatch;
+
+// Distância máxima aceita para uma palavra do termo: palavras curtas precisam
+// ser exatas, senão quase tudo ficaria a uma edição delas
+static int fuzzy_max_distance(int len) {
+    int distance = len <= 2 ? 0 : len <= 5 ? 1 : 2;
+    return distance < FUZZY_MAX_DISTANCE ? distance : FUZZY_MAX_DISTANCE;
+}
+
+// Palavras do dicionário a no máximo max_distance edições de query. Uma edição é
+// inserir, remover ou trocar um byte, ou inverter dois bytes vizinhos ("huntre").
+// O dicionário ordenado é percorrido como uma trie: palavras vizinhas compartilham
+// o prefixo, e as linhas da tabela de distâncias já calculadas para ele são
+// reaproveitadas. Quando uma linha inteira passa do limite (e a anterior não
+// permite mais uma inversão), nenhuma palavra com aquele prefixo serve, e o bloco
+// inteiro é pulado por busca binária; só uma pequena parte do dicionário é visitada
+static uint32_t fuzzy_words(const char *query, int query_len, int max_distance, FuzzyMatch **out) {
+    unsigned char rows[MAX_TITLE][MAX_TITLE];
+    unsigned char row_min[MAX_TITLE];
+    uint32_t count = 0, capacity = 16;
+    FuzzyMatch *matches = malloc(capacity * sizeof(FuzzyMatch));
+
+    for (int j = 0; j <= query_len; j++) {
+        rows[0][j] = (unsigned char)j;
+    }
+    row_min[0] = 0;
+
+    const char *previous = "";
+    int valid = 0; // linhas válidas para o prefixo de previous
+    uint32_t i = 0;
+    while (i < trigram_index.word_count) {
+        const char *word = trigram_word_text(i);
+        int depth = 0;
+        while (depth < valid && word[depth] == previous[depth]) depth++;
+
+        int pruned = 0;
+        for (; word[depth] && depth < MAX_TITLE - 1; depth++) {
+            unsigned char *above = rows[depth], *row = rows[depth + 1];
+            int best = row[0] = (unsigned char)(depth + 1);
+            for (int j = 1; j <= query_len; j++) {
+                int cost = above[j - 1] + (query[j - 1] != word[depth]);
+                if (above[j] + 1 < cost) cost = above[j] + 1;
+                if (row[j - 1] + 1 < cost) cost = row[j - 1] + 1;
+                if (depth > 0 && j > 1 && query[j - 1] == word[depth - 1] && query[j - 2] == word[depth] &&
+                    rows[depth - 1][j - 2] + 1 < cost) {
+                    cost = rows[depth - 1][j - 2] + 1;
+                }
+                row[j] = (unsigned char)cost;
+                if (cost < best) best = cost;
+            }
+            row_min[depth + 1] = (unsigned char)best;
+            if (best > max_distance && row_min[depth] >= max_distance) {
+                pruned = 1;
+                depth++;
+                break;
+            }
+        }
+        previous = word;
+        valid = depth;
+
+        if (pruned) {
+            // Primeira palavra depois do bloco com o prefixo word[0..depth)
+            uint32_t lo = i + 1, hi = trigram_index.word_count;
+            while (lo < hi) {
+                uint32_t mid = lo + (hi - lo) / 2;
+                if (strncmp(trigram_word_text(mid), word, depth) == 0) lo = mid + 1;
+                else hi = mid;
+            }
+            i = lo;
+            continue;
+        }
+
+        if (rows[depth][query_len] <= max_distance && trigram_index.words[i].count > 0) {
+            if (count == capacity) {
+                capacity *= 2;
+                matches = realloc(matches, capacity * sizeof(FuzzyMatch));
+            }
+            matches[count].id = i;
+            matches[count++].distance = rows[depth][query_len];
+        }
+        i++;
+    }
+
+    *out = matches;
+    return count;
+}
+
+static int compare_match_id(const void *a, const void *b) {
+    const FuzzyMatch *x = a, *y = b;
+    if (x->id != y->id) return x->id < y->id ? -1 : 1;
+    return (x->distance > y->distance) - (x->distance < y->distance);
+}
+
+static int compare_match_rank(const void *a, const void *b) {
+    const FuzzyMatch *x = a, *y = b;
+    if (x->distance != y->distance) return x->distance < y->distance ? -1 : 1;
+    return strcmp(trigram_doc_key(x->id), trigram_doc_key(y->id));
+}
+
+// Documentos vivos que contêm alguma das palavras encontradas, em ordem de
+// identificador, cada um com a menor distância entre as suas palavras
+static uint32_t fuzzy_documents(const FuzzyMatch *words, uint32_t word_count, FuzzyMatch **out) {
+    size_t total = 0;
+    for (uint32_t w = 0; w < word_count; w++) {
+        total += trigram_index.words[words[w].id].count;
+    }
+
+    FuzzyMatch *docs = malloc((total + 1) * sizeof(FuzzyMatch));
+    uint32_t count = 0;
+    for (uint32_t w = 0; w < word_count; w++) {
+        const TrigramWord *entry = &trigram_index.words[words[w].id];
+        for (uint32_t i = 0; i < entry->count; i++) {
+            if (trigram_index.docs[entry->ids[i]].alive) {
+                docs[count].id = entry->ids[i];
+                docs[count++].distance = words[w].distance;
+            }
+        }
+    }
+
+    if (word_count > 1) {
+        sort_array(docs, count, sizeof(FuzzyMatch), compare_match_id);
+        uint32_t unique = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            if (unique == 0 || docs[unique - 1].id != docs[i].id) {
+                docs[unique++] = docs[i];
+            }
+        }
+        count = unique;
+    }
+    *out = docs;
+    return count;
+}
+
+// Buscar títulos com erros de digitação: cada palavra do termo (já normalizado)
+// precisa estar, a poucas edições de distância, em alguma palavra do título.
+// Devolve até max_results títulos, dos mais próximos (soma das distâncias) para
+// os mais distantes
+int trigram_fuzzy_search(const char *normalized_search, TitleHit *hits, int max_results) {
+    FuzzyMatch *result = NULL;
+    uint32_t result_count = 0;
+    int terms = 0;
+
+    const char *p = normalized_search, *word;
+    int len;
+    while (terms < FUZZY_MAX_WORDS && (len = next_title_word(&p, &word)) > 0) {
+        char query[MAX_TITLE];
+        memcpy(query, word, len);
+        query[len] = '\0';
+
+        FuzzyMatch *words, *docs;
+        uint32_t word_count = fuzzy_words(query, len, fuzzy_max_distance(len), &words);
+        uint32_t doc_count = fuzzy_documents(words, word_count, &docs);
+        free(words);
+
+        if (terms++ == 0) {
+            result = docs;
+            result_count = doc_count;
+        } else {
+            // Interseção (as duas listas estão em ordem de identificador)
+            uint32_t kept = 0, j = 0;
+            for (uint32_t i = 0; i < result_count; i++) {
+                while (j < doc_count && docs[j].id < result[i].id) j++;
+                if (j < doc_count && docs[j].id == result[i].id) {
+                    result[kept].id = result[i].id;
+                    result[kept++].distance = result[i].distance + docs[j].distance;
+                }
+            }
+            result_count = kept;
+            free(docs);
+        }
+        if (result_count == 0) break;
+    }
+    if (terms == 0) {
+        return 0;
+    }
+
+    sort_array(result, result_count, sizeof(FuzzyMatch), compare_match_rank);
+    int found = 0;
+    for (uint32_t i = 0; i < result_count && found < max_results; i++) {
+        TitleHit *hit = &hits[found++];
+        const char *key = trigram_doc_key(result[i].id);
+        const SecondaryIndex *entry = secondary_find(key, trigram_index.docs[result[i].id].isbn);
+        strcpy(hit->isbn, trigram_index.docs[result[i].id].isbn);
+        strcpy(hit->title, entry ? entry->title : key);
+        hit->match = MATCH_SIMILAR;
+        hit->position = 0;
+        hit->distance = (int)result[i].distance;
+    }
+    free(result);
+    return found;
+}
+
+// Lista de um trigrama no arquivo (os identificadores ficam na última seção)
+typedef struct {
+    uint32_t trigram;
+    uint32_t count;
+    uint64_t ids_offset; // em identificadores, a partir do início da seção
+} TrigramFileEntry;
+
+// Dicionário de palavras no arquivo (depois dos identificadores dos trigramas)
+typedef struct {
+    uint64_t word_count;
+    uint64_t text_size;
+} TrigramWordSection;
+
+typedef struct {
+    uint32_t text_offset;
+    uint32_t count;
+    uint64_t ids_offset; // em identificadores, a partir do início da seção
+} TrigramWordFileEntry;
+
+// Salvar o índice de trigramas
+//
+//   trigram_index.dat: cabeçalho de índice mapeado (contadores: documentos,
+//                      mortos, bytes das chaves, trigramas), TrigramDoc[],
+//                      chaves, TrigramFileEntry[], identificadores,
+//                      TrigramWordSection, TrigramWordFileEntry[] (em ordem
+//                      alfabética), textos das palavras, identificadores
+void save_trigram_index() {
+    IndexWriter writer;
+    if (index_writer_open(&writer, "trigram_index.dat.tmp", TRIGRAM_MAGIC, TRIGRAM_VERSION, 0) != 0) {
+        printf("Erro ao salvar índice de trigramas!\n");
+        return;
+    }
+    writer.header.counts[0] = trigram_index.doc_count;
+    writer.header.counts[1] = trigram_index.dead_count;
+    writer.header.counts[2] = trigram_index.keys_size;
+    writer.header.counts[3] = trigram_index.table_count;
+    index_write(&writer, trigram_index.docs, (size_t)trigram_index.doc_count * sizeof(TrigramDoc));
+    index_write_align(&writer);
+    index_write(&writer, trigram_index.keys, trigram_index.keys_size);
+    index_write_align(&writer);
+
+    uint64_t ids_offset = 0;
+    for (uint32_t i = 0; i < trigram_index.table_capacity; i++) {
+        TrigramPosting *posting = &trigram_index.table[i];
+        if (posting->trigram) {
+            TrigramFileEntry entry = { posting->trigram, posting->count, ids_offset };
+            index_write(&writer, &entry, sizeof(entry));
+            ids_offset += posting->count;
+        }
+    }
+    for (uint32_t i = 0; i < trigram_index.table_capacity; i++) {
+        TrigramPosting *posting = &trigram_index.table[i];
+        if (posting->trigram) {
+            index_write(&writer, posting->ids, (size_t)posting->count * sizeof(uint32_t));
+        }
+    }
+    index_write_align(&writer);
+
+    TrigramWordSection section = { trigram_index.word_count, trigram_index.word_text_size };
+    index_write(&writer, &section, sizeof(section));
+    ids_offset = 0;
+    for (uint32_t i = 0; i < trigram_index.word_count; i++) {
+        TrigramWord *word = &trigram_index.words[i];
+        TrigramWordFileEntry entry = { word->text_offset, word->count, ids_offset };
+        index_write(&writer, &entry, sizeof(entry));
+        ids_offset += word->count;
+    }
+    index_write(&writer, trigram_index.word_text, trigram_index.word_text_size);
+    index_write_align(&writer);
+    for (uint32_t i = 0; i < trigram_index.word_count; i++) {
+        index_write(&writer, trigram_index.words[i].ids, (size_t)trigram_index.words[i].count * sizeof(uint32_t));
+    }
+    if (index_writer_close(&writer, "trigram_index.dat.tmp", "trigram_index.dat") != 0) {
+        printf("Erro ao salvar índice de trigramas!\n");
+    }
+}
+
+// Carregar o índice de trigramas a partir do mapeamento; só a tabela hash dos
+// trigramas é montada, e as listas apontam para o arquivo
+// Retorna 0 se o arquivo for válido
+static int read_trigram_index() {
+    IndexFileHeader header;
+    int status = index_file_map("trigram_index.dat", TRIGRAM_MAGIC, TRIGRAM_VERSION, &header, &trigram_index.mapping);
+    if (status != 0) {
+        return status;
+    }
+
+    uint64_t doc_count = header.counts[0], keys_size = header.counts[2], table_count = header.counts[3];
+    uint64_t payload = header.payload_size;
+    size_t docs_bytes = index_align(doc_count * sizeof(TrigramDoc));
+    size_t keys_bytes = index_align(keys_size);
+    size_t entries_bytes = table_count * sizeof(TrigramFileEntry);
+    if (doc_count > UINT32_MAX || header.counts[1] > doc_count || table_count > UINT32_MAX / 2 ||
+        docs_bytes + keys_bytes + entries_bytes > payload) {
+        return -2;
+    }
+
+    unsigned char *base = mapping_payload(&trigram_index.mapping);
+    const TrigramFileEntry *entries = (const TrigramFileEntry *)(base + docs_bytes + keys_bytes);
+    uint32_t *ids = (uint32_t *)(base + docs_bytes + keys_bytes + entries_bytes);
+    uint64_t ids_count = (payload - docs_bytes - keys_bytes - entries_bytes) / sizeof(uint32_t);
+    uint64_t ids_used = 0;
+
+    trigram_index.docs = (TrigramDoc *)base;
+    trigram_index.doc_count = trigram_index.doc_capacity = (uint32_t)doc_count;
+    trigram_index.dead_count = (uint32_t)header.counts[1];
+    trigram_index.keys = (char *)(base + docs_bytes);
+    trigram_index.keys_size = trigram_index.keys_capacity = keys_size;
+
+    // Tabela já no tamanho final, sem redistribuições durante a carga
+    uint32_t capacity = 4096;
+    while ((table_count + 1) * 4 > (uint64_t)capacity * 3) capacity *= 2;
+    trigram_index.table = calloc(capacity, sizeof(TrigramPosting));
+    trigram_index.table_capacity = capacity;
+
+    for (uint32_t i = 0; i < table_count; i++) {
+        if (entries[i].trigram == 0 || entries[i].ids_offset + entries[i].count > ids_count) {
+            return -2;
+        }
+        TrigramPosting *posting = trigram_slot(entries[i].trigram, 1);
+        posting->count = posting->capacity = entries[i].count;
+        posting->ids = ids + entries[i].ids_offset;
+        ids_used += entries[i].count;
+    }
+
+    // Dicionário de palavras
+    size_t words_start = docs_bytes + keys_bytes + entries_bytes + index_align(ids_used * sizeof(uint32_t));
+    if (words_start + sizeof(TrigramWordSection) > payload) {
+        return -2;
+    }
+    TrigramWordSection section;
+    memcpy(&section, base + words_start, sizeof(section));
+    size_t word_entries_bytes = section.word_count * sizeof(TrigramWordFileEntry);
+    size_t text_start = words_start + sizeof(TrigramWordSection) + word_entries_bytes;
+    if (section.word_count > UINT32_MAX / 2 || section.text_size > UINT32_MAX ||
+        text_start + index_align(section.text_size) > payload) {
+        return -2;
+    }
+    const TrigramWordFileEntry *word_entries = (const TrigramWordFileEntry *)(base + words_start + sizeof(TrigramWordSection));
+    uint32_t *word_ids = (uint32_t *)(base + text_start + index_align(section.text_size));
+    uint64_t word_ids_count = (payload - text_start - index_align(section.text_size)) / sizeof(uint32_t);
+
+    trigram_index.word_text = (char *)(base + text_start);
+    trigram_index.word_text_size = trigram_index.word_text_capacity = section.text_size;
+    trigram_index.words = malloc((section.word_count + 1) * sizeof(TrigramWord));
+    trigram_index.word_capacity = (uint32_t)section.word_count + 1;
+    for (uint32_t i = 0; i < section.word_count; i++) {
+        if (word_entries[i].text_offset >= section.text_size ||
+            word_entries[i].ids_offset + word_entries[i].count > word_ids_count) {
+            return -2;
+        }
+        TrigramWord *word = &trigram_index.words[trigram_index.word_count++];
+        word->text_offset = word_entries[i].text_offset;
+        word->count = word->capacity = word_entries[i].count;
+        word->ids = word_ids + word_entries[i].ids_offset;
+    }
+    return 0;
+}
+
+// Carregar o índice de trigramas, reconstruindo se ausente ou desatualizado
+void load_trigram_index() {
+    trigram_clear();
+    if (read_trigram_index() != 0 ||
+        trigram_index.doc_count - trigram_index.dead_count != (uint32_t)secondary_count) {
+        trigram_rebuild();
+        save_trigram_index();
+    }
+}
+
+void save_secondary_indices();
+
+// Ler os formatos anteriores do índice secundário (lidos e copiados para a memória);
+// retorna 0 se o arquivo não existir ou for de uma versão que exige reconstrução
+static int load_previous_secondary_indices() {
+    FILE *file = io_fopen("secondary_index.dat", "rb");
+    if (!file) {
+        return 0;
+    }
+
+    char magic[4];
+    uint32_t version;
+    int has_magic = io_fread(magic, 1, 4, file) == 4 && memcmp(magic, SECONDARY_MAGIC, 4) == 0;
+    if (!has_magic || io_fread(&version, sizeof(uint32_t), 1, file) != 1) {
+        load_legacy_secondary_indices(file);
+    } else if (version == 1) {
+        if (io_fread(&secondary_count, sizeof(int), 1, file) != 1 || secondary_count < 0) {
+            secondary_count = 0;
+        }
+        if (secondary_count > 0) {
+            secondary_indices = malloc(secondary_count * sizeof(SecondaryIndex));
+            secondary_count = (int)io_fread(secondary_indices, sizeof(SecondaryIndex), secondary_count, file);
+        }
+        // As chaves gravadas seguem a normalização antiga: recalcular e reordenar
+        for (int i = 0; i < secondary_count; i++) {
+            make_title_key(secondary_indices[i].title, secondary_indices[i].key);
+        }
+        sort_array(secondary_indices, secondary_count, sizeof(SecondaryIndex), compare_secondary);
+    } else {
+        // Arquivo mapeado de uma versão anterior: reconstruir a partir de mangas.dat
+        fclose(file);
+        catalog_indices_stale = 1;
+        return 0;
+    }
+    fclose(file);
+    return 1;
+}
+
+// Carregar índices secundários: a base e as runs são usadas diretamente no
+// mapeamento dos arquivos
+//
+//   secondary_index.dat: cabeçalho de índice mapeado (contador: entradas),
+//                        vetor de SecondaryIndex ordenado pela chave
+void load_secondary_indices() {
+    IndexFileHeader header;
+    secondary_clear();
+    int status = index_file_map("secondary_index.dat", SECONDARY_MAGIC, SECONDARY_VERSION, &header, &secondary_mapping);
+    if (status == 0 && header.counts[0] <= INT32_MAX &&
+        header.payload_size == header.counts[0] * sizeof(SecondaryIndex)) {
+        secondary_indices = (SecondaryIndex *)mapping_payload(&secondary_mapping);
+        secondary_lsm.base_count = secondary_count = (int)header.counts[0];
+        load_secondary_runs();
+        load_trigram_index();
+    } else if (status != -1) {
+        mapping_release(&secondary_mapping);
+        catalog_indices_stale = 1;
+        load_trigram_index();
+    } else if (load_previous_secondary_indices()) {
+        // Convertido para o formato atual
+        secondary_lsm.base_count = secondary_count;
+        secondary_lsm.base_dirty = 1;
+        load_trigram_index();
+        save_secondary_indices();
+    } else {
+        // Sem base gravada (catálogo novo): as alterações valem sobre uma base vazia
+        load_secondary_runs();
+        load_trigram_index();
+    }
+}
+
+// Salvar índices secundários: a base só é regravada quando mudou (se a intercalação
+// em segundo plano já a gravou, basta o rename); as alterações vão para secondary_runs.dat
+void save_secondary_indices() {
+    secondary_merge_poll();
+    if (secondary_lsm.base_dirty) {
+        if (secondary_write_base(secondary_indices, secondary_lsm.base_count,
+                                 "secondary_index.dat.tmp", "secondary_index.dat") != 0) {
+            printf("Erro ao salvar índices secundários!\n");
+            return;
+        }
+        secondary_lsm.base_dirty = 0;
+    } else if (secondary_lsm.base_prepared) {
+        if (rename("secondary_index.dat.new", "secondary_index.dat") != 0) {
+            printf("Erro ao salvar índices secundários!\n");
+            return;
+        }
+        secondary_lsm.base_prepared = 0;
+    }
+    if (save_secondary_runs() != 0) {
+        printf("Erro ao salvar índices secundários!\n");
+        return;
+    }
+    save_trigram_index();
+}
+
+// Buscar manga por ISBN no índice primário (pela tabela hash)
+long find_manga_by_isbn(const char *isbn) {
+    uint64_t key;
+    if (isbn_stored_key(isbn, &key) != 0) return -1;
+    return primary_hash_find(key);
+}
+
+// ----- Busca por título com ranking e paginação -----
+//
+// Os resultados são ordenados pela qualidade da correspondência (TitleMatch) e,
+// dentro de cada classe, pela posição do termo no título; o desempate é pela
+// chave e pelo ISBN, o que torna a ordem total. Só os k melhores candidatos
+// ficam guardados, em um heap de tamanho k, e os títulos saem direto das
+// entradas do índice. O cursor guarda o último resultado entregue: a página
+// seguinte considera só os candidatos depois dele na ordem do ranking.
+
+typedef struct {
+    int match;
+    int position;
+    const char *key;
+    const char *isbn;
+} TitleRank;
+
+static int compare_title_rank(const TitleRank *a, const TitleRank *b) {
+    if (a->match != b->match) return a->match < b->match ? -1 : 1;
+    if (a->position != b->position) return a->position < b->position ? -1 : 1;
+    int cmp = strcmp(a->key, b->key);
+    return cmp != 0 ? cmp : strcmp(a->isbn, b->isbn);
+}
+
+// Classificar a ocorrência do termo na chave; -1 se a chave não o contém. A
+// posição é a da primeira ocorrência da melhor classe
+static int title_match(const char *key, const char *term, int *position) {
+    const char *p = strstr(key, term);
+    if (!p) return -1;
+    if (p == key) {
+        *position = 0;
+        return key[strlen(term)] == '\0' ? MATCH_EXACT : MATCH_PREFIX;
+    }
+    *position = (int)(p - key);
+    for (const char *q = p; q; q = strstr(q + 1, term)) {
+        unsigned char before = (unsigned char)q[-1];
+        if (before < 0x80 && !isalnum(before)) {
+            *position = (int)(q - key);
+            return MATCH_WORD;
+        }
+    }
+    return MATCH_SUBSTRING;
+}
+
+typedef struct {
+    TitleRank *items; // max-heap: o pior dos k melhores fica na raiz
+    int count;
+    int capacity;
+    const TitleCursor *cursor;
+    long total;
+    long after;
+} TitleRanking;
+
+static void title_ranking_offer(TitleRanking *ranking, const char *key, const char *isbn, const char *term) {
+    TitleRank rank;
+    rank.match = title_match(key, term, &rank.position);
+    if (rank.match < 0) return;
+    rank.key = key;
+    rank.isbn = isbn;
+    ranking->total++;
+
+    const TitleCursor *cursor = ranking->cursor;
+    if (cursor->started) {
+        TitleRank last = { cursor->match, cursor->position, cursor->key, cursor->isbn };
+        if (compare_title_rank(&rank, &last) <= 0) return;
+    }
+    ranking->after++;
+    if (ranking->capacity == 0) return;
+
+    TitleRank *heap = ranking->items;
+    int i;
+    if (ranking->count < ranking->capacity) {
+        // Subir a partir da última posição
+        i = ranking->count++;
+        while (i > 0 && compare_title_rank(&heap[(i - 1) / 2], &rank) < 0) {
+            heap[i] = heap[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+    } else {
+        if (compare_title_rank(&rank, &heap[0]) >= 0) return;
+        // Substituir a raiz e descer
+        i = 0;
+        for (;;) {
+            int child = 2 * i + 1;
+            if (child >= ranking->count) break;
+            if (child + 1 < ranking->count && compare_title_rank(&heap[child + 1], &heap[child]) > 0) child++;
+            if (compare_title_rank(&heap[child], &rank) <= 0) break;
+            heap[i] = heap[child];
+            i = child;
+        }
+    }
+    heap[i] = rank;
+}
+
+static int compare_title_rank_qsort(const void *a, const void *b) {
+    return compare_title_rank(a, b);
+}
+
+// Preparar o cursor para a primeira página de um termo
+void title_cursor_init(TitleCursor *cursor, const char *search_term) {
+    memset(cursor, 0, sizeof(TitleCursor));
+    make_title_key(search_term, cursor->term);
+}
+
+// Buscar no índice a próxima página de títulos que contêm o termo do cursor
+// (keys, se não for NULL, recebe a chave normalizada de cada resultado)
+static int search_titles_index(TitleCursor *cursor, TitleHit *hits, char (*keys)[MAX_TITLE], int max_hits) {
+    TitleRanking ranking = { malloc((max_hits > 0 ? max_hits : 1) * sizeof(TitleRank)), 0, max_hits, cursor, 0, 0 };
+    const char *term = cursor->term;
+
+    if (term[0] == '\0') {
+        // Termo vazio: não há o que ranquear
+    } else if (strlen(term) >= 3) {
+        // Termos com 3 ou mais bytes usam o índice de trigramas
+        uint32_t *ids;
+        uint32_t count = trigram_matches(term, &ids);
+        for (uint32_t i = 0; i < count; i++) {
+            title_ranking_offer(&ranking, trigram_doc_key(ids[i]), trigram_index.docs[ids[i]].isbn, term);
+        }
+        free(ids);
+    } else {
+        // Termos curtos: varredura das chaves normalizadas
+        SecondaryCursor scan;
+        const SecondaryIndex *entry;
+        secondary_cursor_init(&scan, NULL);
+        while ((entry = secondary_cursor_next(&scan))) {
+            title_ranking_offer(&ranking, entry->key, entry->isbn, term);
+        }
+    }
+
+    sort_array(ranking.items, ranking.count, sizeof(TitleRank), compare_title_rank_qsort);
+    for (int i = 0; i < ranking.count; i++) {
+        const TitleRank *rank = &ranking.items[i];
+        const SecondaryIndex *entry = secondary_find(rank->key, rank->isbn);
+        strcpy(hits[i].isbn, rank->isbn);
+        strcpy(hits[i].title, entry ? entry->title : rank->key);
+        hits[i].match = rank->match;
+        hits[i].position = rank->position;
+        hits[i].distance = 0;
+        if (keys) strcpy(keys[i], rank->key);
+    }
+    if (ranking.count > 0) {
+        // As chaves apontam para o índice: copiar antes de devolver o cursor
+        const TitleRank *last = &ranking.items[ranking.count - 1];
+        cursor->started = 1;
+        cursor->match = last->match;
+        cursor->position = last->position;
+        strcpy(cursor->key, last->key);
+        strcpy(cursor->isbn, last->isbn);
+    }
+    cursor->total = ranking.total;
+    cursor->remaining = ranking.after - ranking.count;
+
+    free(ranking.items);
+    return ranking.count;
+}
+
+// ----- Cache de buscas por título -----
+//
+// Os mesmos termos costumam ser buscados muitas vezes. A primeira página de cada
+// termo (até TITLE_CACHE_HITS resultados, com as chaves para posicionar o
+// cursor) fica em um cache LRU de TITLE_CACHE_SIZE termos, localizado por uma
+// tabela hash do termo normalizado. Cada entrada guarda a geração do catálogo em
+// que foi calculada e deixa de valer quando o índice de títulos muda. As páginas
+// seguintes vão sempre ao índice. No modo servidor várias consultas usam o cache
+// ao mesmo tempo, então ele tem uma trava própria, mantida só durante as cópias.
+
+typedef struct {
+    char term[MAX_TITLE];
+    uint64_t generation;
+    TitleHit *hits;
+    char (*keys)[MAX_TITLE];
+    int count;
+    long total;
+    int hash_next;          // próxima entrada do mesmo balde + 1 (0 = última)
+    int lru_prev, lru_next; // lista da mais recente para a menos recente
+} TitleCacheEntry;
+
+struct {
+    TitleCacheEntry entries[TITLE_CACHE_SIZE];
+    int buckets[TITLE_CACHE_SIZE * 2]; // entrada + 1 (0 = balde vazio)
+    int used;
+    int lru_head, lru_tail;
+    long hits, misses, evictions;
+    pthread_mutex_t lock;
+} title_cache = { .lru_head = -1, .lru_tail = -1, .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static uint32_t title_cache_hash(const char *term) {
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char*)term; *p; p++) {
+        hash = (hash ^ *p) * 16777619u;
+    }
+    return hash % (TITLE_CACHE_SIZE * 2);
+}
+
+static void title_cache_unlink(int index) {
+    TitleCacheEntry *entry = &title_cache.entries[index];
+    if (entry->lru_prev >= 0) title_cache.entries[entry->lru_prev].lru_next = entry->lru_next;
+    else title_cache.lru_head = entry->lru_next;
+    if (entry->lru_next >= 0) title_cache.entries[entry->lru_next].lru_prev = entry->lru_prev;
+    else title_cache.lru_tail = entry->lru_prev;
+}
+
+static void title_cache_push_front(int index) {
+    TitleCacheEntry *entry = &title_cache.entries[index];
+    entry->lru_prev = -1;
+    entry->lru_next = title_cache.lru_head;
+    if (title_cache.lru_head >= 0) title_cache.entries[title_cache.lru_head].lru_prev = index;
+    title_cache.lru_head = index;
+    if (title_cache.lru_tail < 0) title_cache.lru_tail = index;
+}
+
+// Entrada do termo (válida ou não); -1 se não houver
+static int title_cache_find(const char *term) {
+    for (int i = title_cache.buckets[title_cache_hash(term)] - 1; i >= 0; i = title_cache.entries[i].hash_next - 1) {
+        if (strcmp(title_cache.entries[i].term, term) == 0) return i;
+    }
+    return -1;
+}
+
+// Copiar a primeira página de uma entrada para o chamador e posicionar o cursor
+static int title_cache_serve(const TitleCacheEntry *entry, TitleCursor *cursor, TitleHit *hits, int max_hits) {
+    int count = entry->count < max_hits ? entry->count : max_hits;
+    memcpy(hits, entry->hits, count * sizeof(TitleHit));
+    if (count > 0) {
+        cursor->started = 1;
+        cursor->match = entry->hits[count - 1].match;
+        cursor->position = entry->hits[count - 1].position;
+        strcpy(cursor->key, entry->keys[count - 1]);
+        strcpy(cursor->isbn, entry->hits[count - 1].isbn);
+    }
+    cursor->total = entry->total;
+    cursor->remaining = entry->total - count;
+    return count;
+}
+
+// Guardar a primeira página de um termo, reaproveitando a entrada antiga do termo
+// ou a menos usada
+static void title_cache_store(const char *term, uint64_t generation, TitleHit *hits, char (*keys)[MAX_TITLE],
+                              int count, long total) {
+    int index = title_cache_find(term);
+    if (index >= 0) {
+        title_cache_unlink(index);
+    } else {
+        if (title_cache.used < TITLE_CACHE_SIZE) {
+            index = title_cache.used++;
+        } else {
+            // Tirar a menos usada do seu balde
+            index = title_cache.lru_tail;
+            title_cache_unlink(index);
+            int *link = &title_cache.buckets[title_cache_hash(title_cache.entries[index].term)];
+            while (*link - 1 != index) link = &title_cache.entries[*link - 1].hash_next;
+            *link = title_cache.entries[index].hash_next;
+            title_cache.evictions++;
+        }
+        uint32_t bucket = title_cache_hash(term);
+        strcpy(title_cache.entries[index].term, term);
+        title_cache.entries[index].hash_next = title_cache.buckets[bucket];
+        title_cache.buckets[bucket] = index + 1;
+    }
+
+    TitleCacheEntry *entry = &title_cache.entries[index];
+    free(entry->hits);
+    free(entry->keys);
+    entry->hits = hits;
+    entry->keys = keys;
+    entry->count = count;
+    entry->total = total;
+    entry->generation = generation;
+    title_cache_push_front(index);
+}
+
+// Buscar a próxima página de títulos que contêm o termo do cursor, do mais
+// relevante para o menos; o cursor avança para o último resultado devolvido e
+// recebe o total de resultados do termo e quantos ainda faltam. A primeira
+// página sai do cache quando o termo já foi buscado nesta geração do catálogo
+int search_titles(TitleCursor *cursor, TitleHit *hits, int max_hits) {
+    if (cursor->started || max_hits > TITLE_CACHE_HITS) {
+        return search_titles_index(cursor, hits, NULL, max_hits);
+    }
+
+    uint64_t generation = catalog_generation;
+    pthread_mutex_lock(&title_cache.lock);
+    int index = title_cache_find(cursor->term);
+    if (index >= 0 && title_cache.entries[index].generation == generation) {
+        title_cache.hits++;
+        title_cache_unlink(index);
+        title_cache_push_front(index);
+        int count = title_cache_serve(&title_cache.entries[index], cursor, hits, max_hits);
+        pthread_mutex_unlock(&title_cache.lock);
+        return count;
+    }
+    title_cache.misses++;
+    pthread_mutex_unlock(&title_cache.lock);
+
+    // Calcular a página inteira do cache fora da trava
+    TitleCacheEntry fresh;
+    TitleCursor first = *cursor;
+    fresh.hits = malloc(TITLE_CACHE_HITS * sizeof(TitleHit));
+    fresh.keys = malloc(TITLE_CACHE_HITS * sizeof(*fresh.keys));
+    fresh.count = search_titles_index(&first, fresh.hits, fresh.keys, TITLE_CACHE_HITS);
+    fresh.total = first.total;
+    int count = title_cache_serve(&fresh, cursor, hits, max_hits);
+
+    pthread_mutex_lock(&title_cache.lock);
+    title_cache_store(cursor->term, generation, fresh.hits, fresh.keys, fresh.count, fresh.total);
+    pthread_mutex_unlock(&title_cache.lock);
+    return count;
+}
+
+// Esvaziar o cache (os contadores continuam)
+void title_cache_clear() {
+    pthread_mutex_lock(&title_cache.lock);
+    for (int i = 0; i < title_cache.used; i++) {
+        free(title_cache.entries[i].hits);
+        free(title_cache.entries[i].keys);
+        title_cache.entries[i].hits = NULL;
+        title_cache.entries[i].keys = NULL;
+    }
+    memset(title_cache.buckets, 0, sizeof(title_cache.buckets));
+    title_cache.used = 0;
+    title_cache.lru_head = title_cache.lru_tail = -1;
+    pthread_mutex_unlock(&title_cache.lock);
+}
+
+// Contadores do cache de buscas por título
+void title_cache_stats(long *hits, long *misses, long *evictions, int *entries) {
+    pthread_mutex_lock(&title_cache.lock);
+    *hits = title_cache.hits;
+    *misses = title_cache.misses;
+    *evictions = title_cache.evictions;
+    *entries = title_cache.used;
+    pthread_mutex_unlock(&title_cache.lock);
+}
+
+// Cursor como texto, para ser devolvido ao cliente e usado no pedido seguinte:
+// termo e chave em hexadecimal (podem ter qualquer byte), classe, posição e ISBN
+void title_cursor_format(const TitleCursor *cursor, char *out) {
+    static const char digits[] = "0123456789abcdef";
+    char *p = out;
+    for (const unsigned char *c = (const unsigned char*)cursor->term; *c; c++) {
+        *p++ = digits[*c >> 4];
+        *p++ = digits[*c & 15];
+    }
+    p += sprintf(p, ".%d.%d.%s.", cursor->match, cursor->position, cursor->isbn);
+    for (const unsigned char *c = (const unsigned char*)cursor->key; *c; c++) {
+        *p++ = digits[*c >> 4];
+        *p++ = digits[*c & 15];
+    }
+    *p = '\0';
+}
+
+static int hex_field(const char **text, char *out, size_t size) {
+    size_t len = 0;
+    const char *p = *text;
+    while (isxdigit((unsigned char)p[0]) && isxdigit((unsigned char)p[1])) {
+        if (len + 1 >= size) return -1;
+        char pair[3] = { p[0], p[1], '\0' };
+        out[len++] = (char)strtol(pair, NULL, 16);
+        p += 2;
+    }
+    out[len] = '\0';
+    *text = p;
+    return 0;
+}
+
+// Ler um cursor gerado por title_cursor_format; -1 se o texto for inválido
+int title_cursor_parse(const char *text, TitleCursor *cursor) {
+    memset(cursor, 0, sizeof(TitleCursor));
+    const char *p = text;
+    int consumed;
+
+    if (hex_field(&p, cursor->term, MAX_TITLE) != 0 || cursor->term[0] == '\0' || *p++ != '.') return -1;
+    if (sscanf(p, "%d.%d.%n", &cursor->match, &cursor->position, &consumed) != 2) return -1;
+    p += consumed;
+    size_t isbn_len = strcspn(p, ".");
+    if (isbn_len == 0 || isbn_len >= ISBN_SIZE || p[isbn_len] != '.') return -1;
+    memcpy(cursor->isbn, p, isbn_len);
+    p += isbn_len + 1;
+    if (hex_field(&p, cursor->key, MAX_TITLE) != 0 || cursor->key[0] == '\0' || *p != '\0') return -1;
+    if (cursor->match < MATCH_EXACT || cursor->match > MATCH_SUBSTRING || cursor->position < 0) return -1;
+    cursor->started = 1;
+    return 0;
+}
+
+// Buscar títulos parecidos com o termo, tolerando erros de digitação
+int find_similar_titles(const char *search_term, TitleHit *hits, int max_hits) {
+    char normalized_search[MAX_TITLE];
+    make_title_key(search_term, normalized_search);
+    return trigram_fuzzy_search(normalized_search, hits, max_hits);
+}
+
+// Buscar ISBN por título no índice secundário (busca exata e parcial)
+char* find_isbn_by_title(const char *title) {
+    char normalized_search[MAX_TITLE];
+    make_title_key(title, normalized_search);
+    
+    // Primeiro: busca exata (binária em cada camada)
+    static char found[1][ISBN_SIZE];
+    SecondaryCursor cursor;
+    secondary_cursor_init(&cursor, normalized_search);
+    const SecondaryIndex *entry = secondary_cursor_next(&cursor);
+    if (entry && strcmp(entry->key, normalized_search) == 0) {
+        strcpy(found[0], entry->isbn);
+        return found[0];
+    }
+    
+    // Segundo: busca parcial (o resultado mais relevante)
+    TitleCursor search;
+    TitleHit hit;
+    title_cursor_init(&search, title);
+    if (search_titles(&search, &hit, 1) == 0) {
+        return NULL;
+    }
+    strcpy(found[0], hit.isbn);
+    return found[0];
+}
+
+// ===================== ÍNDICES INVERTIDOS DE ATRIBUTOS =====================
+//
+// Autor, editora, revista e gênero têm um índice invertido: para cada termo
+// (campo + valor normalizado) guardamos a lista ordenada dos offsets, em
+// mangas.dat, dos registros que o contêm. Autor e gênero podem ter vários valores
+// separados por vírgula ("Ação, Artes Marciais") e cada valor vira um termo.
+//
+// As listas são comprimidas: cada offset é gravado como a diferença para o
+// anterior em varint (7 bits por byte). Como registros novos vão para o fim do
+// arquivo, quase toda inserção só acrescenta bytes ao final da lista. Um índice de
+// saltos a cada ATTRIBUTE_SKIP_INTERVAL entradas permite avançar na lista sem
+// decodificar tudo: uma consulta conjuntiva percorre a lista mais curta e só
+// procura nas demais os offsets que ela contém.
+//
+//   attribute_index.dat: cabeçalho de índice mapeado (inode de mangas.dat;
+//                        contadores: termos, bytes dos termos, bytes das listas,
+//                        saltos), AttributeFileEntry[], termos, listas, saltos
+//
+// Na carga as listas e os saltos são usados diretamente no mapeamento.
+//
+// O inode identifica o arquivo de dados indexado: se mangas.dat foi substituído
+// (compactação, migração) o índice é reconstruído.
+
+enum {
+    ATTRIBUTE_AUTHOR,
+    ATTRIBUTE_PUBLISHER,
+    ATTRIBUTE_MAGAZINE,
+    ATTRIBUTE_GENRE,
+    ATTRIBUTE_FIELDS
+};
+
+static const char *attribute_names[ATTRIBUTE_FIELDS] = { "author", "publisher", "magazine", "genre" };
+
+typedef struct {
+    long value;        // última entrada antes do bloco (0 no primeiro bloco)
+    uint32_t position; // byte onde o bloco começa
+} AttributeSkip;
+
+typedef struct {
+    char *term;        // NULL = posição vazia
+    int field;
+    uint32_t count;
+    long last;         // maior offset da lista
+    unsigned char *data;
+    uint32_t size;
+    uint32_t capacity;
+    AttributeSkip *skips;
+    uint32_t skip_count;
+    uint32_t skip_capacity;
+} AttributePosting;
+
+typedef struct {
+    AttributePosting *table;
+    uint32_t table_capacity;
+    uint32_t table_count;
+    int stale; // arquivo ausente ou de outro mangas.dat: reconstruir
+    IndexMapping mapping; // listas e saltos podem apontar para attribute_index.dat
+} AttributeIndex;
+
+AttributeIndex attribute_index;
+
+// Termos de uma consulta ou de um mangá
+typedef struct {
+    int count;
+    int fields[ATTRIBUTE_MAX_TERMS];
+    char terms[ATTRIBUTE_MAX_TERMS][MAX_AUTHOR];
+} AttributeTerms;
+
+static uint32_t attribute_hash(int field, const char *term) {
+    uint32_t hash = 2166136261U ^ (uint32_t)field;
+    for (const unsigned char *p = (const unsigned char*)term; *p; p++) {
+        hash = (hash ^ *p) * 16777619U;
+    }
+    return hash;
+}
+
+// Localizar a lista de um termo na tabela hash (criando se pedido)
+static AttributePosting *attribute_slot(int field, const char *term, int create) {
+    if (create && (attribute_index.table_count + 1) * 4 > attribute_index.table_capacity * 3) {
+        uint32_t old_capacity = attribute_index.table_capacity;
+        AttributePosting *old_table = attribute_index.table;
+
+        attribute_index.table_capacity = old_capacity ? old_capacity * 2 : 1024;
+        attribute_index.table = calloc(attribute_index.table_capacity, sizeof(AttributePosting));
+        uint32_t mask = attribute_index.table_capacity - 1;
+
+        for (uint32_t i = 0; i < old_capacity; i++) {
+            if (old_table[i].term) {
+                uint32_t pos = attribute_hash(old_table[i].field, old_table[i].term) & mask;
+                while (attribute_index.table[pos].term) pos = (pos + 1) & mask;
+                attribute_index.table[pos] = old_table[i];
+            }
+        }
+        free(old_table);
+    }
+
+    if (attribute_index.table_capacity == 0) {
+        return NULL;
+    }
+
+    uint32_t mask = attribute_index.table_capacity - 1;
+    uint32_t pos = attribute_hash(field, term) & mask;
+    while (attribute_index.table[pos].term) {
+        AttributePosting *posting = &attribute_index.table[pos];
+        if (posting->field == field && strcmp(posting->term, term) == 0) {
+            return posting;
+        }
+        pos = (pos + 1) & mask;
+    }
+
+    if (!create) {
+        return NULL;
+    }
+    attribute_index.table[pos].term = strdup(term);
+    attribute_index.table[pos].field = field;
+    attribute_index.table_count++;
+    return &attribute_index.table[pos];
+}
+
+// Acrescentar um termo (normalizado) se ainda não estiver na lista
+static void attribute_terms_add(AttributeTerms *terms, int field, const char *value, size_t len) {
+    char term[MAX_AUTHOR];
+    if (len >= MAX_AUTHOR) len = MAX_AUTHOR - 1;
+    memcpy(term, value, len);
+    term[len] = '\0';
+    normalize_string(term);
+
+    if (term[0] == '\0' || terms->count == ATTRIBUTE_MAX_TERMS) {
+        return;
+    }
+    for (int i = 0; i < terms->count; i++) {
+        if (terms->fields[i] == field && strcmp(terms->terms[i], term) == 0) return;
+    }
+    terms->fields[terms->count] = field;
+    strcpy(terms->terms[terms->count++], term);
+}
+
+// Separar o valor de um campo em termos (autor e gênero aceitam vários valores)
+void attribute_terms_split(AttributeTerms *terms, int field, const char *value) {
+    if (field != ATTRIBUTE_AUTHOR && field != ATTRIBUTE_GENRE) {
+        attribute_terms_add(terms, field, value, strlen(value));
+        return;
+    }
+    while (*value) {
+        size_t len = strcspn(value, ",");
+        attribute_terms_add(terms, field, value, len);
+        value += len;
+        if (*value == ',') value++;
+    }
+}
+
+static void attribute_terms_of(const Manga *manga, AttributeTerms *terms) {
+    terms->count = 0;
+    attribute_terms_split(terms, ATTRIBUTE_AUTHOR, manga->author);
+    attribute_terms_split(terms, ATTRIBUTE_PUBLISHER, manga->publisher);
+    attribute_terms_split(terms, ATTRIBUTE_MAGAZINE, manga->magazine);
+    attribute_terms_split(terms, ATTRIBUTE_GENRE, manga->genre);
+}
+
+static uint32_t varint_put(unsigned char *p, uint64_t value) {
+    uint32_t n = 0;
+    while (value >= 0x80) {
+        p[n++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    p[n++] = (unsigned char)value;
+    return n;
+}
+
+static uint32_t varint_get(const unsigned char *p, uint64_t *value) {
+    uint32_t n = 0;
+    int shift = 0;
+    *value = 0;
+    do {
+        *value |= (uint64_t)(p[n] & 0x7F) << shift;
+        shift += 7;
+    } while (p[n++] & 0x80);
+    return n;
+}
+
+static void posting_add_skip(AttributePosting *posting, long value, uint32_t position) {
+    if (posting->skip_count == posting->skip_capacity) {
+        posting->skip_capacity = posting->skip_capacity ? posting->skip_capacity * 2 : 4;
+        posting->skips = mapping_realloc(&attribute_index.mapping, posting->skips,
+                                         posting->skip_count * sizeof(AttributeSkip),
+                                         posting->skip_capacity * sizeof(AttributeSkip));
+    }
+    posting->skips[posting->skip_count].value = value;
+    posting->skips[posting->skip_count++].position = position;
+}
+
+// Acrescentar um offset maior que todos os da lista
+static void posting_append(AttributePosting *posting, long offset) {
+    if (posting->count % ATTRIBUTE_SKIP_INTERVAL == 0) {
+        posting_add_skip(posting, posting->count ? posting->last : 0, posting->size);
+    }
+    if (posting->size + 10 > posting->capacity) {
+        // Uma lista carregada do arquivo tem capacidade igual ao tamanho
+        uint32_t capacity = posting->capacity ? posting->capacity * 2 : 16;
+        posting->capacity = capacity > posting->size + 10 ? capacity : posting->size + 10;
+        posting->data = mapping_realloc(&attribute_index.mapping, posting->data, posting->size, posting->capacity);
+    }
+    posting->size += varint_put(posting->data + posting->size, (uint64_t)(offset - (posting->count ? posting->last : 0)));
+    posting->last = offset;
+    posting->count++;
+}
+
+// Localizar a primeira entrada >= offset (pelos saltos e depois em sequência)
+// Devolve seu índice; em *start fica o byte onde ela começa e em *previous o valor
+// da entrada anterior (0 se não houver)
+static uint32_t posting_find(const AttributePosting *posting, long offset, uint32_t *start, long *previous) {
+    uint32_t lo = 0, hi = posting->skip_count;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (posting->skips[mid].value < offset) lo = mid + 1;
+        else hi = mid;
+    }
+
+    uint32_t block = lo > 0 ? lo - 1 : 0;
+    uint32_t index = block * ATTRIBUTE_SKIP_INTERVAL;
+    uint32_t position = posting->skip_count ? posting->skips[block].position : 0;
+    long value = posting->skip_count ? posting->skips[block].value : 0;
+    while (index < posting->count) {
+        uint64_t delta;
+        uint32_t length = varint_get(posting->data + position, &delta);
+        if (value + (long)delta >= offset) break;
+        value += (long)delta;
+        position += length;
+        index++;
+    }
+    *start = position;
+    *previous = value;
+    return index;
+}
+
+// Copiar para fora do mapeamento uma lista que vai ser alterada no lugar
+static void posting_own(AttributePosting *posting) {
+    posting->data = mapping_own(&attribute_index.mapping, posting->data, posting->size);
+    posting->skips = mapping_own(&attribute_index.mapping, posting->skips, posting->skip_count * sizeof(AttributeSkip));
+}
+
+// Substituir os bytes [start, end) da lista por replacement
+static void posting_splice(AttributePosting *posting, uint32_t start, uint32_t end,
+                           const unsigned char *replacement, uint32_t length) {
+    uint32_t size = posting->size - (end - start) + length;
+    if (size > posting->capacity) {
+        posting->capacity = size > 2 * posting->capacity ? size : 2 * posting->capacity;
+        posting->data = mapping_realloc(&attribute_index.mapping, posting->data, posting->size, posting->capacity);
+    }
+    memmove(posting->data + start + length, posting->data + end, posting->size - end);
+    memcpy(posting->data + start, replacement, length);
+    posting->size = size;
+}
+
+// Refazer os saltos depois de alterar a entrada index; os blocos anteriores não mudam
+static void posting_reindex(AttributePosting *posting, uint32_t index) {
+    uint32_t keep = index / ATTRIBUTE_SKIP_INTERVAL + 1;
+    uint32_t needed = (posting->count + ATTRIBUTE_SKIP_INTERVAL - 1) / ATTRIBUTE_SKIP_INTERVAL;
+    posting->skip_count = keep < needed ? keep : needed;
+    if (posting->skip_count == 0) {
+        posting->last = 0;
+        return;
+    }
+
+    uint32_t i = (posting->skip_count - 1) * ATTRIBUTE_SKIP_INTERVAL;
+    uint32_t position = posting->skips[posting->skip_count - 1].position;
+    long value = posting->skips[posting->skip_count - 1].value;
+    for (; i < posting->count; i++) {
+        if (i % ATTRIBUTE_SKIP_INTERVAL == 0 && i / ATTRIBUTE_SKIP_INTERVAL >= posting->skip_count) {
+            posting_add_skip(posting, value, position);
+        }
+        uint64_t delta;
+        position += varint_get(posting->data + position, &delta);
+        value += (long)delta;
+    }
+    posting->last = value;
+}
+
+// Inserir um offset na lista (sem duplicar). Só a diferença da entrada seguinte
+// é regravada; o resto da lista é deslocado sem ser decodificado
+static void posting_insert(AttributePosting *posting, long offset) {
+    if (posting->count == 0 || offset > posting->last) {
+        posting_append(posting, offset);
+        return;
+    }
+
+    uint32_t start;
+    long previous;
+    uint32_t index = posting_find(posting, offset, &start, &previous);
+    uint64_t delta;
+    uint32_t length = varint_get(posting->data + start, &delta);
+    long next = previous + (long)delta;
+    if (next == offset) {
+        return;
+    }
+
+    unsigned char replacement[20];
+    uint32_t size = varint_put(replacement, (uint64_t)(offset - previous));
+    size += varint_put(replacement + size, (uint64_t)(next - offset));
+    posting_own(posting);
+    posting_splice(posting, start, start + length, replacement, size);
+    posting->count++;
+    posting_reindex(posting, index);
+}
+
+static void posting_remove(AttributePosting *posting, long offset) {
+    if (posting->count == 0 || offset > posting->last) {
+        return;
+    }
+
+    uint32_t start;
+    long previous;
+    uint32_t index = posting_find(posting, offset, &start, &previous);
+    uint64_t delta;
+    uint32_t length = varint_get(posting->data + start, &delta);
+    if (previous + (long)delta != offset) {
+        return;
+    }
+
+    // A entrada seguinte passa a ser relativa à anterior à removida
+    unsigned char replacement[10];
+    uint32_t size = 0;
+    if (index + 1 < posting->count) {
+        uint64_t next_delta;
+        length += varint_get(posting->data + start + length, &next_delta);
+        size = varint_put(replacement, delta + next_delta);
+    }
+    posting_own(posting);
+    posting_splice(posting, start, start + length, replacement, size);
+    posting->count--;
+    posting_reindex(posting, index);
+}
+
+// Incluir (ou retirar) os termos de um mangá gravado em offset
+void attribute_add(const Manga *manga, long offset) {
+    AttributeTerms terms;
+    attribute_terms_of(manga, &terms);
+    for (int i = 0; i < terms.count; i++) {
+        posting_insert(attribute_slot(terms.fields[i], terms.terms[i], 1), offset);
+    }
+}
+
+void attribute_remove(const Manga *manga, long offset) {
+    AttributeTerms terms;
+    attribute_terms_of(manga, &terms);
+    for (int i = 0; i < terms.count; i++) {
+        AttributePosting *posting = attribute_slot(terms.fields[i], terms.terms[i], 0);
+        if (posting) posting_remove(posting, offset);
+    }
+}
+
+// Verificar se o mangá tem os mesmos termos nos dois estados
+int attribute_terms_equal(const Manga *a, const Manga *b) {
+    return strcmp(a->author, b->author) == 0 && strcmp(a->publisher, b->publisher) == 0 &&
+           strcmp(a->magazine, b->magazine) == 0 && strcmp(a->genre, b->genre) == 0;
+}
+
+// Liberar toda a memória do índice de atributos
+void attribute_clear() {
+    for (uint32_t i = 0; i < attribute_index.table_capacity; i++) {
+        free(attribute_index.table[i].term);
+        mapping_free(&attribute_index.mapping, attribute_index.table[i].data);
+        mapping_free(&attribute_index.mapping, attribute_index.table[i].skips);
+    }
+    free(attribute_index.table);
+    mapping_release(&attribute_index.mapping);
+    memset(&attribute_index, 0, sizeof(attribute_index));
+}
+
+// Cursor sobre uma lista comprimida (entradas em ordem crescente)
+typedef struct {
+    const AttributePosting *posting;
+    uint32_t index;    // entradas já decodificadas
+    uint32_t position; // próximo byte a decodificar
+    long value;        // última entrada decodificada
+} AttributeCursor;
+
+static int cursor_next(AttributeCursor *cursor) {
+    if (cursor->index >= cursor->posting->count) {
+        return 0;
+    }
+    uint64_t delta;
+    cursor->position += varint_get(cursor->posting->data + cursor->position, &delta);
+    cursor->value += (long)delta;
+    cursor->index++;
+    return 1;
+}
+
+// Avançar até a primeira entrada >= target; retorna 0 se a lista acabou
+static int cursor_seek(AttributeCursor *cursor, long target) {
+    if (cursor->index > 0 && cursor->value >= target) {
+        return 1;
+    }
+
+    // Último bloco ainda não decodificado cujas entradas anteriores são todas < target
+    // (se nem o próximo bloco serve, basta seguir decodificando)
+    const AttributePosting *posting = cursor->posting;
+    uint32_t lo = (cursor->index + ATTRIBUTE_SKIP_INTERVAL - 1) / ATTRIBUTE_SKIP_INTERVAL;
+    uint32_t hi = posting->skip_count;
+    if (lo >= hi || posting->skips[lo].value >= target) {
+        hi = lo;
+    }
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (posting->skips[mid].value < target) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo > 0 && (lo - 1) * ATTRIBUTE_SKIP_INTERVAL >= cursor->index) {
+        cursor->index = (lo - 1) * ATTRIBUTE_SKIP_INTERVAL;
+        cursor->position = posting->skips[lo - 1].position;
+        cursor->value = posting->skips[lo - 1].value;
+    }
+
+    while (cursor_next(cursor)) {
+        if (cursor->value >= target) return 1;
+    }
+    return 0;
+}
+
+// Identificar o campo pelo nome ("author", "publisher", "magazine" ou "genre")
+int attribute_field(const char *name) {
+    for (int i = 0; i < ATTRIBUTE_FIELDS; i++) {
+        if (strcmp(attribute_names[i], name) == 0) return i;
+    }
+    return -1;
+}
+
+// Consulta conjuntiva: offsets dos registros que têm todos os termos, em ordem
+// crescente. Guarda até max_results em results e devolve o total encontrado.
+// Se accept não for NULL, só entram os offsets para os quais ele retorna 1
+long attribute_query(const AttributeTerms *terms, int (*accept)(long offset, void *context), void *context,
+                     long *results, int max_results) {
+    AttributeCursor cursors[ATTRIBUTE_MAX_TERMS];
+    int count = terms->count;
+    if (count == 0) {
+        return 0;
+    }
+
+    for (int i = 0; i < count; i++) {
+        AttributePosting *posting = attribute_slot(terms->fields[i], terms->terms[i], 0);
+        if (!posting || posting->count == 0) {
+            return 0;
+        }
+        AttributeCursor cursor = { posting, 0, 0, 0 };
+
+        // Ordem crescente de tamanho: a primeira lista guia a interseção
+        int j = i;
+        while (j > 0 && cursors[j - 1].posting->count > posting->count) {
+            cursors[j] = cursors[j - 1];
+            j--;
+        }
+        cursors[j] = cursor;
+    }
+
+    long total = 0;
+    while (cursor_next(&cursors[0])) {
+        long candidate = cursors[0].value;
+        int matched = 1;
+        for (int i = 1; i < count && matched; i++) {
+            if (!cursor_seek(&cursors[i], candidate)) {
+                return total;
+            }
+            matched = cursors[i].value == candidate;
+        }
+        if (matched && (!accept || accept(candidate, context))) {
+            if (total < max_results) results[total] = candidate;
+            total++;
+        }
+    }
+    return total;
+}
+
+// Lista de um termo no arquivo (posições relativas ao início de cada seção)
+typedef struct {
+    uint8_t field;
+    uint8_t length;
+    uint16_t reserved;
+    uint32_t count;
+    uint32_t size;
+    uint32_t skip_count;
+    int64_t last;
+    uint64_t term_offset;
+    uint64_t data_offset;
+    uint64_t skips_offset; // em saltos
+} AttributeFileEntry;
+
+// Salvar o índice de atributos (um índice desatualizado só é gravado depois de reconstruído)
+void save_attribute_index() {
+    if (attribute_index.stale) {
+        return;
+    }
+    IndexWriter writer;
+    if (index_writer_open(&writer, "attribute_index.dat.tmp", ATTRIBUTE_MAGIC, ATTRIBUTE_VERSION,
+                          file_inode(data_map.fd)) != 0) {
+        printf("Erro ao salvar índice de atributos!\n");
+        return;
+    }
+
+    uint64_t term_count = 0, terms_size = 0, data_size = 0, skip_count = 0;
+    for (uint32_t i = 0; i < attribute_index.table_capacity; i++) {
+        AttributePosting *posting = &attribute_index.table[i];
+        if (!posting->term || posting->count == 0) continue;
+        AttributeFileEntry entry = {
+            (uint8_t)posting->field, (uint8_t)strlen(posting->term), 0, posting->count, posting->size,
+            posting->skip_count, posting->last, terms_size, data_size, skip_count
+        };
+        index_write(&writer, &entry, sizeof(entry));
+        term_count++;
+        terms_size += entry.length + 1;
+        data_size += posting->size;
+        skip_count += posting->skip_count;
+    }
+    writer.header.counts[0] = term_count;
+    writer.header.counts[1] = terms_size;
+    writer.header.counts[2] = data_size;
+    writer.header.counts[3] = skip_count;
+
+    for (int pass = 0; pass < 3; pass++) {
+        for (uint32_t i = 0; i < attribute_index.table_capacity; i++) {
+            AttributePosting *posting = &attribute_index.table[i];
+            if (!posting->term || posting->count == 0) continue;
+            if (pass == 0) index_write(&writer, posting->term, strlen(posting->term) + 1);
+            if (pass == 1) index_write(&writer, posting->data, posting->size);
+            if (pass == 2) index_write(&writer, posting->skips, posting->skip_count * sizeof(AttributeSkip));
+        }
+        index_write_align(&writer);
+    }
+    if (index_writer_close(&writer, "attribute_index.dat.tmp", "attribute_index.dat") != 0) {
+        printf("Erro ao salvar índice de atributos!\n");
+    }
+}
+
+// Montar a tabela de termos sobre o arquivo mapeado; retorna 0 se o conteúdo for coerente
+static int map_attribute_index(const IndexFileHeader *header) {
+    uint64_t term_count = header->counts[0], terms_size = header->counts[1];
+    uint64_t data_size = header->counts[2], skip_count = header->counts[3];
+    size_t entries_bytes = term_count * sizeof(AttributeFileEntry);
+    size_t terms_bytes = index_align(terms_size), data_bytes = index_align(data_size);
+    if (term_count > UINT32_MAX / 2 || skip_count > UINT32_MAX ||
+        entries_bytes + terms_bytes + data_bytes + skip_count * sizeof(AttributeSkip) != header->payload_size) {
+        return -1;
+    }
+
+    unsigned char *base = mapping_payload(&attribute_index.mapping);
+    const AttributeFileEntry *entries = (const AttributeFileEntry *)base;
+    const char *terms = (const char *)(base + entries_bytes);
+    unsigned char *data = base + entries_bytes + terms_bytes;
+    AttributeSkip *skips = (AttributeSkip *)(data + data_bytes);
+
+    uint32_t capacity = 1024;
+    while ((term_count + 1) * 4 > (uint64_t)capacity * 3) capacity *= 2;
+    attribute_index.table = calloc(capacity, sizeof(AttributePosting));
+    attribute_index.table_capacity = capacity;
+
+    for (uint32_t i = 0; i < term_count; i++) {
+        const AttributeFileEntry *entry = &entries[i];
+        if (entry->field >= ATTRIBUTE_FIELDS || entry->count == 0 ||
+            entry->term_offset + entry->length >= terms_size || terms[entry->term_offset + entry->length] != '\0' ||
+            entry->data_offset + entry->size > data_size || entry->skips_offset + entry->skip_count > skip_count) {
+            return -1;
+        }
+        AttributePosting *posting = attribute_slot(entry->field, terms + entry->term_offset, 1);
+        posting->count = entry->count;
+        posting->last = (long)entry->last;
+        posting->data = data + entry->data_offset;
+        posting->size = posting->capacity = entry->size;
+        posting->skips = skips + entry->skips_offset;
+        posting->skip_count = posting->skip_capacity = entry->skip_count;
+    }
+    return 0;
+}
+
+// Carregar o índice de atributos; marca como desatualizado se o arquivo não
+// existir, for inválido ou pertencer a outro mangas.dat
+void load_attribute_index() {
+    IndexFileHeader header;
+    attribute_clear();
+    attribute_index.stale = 1;
+
+    if (index_file_map("attribute_index.dat", ATTRIBUTE_MAGIC, ATTRIBUTE_VERSION, &header, &attribute_index.mapping) != 0) {
+        return;
+    }
+    if (header.inode == file_inode(data_map.fd) && map_attribute_index(&header) == 0) {
+        attribute_index.stale = 0;
+    } else {
+        attribute_clear();
+        attribute_index.stale = 1;
+    }
+}
+
+// ===================== ÍNDICES DE ANOS E MAPAS DE ZONA =====================
+//
+// Ano de início, ano de término (-1 = em publicação) e ano da edição têm um
+// índice ordenado por (ano, offset): uma faixa de anos vira um intervalo contíguo
+// do vetor, localizado por busca binária.
+//
+// mangas.dat também é dividido em blocos de ZONE_BLOCK_SIZE bytes e, para cada
+// bloco, guardamos o menor e o maior valor de cada ano entre os registros que
+// começam nele (mapa de zona), além do offset do primeiro desses registros. Uma
+// varredura filtrada pula os blocos cujo intervalo não atende à faixa pedida e,
+// nos demais, confere os anos no cabeçalho do registro sem decodificá-lo.
+// Remoções não encolhem os intervalos: o mapa continua correto, só menos preciso,
+// até a próxima compactação ou reconstrução.
+//
+//   year_index.dat: cabeçalho de índice mapeado (inode de mangas.dat;
+//                   contadores: entradas, blocos), 3 vetores de YearEntry,
+//                   vetor de ZoneMap
+
+enum {
+    YEAR_START,
+    YEAR_END,
+    YEAR_EDITION,
+    YEAR_FIELDS
+};
+
+static const char *year_names[YEAR_FIELDS] = { "start_year", "end_year", "edition_year" };
+
+typedef struct {
+    int year;
+    long offset;
+} YearEntry;
+
+typedef struct {
+    int16_t min[YEAR_FIELDS];
+    int16_t max[YEAR_FIELDS];
+    long first; // primeiro registro que começa no bloco (-1 = nenhum)
+} ZoneMap;
+
+typedef struct {
+    YearEntry *entries[YEAR_FIELDS];
+    long count;
+    long capacity;
+    ZoneMap *zones;
+    long zone_count;
+    int stale; // arquivo ausente ou de outro mangas.dat: reconstruir
+    IndexMapping mapping; // os vetores podem apontar para year_index.dat
+} YearIndex;
+
+YearIndex year_index;
+
+// Faixa de anos pedida em uma consulta (limites inclusivos)
+typedef struct {
+    int field;
+    int min;
+    int max;
+} YearRange;
+
+// Os anos são gravados no registro com 16 bits; o índice usa os mesmos valores
+static void manga_years(const Manga *manga, int *years) {
+    years[YEAR_START] = (int16_t)manga->start_year;
+    years[YEAR_END] = (int16_t)manga->end_year;
+    years[YEAR_EDITION] = (int16_t)manga->edition_year;
+}
+
+// Posição da primeira entrada >= (year, offset)
+static long year_lower_bound(int field, int year, long offset) {
+    const YearEntry *entries = year_index.entries[field];
+    long lo = 0, hi = year_index.count;
+    while (lo < hi) {
+        long mid = (lo + hi) / 2;
+        if (entries[mid].year < year || (entries[mid].year == year && entries[mid].offset < offset)) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Verificar se o registro em offset, com o ano de início dado, está no índice
+int year_contains(int start_year, long offset) {
+    long pos = year_lower_bound(YEAR_START, start_year, offset);
+    return pos < year_index.count && year_index.entries[YEAR_START][pos].year == start_year &&
+           year_index.entries[YEAR_START][pos].offset == offset;
+}
+
+static void year_reserve(long count) {
+    if (count > year_index.capacity) {
+        year_index.capacity = year_index.capacity ? year_index.capacity : 1024;
+        while (year_index.capacity < count) year_index.capacity *= 2;
+        for (int f = 0; f < YEAR_FIELDS; f++) {
+            year_index.entries[f] = mapping_realloc(&year_index.mapping, year_index.entries[f],
+                                                    year_index.count * sizeof(YearEntry),
+                                                    year_index.capacity * sizeof(YearEntry));
+        }
+    }
+}
+
+// Incluir o registro no mapa de zona do bloco onde ele começa
+static void zone_note(long offset, const int *years) {
+    long block = offset / ZONE_BLOCK_SIZE;
+    if (block >= year_index.zone_count) {
+        year_index.zones = mapping_realloc(&year_index.mapping, year_index.zones, year_index.zone_count * sizeof(ZoneMap),
+                                           (block + 1) * sizeof(ZoneMap));
+        for (long i = year_index.zone_count; i <= block; i++) {
+            for (int f = 0; f < YEAR_FIELDS; f++) {
+                year_index.zones[i].min[f] = INT16_MAX;
+                year_index.zones[i].max[f] = INT16_MIN;
+            }
+            year_index.zones[i].first = -1;
+        }
+        year_index.zone_count = block + 1;
+    }
+
+    year_index.zones = mapping_own(&year_index.mapping, year_index.zones, year_index.zone_count * sizeof(ZoneMap));
+    ZoneMap *zone = &year_index.zones[block];
+    for (int f = 0; f < YEAR_FIELDS; f++) {
+        if (years[f] < zone->min[f]) zone->min[f] = (int16_t)years[f];
+        if (years[f] > zone->max[f]) zone->max[f] = (int16_t)years[f];
+    }
+    if (zone->first == -1 || offset < zone->first) {
+        zone->first = offset;
+    }
+}
+
+// Incluir (ou retirar) os anos de um mangá gravado em offset
+void year_add(const Manga *manga, long offset) {
+    int years[YEAR_FIELDS];
+    manga_years(manga, years);
+    zone_note(offset, years);
+
+    if (year_contains(years[YEAR_START], offset)) {
+        return;
+    }
+
+    year_reserve(year_index.count + 1);
+    for (int f = 0; f < YEAR_FIELDS; f++) {
+        YearEntry *entries = year_index.entries[f];
+        long pos = year_lower_bound(f, years[f], offset);
+        memmove(&entries[pos + 1], &entries[pos], (year_index.count - pos) * sizeof(YearEntry));
+        entries[pos].year = years[f];
+        entries[pos].offset = offset;
+    }
+    year_index.count++;
+}
+
+void year_remove(const Manga *manga, long offset) {
+    int years[YEAR_FIELDS];
+    manga_years(manga, years);
+
+    if (!year_contains(years[YEAR_START], offset)) {
+        return;
+    }
+    for (int f = 0; f < YEAR_FIELDS; f++) {
+        year_index.entries[f] = mapping_own(&year_index.mapping, year_index.entries[f], year_index.count * sizeof(YearEntry));
+        YearEntry *entries = year_index.entries[f];
+        long pos = year_lower_bound(f, years[f], offset);
+        memmove(&entries[pos], &entries[pos + 1], (year_index.count - pos - 1) * sizeof(YearEntry));
+    }
+    year_index.count--;
+}
+
+// Acrescentar sem manter a ordem (reconstrução e importação); year_sort() reordena no final
+void year_append(const Manga *manga, long offset) {
+    int years[YEAR_FIELDS];
+    manga_years(manga, years);
+    zone_note(offset, years);
+    year_reserve(year_index.count + 1);
+    for (int f = 0; f < YEAR_FIELDS; f++) {
+        year_index.entries[f][year_index.count].year = years[f];
+        year_index.entries[f][year_index.count].offset = offset;
+    }
+    year_index.count++;
+}
+
+static int compare_year_entries(const void *a, const void *b) {
+    const YearEntry *x = a, *y = b;
+    if (x->year != y->year) return x->year < y->year ? -1 : 1;
+    return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+void year_sort() {
+    for (int f = 0; f < YEAR_FIELDS && year_index.count > 0; f++) {
+        sort_array(year_index.entries[f], year_index.count, sizeof(YearEntry), compare_year_entries);
+    }
+}
+
+// Verificar se o mangá tem os mesmos anos nos dois estados
+int year_values_equal(const Manga *a, const Manga *b) {
+    return a->start_year == b->start_year && a->end_year == b->end_year && a->edition_year == b->edition_year;
+}
+
+// Liberar toda a memória do índice de anos
+void year_clear() {
+    for (int f = 0; f < YEAR_FIELDS; f++) {
+        mapping_free(&year_index.mapping, year_index.entries[f]);
+    }
+    mapping_free(&year_index.mapping, year_index.zones);
+    mapping_release(&year_index.mapping);
+    memset(&year_index, 0, sizeof(year_index));
+}
+
+// Identificar o campo pelo nome ("start_year", "end_year" ou "edition_year")
+int year_field(const char *name) {
+    for (int i = 0; i < YEAR_FIELDS; i++) {
+        if (strcmp(year_names[i], name) == 0) return i;
+    }
+    return -1;
+}
+
+// Interpretar uma faixa: "1990..1999", "1990..", "..1999" ou um ano ("-" = -1)
+// Retorna 0 se a faixa for válida
+int parse_year_range(const char *text, int field, YearRange *range) {
+    char value[32];
+    size_t len = strlen(text);
+    if (len >= sizeof(value)) return -1;
+    memcpy(value, text, len + 1);
+
+    char *min = value;
+    while (isspace((unsigned char)*min)) min++;
+    char *end = min + strlen(min);
+    while (end > min && isspace((unsigned char)end[-1])) *--end = '\0';
+
+    char *max = strstr(min, "..");
+    range->field = field;
+    if (!max) {
+        if (*min == '\0') return -1;
+        range->min = range->max = strcmp(min, "-") == 0 ? -1 : atoi(min);
+        return range->min >= INT16_MIN && range->min <= INT16_MAX ? 0 : -1;
+    }
+    *max = '\0';
+    max += 2;
+    range->min = *min ? atoi(min) : INT16_MIN;
+    range->max = *max ? atoi(max) : INT16_MAX;
+    if (range->min < INT16_MIN) range->min = INT16_MIN;
+    if (range->max > INT16_MAX) range->max = INT16_MAX;
+    return range->min <= range->max ? 0 : -1;
+}
+
+// Número de entradas do índice dentro da faixa (e a posição da primeira)
+long year_range_count(const YearRange *range, long *first) {
+    *first = year_lower_bound(range->field, range->min, 0);
+    return year_lower_bound(range->field, range->max + 1, 0) - *first;
+}
+
+// Verificar se um bloco pode conter registros dentro de todas as faixas
+int zone_may_match(const ZoneMap *zone, const YearRange *ranges, int range_count) {
+    if (zone->first == -1) {
+        return 0;
+    }
+    for (int i = 0; i < range_count; i++) {
+        if (zone->max[ranges[i].field] < ranges[i].min || zone->min[ranges[i].field] > ranges[i].max) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Salvar o índice de anos (um índice desatualizado só é gravado depois de reconstruído)
+void save_year_index() {
+    if (year_index.stale) {
+        return;
+    }
+    IndexWriter writer;
+    if (index_writer_open(&writer, "year_index.dat.tmp", YEAR_MAGIC, YEAR_VERSION, file_inode(data_map.fd)) != 0) {
+        printf("Erro ao salvar índice de anos!\n");
+        return;
+    }
+    writer.header.counts[0] = year_index.count;
+    writer.header.counts[1] = year_index.zone_count;
+    for (int f = 0; f < YEAR_FIELDS; f++) {
+        index_write(&writer, year_index.entries[f], year_index.count * sizeof(YearEntry));
+    }
+    index_write(&writer, year_index.zones, year_index.zone_count * sizeof(ZoneMap));
+    if (index_writer_close(&writer, "year_index.dat.tmp", "year_index.dat") != 0) {
+        printf("Erro ao salvar índice de anos!\n");
+    }
+}
+
+// Carregar o índice de anos; marca como desatualizado se o arquivo não existir,
+// for inválido ou pertencer a outro mangas.dat
+void load_year_index() {
+    IndexFileHeader header;
+    struct stat st;
+    year_clear();
+    year_index.stale = 1;
+
+    if (index_file_map("year_index.dat", YEAR_MAGIC, YEAR_VERSION, &header, &year_index.mapping) != 0) {
+        return;
+    }
+
+    uint64_t count = header.counts[0], zone_count = header.counts[1];
+    int ok = data_map.fd >= 0 && fstat(data_map.fd, &st) == 0 && header.inode == (uint64_t)st.st_ino &&
+             zone_count <= (uint64_t)st.st_size / ZONE_BLOCK_SIZE + 1 && count <= (uint64_t)st.st_size &&
+             header.payload_size == YEAR_FIELDS * count * sizeof(YearEntry) + zone_count * sizeof(ZoneMap);
+
+    if (ok) {
+        unsigned char *base = mapping_payload(&year_index.mapping);
+        year_index.count = year_index.capacity = (long)count;
+        for (int f = 0; f < YEAR_FIELDS; f++) {
+            year_index.entries[f] = (YearEntry *)(base + f * count * sizeof(YearEntry));
+        }
+        year_index.zone_count = (long)zone_count;
+        year_index.zones = (ZoneMap *)(base + YEAR_FIELDS * count * sizeof(YearEntry));
+
+        // O conteúdo já foi conferido pelo checksum; os blocos só confirmam que
+        // o mapa de zona corresponde ao tamanho de bloco atual
+        for (long i = 0; ok && i < year_index.zone_count; i++) {
+            long first = year_index.zones[i].first;
+            ok = first == -1 || (first > 0 && first / ZONE_BLOCK_SIZE == i);
+        }
+    }
+
+    if (ok) {
+        year_index.stale = 0;
+    } else {
+        year_clear();
+        year_index.stale = 1;
+    }
+}
+
+// ===================== PROJEÇÃO COLUNAR (ESTATÍSTICAS DA COLEÇÃO) =====================
+//
+// Os relatórios de completude (volumes adquiridos / total, volumes faltantes,
+// totais por editora e por revista) usam uma projeção colunar dos registros
+// ativos em vez de ler mangas.dat: uma linha por registro, ordenada pelo offset,
+// com cada campo em um vetor contíguo. Editora e revista viram códigos de um
+// dicionário, de modo que os agrupamentos somam por índice de vetor.
+//
+// Os totais da coleção percorrem os vetores em blocos de COLUMN_LANES linhas com
+// acumuladores independentes por posição: o laço interno, de tamanho fixo e sem
+// desvios, é vetorizado pelo compilador (SSE/AVX/NEON, conforme o alvo).
+//
+//   column_store.dat: cabeçalho de índice mapeado (inode de mangas.dat;
+//                     contadores: linhas, editoras, revistas), valores dos dois
+//                     dicionários, offsets (i64), total (i32), adquiridos (i32),
+//                     editora (u32), revista (u32)
+
+enum {
+    COLUMN_PUBLISHER,
+    COLUMN_MAGAZINE,
+    COLUMN_GROUPS
+};
+
+static const char *column_group_names[COLUMN_GROUPS] = { "publisher", "magazine" };
+
+// Dicionário de valores de um campo (o código é a posição em values)
+typedef struct {
+    char (*values)[MAX_PUBLISHER];
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t *table;       // código + 1 (0 = posição vazia)
+    uint32_t table_capacity;
+} ColumnDictionary;
+
+typedef struct {
+    long *offsets;
+    int32_t *total;        // total de volumes da série
+    int32_t *acquired;     // volumes adquiridos
+    uint32_t *codes[COLUMN_GROUPS];
+    long rows;
+    long capacity;
+    ColumnDictionary dictionaries[COLUMN_GROUPS];
+    int stale; // arquivo ausente ou de outro mangas.dat: reconstruir
+    IndexMapping mapping; // colunas e valores podem apontar para column_store.dat
+} ColumnStore;
+
+ColumnStore column_store;
+
+// Totais de um conjunto de séries
+typedef struct {
+    long series;
+    long volumes;
+    long acquired;   // adquiridos dentro do total da série
+    long missing;    // volumes que faltam para completar
+    long complete;   // séries com todos os volumes
+} ColumnTotals;
+
+typedef struct {
+    ColumnTotals totals;
+    uint32_t code;   // valor no dicionário da editora ou revista
+} ColumnGroup;
+
+static uint32_t column_hash(const char *value) {
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char*)value; *p; p++) {
+        hash = (hash ^ *p) * 16777619u;
+    }
+    return hash;
+}
+
+// Refazer a tabela hash do dicionário com a capacidade dada (potência de 2)
+static void column_rehash(ColumnDictionary *dictionary, uint32_t capacity) {
+    free(dictionary->table);
+    dictionary->table = calloc(capacity, sizeof(uint32_t));
+    dictionary->table_capacity = capacity;
+    for (uint32_t code = 0; code < dictionary->count; code++) {
+        uint32_t slot = column_hash(dictionary->values[code]) & (capacity - 1);
+        while (dictionary->table[slot]) slot = (slot + 1) & (capacity - 1);
+        dictionary->table[slot] = code + 1;
+    }
+}
+
+// Código do valor no dicionário, incluindo-o se ainda não existir
+static uint32_t column_code(ColumnDictionary *dictionary, const char *value) {
+    if (dictionary->count * 2 >= dictionary->table_capacity) {
+        column_rehash(dictionary, dictionary->table_capacity ? dictionary->table_capacity * 2 : 256);
+    }
+
+    uint32_t slot = column_hash(value) & (dictionary->table_capacity - 1);
+    while (dictionary->table[slot]) {
+        uint32_t code = dictionary->table[slot] - 1;
+        if (strcmp(dictionary->values[code], value) == 0) return code;
+        slot = (slot + 1) & (dictionary->table_capacity - 1);
+    }
+
+    if (dictionary->count == dictionary->capacity) {
+        dictionary->capacity = dictionary->capacity ? dictionary->capacity * 2 : 64;
+        dictionary->values = mapping_realloc(&column_store.mapping, dictionary->values,
+                                             dictionary->count * sizeof(*dictionary->values),
+                                             dictionary->capacity * sizeof(*dictionary->values));
+    }
+    snprintf(dictionary->values[dictionary->count], MAX_PUBLISHER, "%s", value);
+    dictionary->table[slot] = dictionary->count + 1;
+    return dictionary->count++;
+}
+
+// Posição da primeira linha com offset >= offset
+static long column_lower_bound(long offset) {
+    long lo = 0, hi = column_store.rows;
+    while (lo < hi) {
+        long mid = (lo + hi) / 2;
+        if (column_store.offsets[mid] < offset) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static void column_move_rows(long to, long from, long count) {
+    memmove(&column_store.offsets[to], &column_store.offsets[from], count * sizeof(long));
+    memmove(&column_store.total[to], &column_store.total[from], count * sizeof(int32_t));
+    memmove(&column_store.acquired[to], &column_store.acquired[from], count * sizeof(int32_t));
+    for (int g = 0; g < COLUMN_GROUPS; g++) {
+        memmove(&column_store.codes[g][to], &column_store.codes[g][from], count * sizeof(uint32_t));
+    }
+}
+
+// Copiar para fora do mapeamento as colunas, antes de alterar uma linha no lugar
+static void column_own() {
+    size_t rows = column_store.rows;
+    column_store.offsets = mapping_own(&column_store.mapping, column_store.offsets, rows * sizeof(long));
+    column_store.total = mapping_own(&column_store.mapping, column_store.total, rows * sizeof(int32_t));
+    column_store.acquired = mapping_own(&column_store.mapping, column_store.acquired, rows * sizeof(int32_t));
+    for (int g = 0; g < COLUMN_GROUPS; g++) {
+        column_store.codes[g] = mapping_own(&column_store.mapping, column_store.codes[g], rows * sizeof(uint32_t));
+    }
+}
+
+// Total e volumes adquiridos como ficam gravados no registro (total em 16 bits)
+void column_volumes(const Manga *manga, int32_t *total, int32_t *acquired) {
+    *total = (uint16_t)(manga->total_volumes > 0 ? manga->total_volumes : 0);
+    *acquired = manga->acquired_volumes;
+}
+
+// Gravar (incluir ou substituir) a linha do registro em offset
+void column_set(long offset, int32_t total, int32_t acquired, const char *publisher, const char *magazine) {
+    long row = column_lower_bound(offset);
+    if (row == column_store.rows || column_store.offsets[row] != offset) {
+        if (column_store.rows == column_store.capacity) {
+            column_store.capacity = column_store.capacity ? column_store.capacity * 2 : 1024;
+            size_t rows = column_store.rows, capacity = column_store.capacity;
+            column_store.offsets = mapping_realloc(&column_store.mapping, column_store.offsets,
+                                                   rows * sizeof(long), capacity * sizeof(long));
+            column_store.total = mapping_realloc(&column_store.mapping, column_store.total,
+                                                 rows * sizeof(int32_t), capacity * sizeof(int32_t));
+            column_store.acquired = mapping_realloc(&column_store.mapping, column_store.acquired,
+                                                    rows * sizeof(int32_t), capacity * sizeof(int32_t));
+            for (int g = 0; g < COLUMN_GROUPS; g++) {
+                column_store.codes[g] = mapping_realloc(&column_store.mapping, column_store.codes[g],
+                                                        rows * sizeof(uint32_t), capacity * sizeof(uint32_t));
+            }
+        }
+        column_move_rows(row + 1, row, column_store.rows - row);
+        column_store.offsets[row] = offset;
+        column_store.rows++;
+    } else {
+        column_own();
+    }
+    column_store.total[row] = total;
+    column_store.acquired[row] = acquired;
+    column_store.codes[COLUMN_PUBLISHER][row] = column_code(&column_store.dictionaries[COLUMN_PUBLISHER], publisher);
+    column_store.codes[COLUMN_MAGAZINE][row] = column_code(&column_store.dictionaries[COLUMN_MAGAZINE], magazine);
+}
+
+void column_delete(long offset) {
+    long row = column_lower_bound(offset);
+    if (row < column_store.rows && column_store.offsets[row] == offset) {
+        column_own();
+        column_move_rows(row, row + 1, column_store.rows - row - 1);
+        column_store.rows--;
+    }
+}
+
+// Verificar se a linha do mangá muda entre os dois estados
+int column_values_equal(const Manga *a, const Manga *b) {
+    int32_t total_a, acquired_a, total_b, acquired_b;
+    column_volumes(a, &total_a, &acquired_a);
+    column_volumes(b, &total_b, &acquired_b);
+    return total_a == total_b && acquired_a == acquired_b &&
+           strcmp(a->publisher, b->publisher) == 0 && strcmp(a->magazine, b->magazine) == 0;
+}
+
+// Liberar toda a memória da projeção
+void column_clear() {
+    mapping_free(&column_store.mapping, column_store.offsets);
+    mapping_free(&column_store.mapping, column_store.total);
+    mapping_free(&column_store.mapping, column_store.acquired);
+    for (int g = 0; g < COLUMN_GROUPS; g++) {
+        mapping_free(&column_store.mapping, column_store.codes[g]);
+        mapping_free(&column_store.mapping, column_store.dictionaries[g].values);
+        free(column_store.dictionaries[g].table);
+    }
+    mapping_release(&column_store.mapping);
+    memset(&column_store, 0, sizeof(column_store));
+}
+
+// Identificar o agrupamento pelo nome ("publisher" ou "magazine")
+int column_group(const char *name) {
+    for (int g = 0; g < COLUMN_GROUPS; g++) {
+        if (strcmp(column_group_names[g], name) == 0) return g;
+    }
+    return -1;
+}
+
+#define COLUMN_LANES 8
+
+// Totais de toda a coleção
+void column_totals(ColumnTotals *totals) {
+    const int32_t *total = column_store.total;
+    const int32_t *acquired = column_store.acquired;
+    long rows = column_store.rows;
+    int64_t volumes[COLUMN_LANES] = { 0 }, owned[COLUMN_LANES] = { 0 }, complete[COLUMN_LANES] = { 0 };
+
+    long i = 0;
+    for (; i + COLUMN_LANES <= rows; i += COLUMN_LANES) {
+        for (int l = 0; l < COLUMN_LANES; l++) {
+            int32_t t = total[i + l], a = acquired[i + l];
+            int32_t o = a < t ? a : t;
+            volumes[l] += t;
+            owned[l] += o;
+            complete[l] += (o == t) & (t > 0);
+        }
+    }
+    for (int l = 1; l < COLUMN_LANES; l++) {
+        volumes[0] += volumes[l];
+        owned[0] += owned[l];
+        complete[0] += complete[l];
+    }
+    for (; i < rows; i++) {
+        int32_t o = acquired[i] < total[i] ? acquired[i] : total[i];
+        volumes[0] += total[i];
+        owned[0] += o;
+        complete[0] += o == total[i] && total[i] > 0;
+    }
+
+    totals->series = rows;
+    totals->volumes = (long)volumes[0];
+    totals->acquired = (long)owned[0];
+    totals->missing = (long)(volumes[0] - owned[0]);
+    totals->complete = (long)complete[0];
+}
+
+static int compare_column_groups(const void *a, const void *b) {
+    const ColumnGroup *x = a, *y = b;
+    if (x->totals.series != y->totals.series) return x->totals.series > y->totals.series ? -1 : 1;
+    return (x->code > y->code) - (x->code < y->code);
+}
+
+// Totais por editora ou revista, do valor com mais séries para o com menos
+// Retorna um vetor com *count posições (liberar com free)
+ColumnGroup *column_group_totals(int group, uint32_t *count) {
+    const int32_t *total = column_store.total;
+    const int32_t *acquired = column_store.acquired;
+    const uint32_t *codes = column_store.codes[group];
+    uint32_t values = column_store.dictionaries[group].count;
+    ColumnGroup *groups = calloc(values + 1, sizeof(ColumnGroup));
+
+    for (uint32_t code = 0; code < values; code++) {
+        groups[code].code = code;
+    }
+    for (long i = 0; i < column_store.rows; i++) {
+        int32_t owned = acquired[i] < total[i] ? acquired[i] : total[i];
+        ColumnTotals *g = &groups[codes[i]].totals;
+        g->series++;
+        g->volumes += total[i];
+        g->acquired += owned;
+        g->missing += total[i] - owned;
+        g->complete += owned == total[i] && total[i] > 0;
+    }
+
+    // Valores que não têm mais séries (o dicionário só é refeito na reconstrução) ficam de fora
+    sort_array(groups, values, sizeof(ColumnGroup), compare_column_groups);
+    *count = values;
+    while (*count > 0 && groups[*count - 1].totals.series == 0) (*count)--;
+    return groups;
+}
+
+// Linhas com mais volumes faltantes (em ordem decrescente); retorna quantas
+int column_top_missing(long *offsets, int32_t *missing, int max_results) {
+    int count = 0;
+    for (long i = 0; i < column_store.rows; i++) {
+        int32_t o = column_store.acquired[i] < column_store.total[i] ? column_store.acquired[i] : column_store.total[i];
+        int32_t m = column_store.total[i] - o;
+        if (m == 0 || (count == max_results && m <= missing[count - 1])) continue;
+
+        int j = count < max_results ? count++ : count - 1;
+        while (j > 0 && missing[j - 1] < m) {
+            missing[j] = missing[j - 1];
+            offsets[j] = offsets[j - 1];
+            j--;
+        }
+        missing[j] = m;
+        offsets[j] = column_store.offsets[i];
+    }
+    return count;
+}
+
+// Salvar a projeção (uma projeção desatualizada só é gravada depois de reconstruída)
+void save_column_store() {
+    if (column_store.stale) {
+        return;
+    }
+    IndexWriter writer;
+    if (index_writer_open(&writer, "column_store.dat.tmp", COLUMN_MAGIC, COLUMN_VERSION, file_inode(data_map.fd)) != 0) {
+        printf("Erro ao salvar projeção colunar!\n");
+        return;
+    }
+
+    size_t rows = column_store.rows;
+    writer.header.counts[0] = rows;
+    for (int g = 0; g < COLUMN_GROUPS; g++) {
+        const ColumnDictionary *dictionary = &column_store.dictionaries[g];
+        writer.header.counts[1 + g] = dictionary->count;
+        index_write(&writer, dictionary->values, dictionary->count * sizeof(*dictionary->values));
+        index_write_align(&writer);
+    }
+    index_write(&writer, column_store.offsets, rows * sizeof(long));
+    index_write(&writer, column_store.total, rows * sizeof(int32_t));
+    index_write(&writer, column_store.acquired, rows * sizeof(int32_t));
+    for (int g = 0; g < COLUMN_GROUPS; g++) {
+        index_write(&writer, column_store.codes[g], rows * sizeof(uint32_t));
+    }
+    if (index_writer_close(&writer, "column_store.dat.tmp", "column_store.dat") != 0) {
+        printf("Erro ao salvar projeção colunar!\n");
+    }
+}
+
+// Carregar a projeção; marca como desatualizada se o arquivo não existir, for
+// inválido ou pertencer a outro mangas.dat
+void load_column_store() {
+    IndexFileHeader header;
+    struct stat st;
+    column_clear();
+    column_store.stale = 1;
+
+    if (index_file_map("column_store.dat", COLUMN_MAGIC, COLUMN_VERSION, &header, &column_store.mapping) != 0) {
+        return;
+    }
+
+    uint64_t rows = header.counts[0];
+    size_t dictionary_bytes[COLUMN_GROUPS];
+    size_t expected = rows * (sizeof(long) + 2 * sizeof(int32_t) + COLUMN_GROUPS * sizeof(uint32_t));
+    for (int g = 0; g < COLUMN_GROUPS; g++) {
+        dictionary_bytes[g] = index_align(header.counts[1 + g] * sizeof(*column_store.dictionaries[g].values));
+        expected += dictionary_bytes[g];
+    }
+    int ok = data_map.fd >= 0 && fstat(data_map.fd, &st) == 0 && header.inode == (uint64_t)st.st_ino &&
+             rows <= (uint64_t)st.st_size && header.counts[1] <= UINT32_MAX / 4 &&
+             header.counts[2] <= UINT32_MAX / 4 && header.payload_size == expected;
+
+    if (ok) {
+        unsigned char *p = mapping_payload(&column_store.mapping);
+        for (int g = 0; g < COLUMN_GROUPS; g++) {
+            ColumnDictionary *dictionary = &column_store.dictionaries[g];
+            dictionary->values = (char (*)[MAX_PUBLISHER])p;
+            dictionary->count = dictionary->capacity = (uint32_t)header.counts[1 + g];
+            uint32_t capacity = 256;
+            while (dictionary->count * 2 >= capacity) capacity *= 2;
+            column_rehash(dictionary, capacity);
+            p += dictionary_bytes[g];
+        }
+        column_store.rows = column_store.capacity = (long)rows;
+        column_store.offsets = (long *)p;
+        p += rows * sizeof(long);
+        column_store.total = (int32_t *)p;
+        p += rows * sizeof(int32_t);
+        column_store.acquired = (int32_t *)p;
+        p += rows * sizeof(int32_t);
+        for (int g = 0; g < COLUMN_GROUPS; g++) {
+            column_store.codes[g] = (uint32_t *)p;
+            p += rows * sizeof(uint32_t);
+        }
+        column_store.stale = 0;
+    } else {
+        column_clear();
+        column_store.stale = 1;
+    }
+}
+
+// ===================== LOG DE ÍNDICES (WRITE-AHEAD LOG) =====================
+//
+// Cada alteração dos índices é acrescentada a index.wal como um registro pequeno
+// com checksum. Os arquivos completos dos índices só são gravados nos checkpoints;
+// na inicialização o log é reaplicado sobre o último checkpoint.
+//
+//   cabeçalho: "MMWL", u32 versão, u32 tamanho do cabeçalho, u32 reservado
+//   registro:  u32 crc32 (tipo + tamanho + dados), u32 tamanho dos dados,
+//              u8 tipo, 3 bytes reservados, dados
+//
+// As páginas alteradas da árvore B+ ficam no cache até o checkpoint. Nele, as
+// imagens dessas páginas vão primeiro para o log (WAL_PAGES) e só depois para
+// primary_index.dat, de modo que uma gravação interrompida seja refeita a partir
+// do log.
+//
+// Commits simultâneos compartilham um único fsync (group commit): quem chega
+// enquanto outro commit está gravando espera e é coberto pela gravação seguinte.
+
+enum {
+    WAL_PRIMARY_SET = 1, // isbn, i64 offset
+    WAL_PRIMARY_DEL,     // isbn
+    WAL_SECONDARY_ADD,   // título, isbn
+    WAL_SECONDARY_DEL,   // título, isbn
+    WAL_PAGES,           // u32 quantidade, (u32 página, BTREE_PAGE_SIZE bytes)...
+    WAL_ATTRIBUTES_ADD,  // i64 offset, autor, gênero, revista, editora
+    WAL_ATTRIBUTES_DEL,  // i64 offset, autor, gênero, revista, editora
+    WAL_YEARS_ADD,       // i64 offset, i16 início, i16 término, i16 edição
+    WAL_YEARS_DEL,       // i64 offset, i16 início, i16 término, i16 edição
+    WAL_COLUMNS_SET,     // i64 offset, i32 total, i32 adquiridos, editora, revista
+    WAL_COLUMNS_DEL      // i64 offset
+};
+
+#define WAL_HEADER_SIZE 16
+#define WAL_RECORD_HEADER 12
+
+typedef struct {
+    int fd;
+    unsigned char *buffer; // registros ainda não gravados
+    size_t buffered;
+    size_t capacity;
+    uint64_t appended;     // bytes de registros após o cabeçalho (gravados + pendentes)
+    uint64_t synced;       // bytes já gravados e sincronizados
+    long records;          // operações desde o último checkpoint
+    int syncing;
+    unsigned long generation; // incrementado a cada checkpoint (o log recomeça do zero)
+    int suspended;         // alterações em lote, gravadas só no próximo checkpoint
+    int unlogged;          // houve alterações sem log desde o último checkpoint
+    unsigned char *replay; // registros lidos na abertura, reaplicados após carregar os índices
+    size_t replay_size;
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+} WriteAheadLog;
+
+WriteAheadLog index_wal = { .fd = -1, .lock = PTHREAD_MUTEX_INITIALIZER, .done = PTHREAD_COND_INITIALIZER };
+
+static uint32_t crc32_table[256];
+static pthread_once_t crc32_once = PTHREAD_ONCE_INIT;
+
+static void crc32_init() {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        crc32_table[i] = c;
+    }
+}
+
+// CRC-32 (IEEE); crc = 0 para começar
+uint32_t crc32_update(uint32_t crc, const unsigned char *data, size_t size) {
+    pthread_once(&crc32_once, crc32_init);
+    crc = ~crc;
+    while (size--) {
+        crc = crc32_table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static void wal_io_error() {
+    printf("Erro de E/S no log de índices!\n");
+    exit(1);
+}
+
+// Acrescentar um registro ao buffer do log (gravado no próximo commit)
+static void wal_append(int type, const unsigned char *payload, uint32_t size) {
+    unsigned char header[WAL_RECORD_HEADER] = { 0 };
+    memcpy(header + 4, &size, sizeof(uint32_t));
+    header[8] = (unsigned char)type;
+    uint32_t crc = crc32_update(crc32_update(0, header + 4, WAL_RECORD_HEADER - 4), payload, size);
+    memcpy(header, &crc, sizeof(uint32_t));
+
+    pthread_mutex_lock(&index_wal.lock);
+    size_t needed = index_wal.buffered + WAL_RECORD_HEADER + size;
+    if (needed > index_wal.capacity) {
+        index_wal.capacity = needed > 2 * index_wal.capacity ? needed : 2 * index_wal.capacity;
+        index_wal.buffer = realloc(index_wal.buffer, index_wal.capacity);
+        if (!index_wal.buffer) {
+            printf("Erro: memória insuficiente para o log de índices!\n");
+            exit(1);
+        }
+    }
+    memcpy(index_wal.buffer + index_wal.buffered, header, WAL_RECORD_HEADER);
+    memcpy(index_wal.buffer + index_wal.buffered + WAL_RECORD_HEADER, payload, size);
+    index_wal.buffered = needed;
+    index_wal.appended += WAL_RECORD_HEADER + size;
+    if (type != WAL_PAGES) {
+        index_wal.records++;
+    }
+    pthread_mutex_unlock(&index_wal.lock);
+}
+
+// Gravar e sincronizar todos os registros acrescentados até agora
+void wal_commit() {
+    uint64_t start = metrics_clock();
+
+    // Alterações que não mudaram os índices também são confirmadas aqui
+    data_pool_flush();
+
+    pthread_mutex_lock(&index_wal.lock);
+    uint64_t target = index_wal.appended;
+    unsigned long generation = index_wal.generation;
+    int pending = index_wal.fd >= 0 && index_wal.synced < target;
+
+    // Após um checkpoint os registros já estão nos índices completos
+    while (index_wal.fd >= 0 && index_wal.generation == generation && index_wal.synced < target) {
+        if (index_wal.syncing) {
+            pthread_cond_wait(&index_wal.done, &index_wal.lock);
+            continue;
+        }
+
+        // Este commit grava tudo o que estiver pendente, inclusive de outros commits
+        unsigned char *buffer = index_wal.buffer;
+        size_t size = index_wal.buffered;
+        uint64_t end = index_wal.appended;
+        index_wal.buffer = NULL;
+        index_wal.buffered = index_wal.capacity = 0;
+        index_wal.syncing = 1;
+        pthread_mutex_unlock(&index_wal.lock);
+
+        // Os registros de dados apontados pelo log precisam estar no disco antes dele
+        data_pool_flush();
+        if (data_map.fd >= 0 && io_fdatasync(data_map.fd) != 0) wal_io_error();
+        if (io_pwrite(index_wal.fd, buffer, size, WAL_HEADER_SIZE + end - size) != (ssize_t)size) wal_io_error();
+        if (io_fdatasync(index_wal.fd) != 0) wal_io_error();
+        free(buffer);
+
+        pthread_mutex_lock(&index_wal.lock);
+        index_wal.synced = end;
+        index_wal.syncing = 0;
+        pthread_cond_broadcast(&index_wal.done);
+    }
+    pthread_mutex_unlock(&index_wal.lock);
+    if (pending) {
+        metrics_record(METRIC_COMMIT, start);
+    }
+}
+
+static size_t wal_put_string(unsigned char *p, const char *str) {
+    size_t len = strlen(str);
+    if (len > 255) len = 255;
+    p[0] = (unsigned char)len;
+    memcpy(p + 1, str, len);
+    return len + 1;
+}
+
+static const unsigned char *wal_get_string(const unsigned char *p, const unsigned char *end, char *dest, size_t size) {
+    if (p >= end || p + 1 + *p > end || *p >= size) return NULL;
+    memcpy(dest, p + 1, *p);
+    dest[*p] = '\0';
+    return p + 1 + *p;
+}
+
+void wal_log_primary(const char *isbn, long offset, int removed) {
+    if (index_wal.suspended) return;
+    unsigned char payload[256 + sizeof(int64_t)];
+    size_t size = wal_put_string(payload, isbn);
+    if (!removed) {
+        int64_t value = offset;
+        memcpy(payload + size, &value, sizeof(int64_t));
+        size += sizeof(int64_t);
+    }
+    wal_append(removed ? WAL_PRIMARY_DEL : WAL_PRIMARY_SET, payload, size);
+}
+
+void wal_log_secondary(const char *title, const char *isbn, int removed) {
+    if (index_wal.suspended) return;
+    unsigned char payload[2 * 256];
+    size_t size = wal_put_string(payload, title);
+    size += wal_put_string(payload + size, isbn);
+    wal_append(removed ? WAL_SECONDARY_DEL : WAL_SECONDARY_ADD, payload, size);
+}
+
+void wal_log_attributes(const Manga *manga, long offset, int removed) {
+    if (index_wal.suspended) return;
+    unsigned char payload[sizeof(int64_t) + 4 * 256];
+    int64_t value = offset;
+    memcpy(payload, &value, sizeof(int64_t));
+    size_t size = sizeof(int64_t);
+    size += wal_put_string(payload + size, manga->author);
+    size += wal_put_string(payload + size, manga->genre);
+    size += wal_put_string(payload + size, manga->magazine);
+    size += wal_put_string(payload + size, manga->publisher);
+    wal_append(removed ? WAL_ATTRIBUTES_DEL : WAL_ATTRIBUTES_ADD, payload, size);
+}
+
+void wal_log_years(const Manga *manga, long offset, int removed) {
+    if (index_wal.suspended) return;
+    unsigned char payload[sizeof(int64_t) + YEAR_FIELDS * sizeof(int16_t)];
+    int64_t value = offset;
+    int years[YEAR_FIELDS];
+    manga_years(manga, years);
+    memcpy(payload, &value, sizeof(int64_t));
+    for (int f = 0; f < YEAR_FIELDS; f++) {
+        int16_t year = (int16_t)years[f];
+        memcpy(payload + sizeof(int64_t) + f * sizeof(int16_t), &year, sizeof(int16_t));
+    }
+    wal_append(removed ? WAL_YEARS_DEL : WAL_YEARS_ADD, payload, sizeof(payload));
+}
+
+void wal_log_columns(long offset, const int32_t *volumes, const char *publisher, const char *magazine, int removed) {
+    if (index_wal.suspended) return;
+    unsigned char payload[sizeof(int64_t) + 2 * sizeof(int32_t) + 2 * 256];
+    int64_t value = offset;
+    memcpy(payload, &value, sizeof(int64_t));
+    size_t size = sizeof(int64_t);
+    if (!removed) {
+        memcpy(payload + size, volumes, 2 * sizeof(int32_t));
+        size += 2 * sizeof(int32_t);
+        size += wal_put_string(payload + size, publisher);
+        size += wal_put_string(payload + size, magazine);
+    }
+    wal_append(removed ? WAL_COLUMNS_DEL : WAL_COLUMNS_SET, payload, size);
+}
+
+// Adicionar índice primário
+void add_primary_index(const char *isbn, long offset) {
+    uint64_t key;
+    if (isbn_stored_key(isbn, &key) != 0) return;
+    wal_log_primary(isbn, offset, 0);
+    btree_insert(key, offset);
+    primary_hash_put(key, offset);
+    primary_count = (int)primary_tree.header.entry_count;
+}
+
+// Adicionar índice secundário
+void add_secondary_index(const char *title, const char *isbn) {
+    wal_log_secondary(title, isbn, 0);
+    SecondaryIndex entry;
+    strcpy(entry.title, title);
+    make_title_key(title, entry.key);
+    strcpy(entry.isbn, isbn);
+    if (!secondary_put(&entry, 0)) {
+        trigram_add(entry.key, isbn);
+    }
+}
+
+// Remover índice primário
+void remove_primary_index(const char *isbn) {
+    uint64_t key;
+    if (isbn_stored_key(isbn, &key) != 0) return;
+    wal_log_primary(isbn, 0, 1);
+    btree_delete(key);
+    primary_hash_delete(key);
+    primary_count = (int)primary_tree.header.entry_count;
+}
+
+// Remover índice secundário (localizado pela chave normalizada e ISBN): grava uma lápide
+void remove_secondary_index(const char *title, const char *isbn) {
+    wal_log_secondary(title, isbn, 1);
+    SecondaryIndex entry;
+    strcpy(entry.title, title);
+    make_title_key(title, entry.key);
+    strcpy(entry.isbn, isbn);
+    if (secondary_put(&entry, 1)) {
+        trigram_remove(entry.key, isbn);
+    }
+}
+
+// Adicionar os atributos (autor, editora, revista, gêneros) do mangá gravado em offset
+void add_attribute_index(const Manga *manga, long offset) {
+    wal_log_attributes(manga, offset, 0);
+    attribute_add(manga, offset);
+}
+
+void remove_attribute_index(const Manga *manga, long offset) {
+    wal_log_attributes(manga, offset, 1);
+    attribute_remove(manga, offset);
+}
+
+// Adicionar os anos (início, término, edição) do mangá gravado em offset
+void add_year_index(const Manga *manga, long offset) {
+    wal_log_years(manga, offset, 0);
+    year_add(manga, offset);
+}
+
+void remove_year_index(const Manga *manga, long offset) {
+    wal_log_years(manga, offset, 1);
+    year_remove(manga, offset);
+}
+
+// Gravar na projeção colunar a linha do registro em offset
+void set_column_row(long offset, int32_t total, int32_t acquired, const char *publisher, const char *magazine) {
+    int32_t volumes[2] = { total, acquired };
+    wal_log_columns(offset, volumes, publisher, magazine, 0);
+    column_set(offset, total, acquired, publisher, magazine);
+}
+
+void remove_column_row(long offset) {
+    wal_log_columns(offset, NULL, NULL, NULL, 1);
+    column_delete(offset);
+}
+
+// Gravar na projeção colunar a linha do mangá gravado em offset
+void add_column_row(const Manga *manga, long offset) {
+    int32_t total, acquired;
+    column_volumes(manga, &total, &acquired);
+    set_column_row(offset, total, acquired, manga->publisher, manga->magazine);
+}
+
+// Função para debug - mostra todos os títulos indexados
+void debug_titles() {
+    printf("\n=== DEBUG: TÍTULOS INDEXADOS ===\n");
+    SecondaryCursor cursor;
+    const SecondaryIndex *entry;
+    secondary_cursor_init(&cursor, NULL);
+    for (int i = 0; (entry = secondary_cursor_next(&cursor)); i++) {
+        printf("%d. Original: '%s'\n", i+1, entry->title);
+        printf("   Normalizado: '%s'\n", entry->key);
+        printf("   ISBN: %s\n\n", entry->isbn);
+    }
+}
+
+// Exibir dados de um mangá
+void display_manga(const Manga *manga) {
+    printf("\n=== DADOS DO MANGÁ ===\n");
+    printf("ISBN: %s\n", manga->isbn);
+    printf("Título: %s\n", manga->title);
+    printf("Autor(es): %s\n", manga->author);
+    printf("Ano de início: %d\n", manga->start_year);
+    if (manga->end_year == -1) {
+        printf("Ano de fim: Em publicação\n");
+    } else {
+        printf("Ano de fim: %d\n", manga->end_year);
+    }
+    printf("Gênero: %s\n", manga->genre);
+    printf("Revista: %s\n", manga->magazine);
     printf("Editora: %s\n", manga->publisher);
     printf("Ano da edição: %d\n", manga->edition_year);
     printf("Total de volumes: %d\n", manga->total_volumes);
     printf("Volumes adquiridos: %d\n", manga->acquired_volumes);
     printf("Lista de volumes: ");
-    for (int i = 0; i < manga->acquired_volumes; i++) {
-        printf("%d ", manga->volumes_list[i]);
+    for (int v = manga_next_volume(manga, 0); v; v = manga_next_volume(manga, v)) {
+        printf("%d ", v);
+    }
+    printf("\n");
+}
+
+// ===================== RECUPERAÇÃO E CHECKPOINT DOS ÍNDICES =====================
+
+// Percorrer os registros íntegros de um log lido para a memória
+// Retorna o número de bytes válidos (o restante é um final incompleto)
+static size_t wal_scan(const unsigned char *data, size_t size,
+                       void (*callback)(int type, const unsigned char *payload, uint32_t length, void *context),
+                       void *context) {
+    size_t position = 0;
+    while (position + WAL_RECORD_HEADER <= size) {
+        uint32_t crc, length;
+        memcpy(&crc, data + position, sizeof(uint32_t));
+        memcpy(&length, data + position + 4, sizeof(uint32_t));
+        if (length > size - position - WAL_RECORD_HEADER) break;
+        const unsigned char *payload = data + position + WAL_RECORD_HEADER;
+        if (crc32_update(crc32_update(0, data + position + 4, WAL_RECORD_HEADER - 4), payload, length) != crc) break;
+        if (callback) {
+            callback(data[position + 8], payload, length, context);
+        }
+        position += WAL_RECORD_HEADER + length;
+    }
+    return position;
+}
+
+static void wal_find_pages(int type, const unsigned char *payload, uint32_t length, void *context) {
+    (void)length;
+    if (type == WAL_PAGES) {
+        *(const unsigned char **)context = payload;
+    }
+}
+
+// Regravar em primary_index.dat as imagens de páginas do último checkpoint interrompido
+static void wal_restore_pages(const unsigned char *payload) {
+    uint32_t count;
+    memcpy(&count, payload, sizeof(uint32_t));
+    payload += sizeof(uint32_t);
+
+    int fd = io_open("primary_index.dat", O_RDWR | O_CREAT, 0644);
+    if (fd < 0) wal_io_error();
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t page_no;
+        memcpy(&page_no, payload, sizeof(uint32_t));
+        if (io_pwrite(fd, payload + sizeof(uint32_t), BTREE_PAGE_SIZE, (off_t)page_no * BTREE_PAGE_SIZE) != BTREE_PAGE_SIZE) {
+            wal_io_error();
+        }
+        payload += sizeof(uint32_t) + BTREE_PAGE_SIZE;
+    }
+    if (io_fsync(fd) != 0) wal_io_error();
+    close(fd);
+    printf("Log de índices: %u páginas do índice primário restauradas.\n", count);
+}
+
+// Abrir (ou criar) index.wal; deve ser chamado antes de carregar os índices
+int wal_open() {
+    int fd = io_open("index.wal", O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    unsigned char header[WAL_HEADER_SIZE];
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    if (st.st_size < WAL_HEADER_SIZE || io_pread(fd, header, WAL_HEADER_SIZE, 0) != WAL_HEADER_SIZE ||
+        memcmp(header, WAL_MAGIC, 4) != 0) {
+        if (st.st_size > 0) {
+            printf("Aviso: index.wal inválido foi descartado.\n");
+        }
+        uint32_t fields[3] = { WAL_VERSION, WAL_HEADER_SIZE, 0 };
+        memcpy(header, WAL_MAGIC, 4);
+        memcpy(header + 4, fields, sizeof(fields));
+        if (io_pwrite(fd, header, WAL_HEADER_SIZE, 0) != WAL_HEADER_SIZE || ftruncate(fd, WAL_HEADER_SIZE) != 0 ||
+            io_fsync(fd) != 0) {
+            close(fd);
+            return -1;
+        }
+    } else {
+        uint32_t version;
+        memcpy(&version, header + 4, sizeof(uint32_t));
+        if (version != WAL_VERSION) {
+            printf("Versão do log de índices não suportada!\n");
+            close(fd);
+            return -1;
+        }
+
+        size_t size = st.st_size - WAL_HEADER_SIZE;
+        unsigned char *data = malloc(size + 1);
+        if (!data || io_pread(fd, data, size, WAL_HEADER_SIZE) != (ssize_t)size) {
+            free(data);
+            close(fd);
+            return -1;
+        }
+
+        // Um registro cortado no fim é de um commit que não chegou a ser concluído
+        const unsigned char *pages = NULL;
+        size_t valid = wal_scan(data, size, wal_find_pages, &pages);
+        if (valid < size) {
+            printf("Aviso: %zu bytes incompletos no fim de index.wal foram descartados.\n", size - valid);
+            if (ftruncate(fd, WAL_HEADER_SIZE + valid) != 0) {
+                free(data);
+                close(fd);
+                return -1;
+            }
+        }
+        if (pages) {
+            wal_restore_pages(pages);
+        }
+
+        index_wal.replay = data;
+        index_wal.replay_size = valid;
+        index_wal.appended = index_wal.synced = valid;
+    }
+
+    index_wal.fd = fd;
+    return 0;
+}
+
+static int secondary_contains(const char *title, const char *isbn) {
+    char key[MAX_TITLE];
+    make_title_key(title, key);
+    return secondary_find(key, isbn) != NULL;
+}
+
+// Reaplicar uma operação do log. As operações são idempotentes: aplicá-las de
+// novo sobre um estado que já as contém não muda o resultado
+static void wal_apply(int type, const unsigned char *payload, uint32_t length, void *context) {
+    const unsigned char *end = payload + length;
+    char isbn[ISBN_SIZE], title[MAX_TITLE];
+    long *applied = context;
+
+    switch (type) {
+        case WAL_PRIMARY_SET: {
+            int64_t offset;
+            const unsigned char *p = wal_get_string(payload, end, isbn, ISBN_SIZE);
+            if (!p || end - p != sizeof(int64_t)) return;
+            memcpy(&offset, p, sizeof(int64_t));
+            add_primary_index(isbn, (long)offset);
+            break;
+        }
+        case WAL_PRIMARY_DEL:
+            if (!wal_get_string(payload, end, isbn, ISBN_SIZE)) return;
+            remove_primary_index(isbn);
+            break;
+        case WAL_SECONDARY_ADD:
+        case WAL_SECONDARY_DEL: {
+            const unsigned char *p = wal_get_string(payload, end, title, MAX_TITLE);
+            if (!p || !wal_get_string(p, end, isbn, ISBN_SIZE)) return;
+            if (type == WAL_SECONDARY_DEL) {
+                remove_secondary_index(title, isbn);
+            } else if (!secondary_contains(title, isbn)) {
+                add_secondary_index(title, isbn);
+            }
+            break;
+        }
+        case WAL_ATTRIBUTES_ADD:
+        case WAL_ATTRIBUTES_DEL: {
+            Manga manga;
+            int64_t offset;
+            const unsigned char *p = payload + sizeof(int64_t);
+            memset(&manga, 0, sizeof(manga));
+            if (length < sizeof(int64_t) ||
+                !(p = wal_get_string(p, end, manga.author, MAX_AUTHOR)) ||
+                !(p = wal_get_string(p, end, manga.genre, MAX_GENRE)) ||
+                !(p = wal_get_string(p, end, manga.magazine, MAX_MAGAZINE)) ||
+                !wal_get_string(p, end, manga.publisher, MAX_PUBLISHER)) {
+                return;
+            }
+            memcpy(&offset, payload, sizeof(int64_t));
+            if (type == WAL_ATTRIBUTES_DEL) {
+                remove_attribute_index(&manga, (long)offset);
+            } else {
+                add_attribute_index(&manga, (long)offset);
+            }
+            break;
+        }
+        case WAL_YEARS_ADD:
+        case WAL_YEARS_DEL: {
+            Manga manga;
+            int64_t offset;
+            int16_t years[YEAR_FIELDS];
+            if (length != sizeof(int64_t) + sizeof(years)) return;
+            memcpy(&offset, payload, sizeof(int64_t));
+            memcpy(years, payload + sizeof(int64_t), sizeof(years));
+            memset(&manga, 0, sizeof(manga));
+            manga.start_year = years[YEAR_START];
+            manga.end_year = years[YEAR_END];
+            manga.edition_year = years[YEAR_EDITION];
+            if (type == WAL_YEARS_DEL) {
+                remove_year_index(&manga, (long)offset);
+            } else {
+                add_year_index(&manga, (long)offset);
+            }
+            break;
+        }
+        case WAL_COLUMNS_SET: {
+            char publisher[MAX_PUBLISHER], magazine[MAX_MAGAZINE];
+            int64_t offset;
+            int32_t volumes[2];
+            const unsigned char *p = payload + sizeof(int64_t) + sizeof(volumes);
+            if (length < sizeof(int64_t) + sizeof(volumes) ||
+                !(p = wal_get_string(p, end, publisher, MAX_PUBLISHER)) ||
+                !wal_get_string(p, end, magazine, MAX_MAGAZINE)) {
+                return;
+            }
+            memcpy(&offset, payload, sizeof(int64_t));
+            memcpy(volumes, payload + sizeof(int64_t), sizeof(volumes));
+            set_column_row((long)offset, volumes[0], volumes[1], publisher, magazine);
+            break;
+        }
+        case WAL_COLUMNS_DEL: {
+            int64_t offset;
+            if (length != sizeof(int64_t)) return;
+            memcpy(&offset, payload, sizeof(int64_t));
+            remove_column_row((long)offset);
+            break;
+        }
+        default:
+            return;
+    }
+    (*applied)++;
+}
+
+static void wal_collect_page(uint32_t page_no, const unsigned char *data, void *context) {
+    unsigned char **p = context;
+    memcpy(*p, &page_no, sizeof(uint32_t));
+    memcpy(*p + sizeof(uint32_t), data, BTREE_PAGE_SIZE);
+    *p += sizeof(uint32_t) + BTREE_PAGE_SIZE;
+}
+
+// Registros removidos por remove_manga e versões antigas de registros movidos por
+// save_manga. Só são marcados como deletados (e entram no espaço livre) depois que o
+// log com a alteração do índice está sincronizado: na confirmação feita por quem
+// chamou ou em um checkpoint. Assim um espaço nunca é reaproveitado enquanto um índice
+// recuperado do log ainda pode apontar para ele. Até lá as varreduras já os ignoram,
+// pois o índice primário não aponta mais para eles. Alteradas apenas por quem tem
+// acesso exclusivo ao catálogo
+
+typedef struct {
+    long offset;
+    uint64_t position;        // fim do log quando o registro foi liberado
+    unsigned long generation; // checkpoint em que o registro foi liberado
+} PendingDelete;
+
+struct {
+    PendingDelete *entries;
+    int count;
+    int capacity;
+} pending_deletes;
+
+int mark_record_deleted(long offset);
+void free_list_add(long offset);
+
+// Registrar um registro removido ou movido (depois de logar a alteração do índice)
+void defer_record_delete(long offset) {
+    if (pending_deletes.count == pending_deletes.capacity) {
+        pending_deletes.capacity = pending_deletes.capacity ? 2 * pending_deletes.capacity : 16;
+        pending_deletes.entries = realloc(pending_deletes.entries, pending_deletes.capacity * sizeof(PendingDelete));
+    }
+    PendingDelete *entry = &pending_deletes.entries[pending_deletes.count++];
+    pthread_mutex_lock(&index_wal.lock);
+    entry->offset = offset;
+    entry->position = index_wal.appended;
+    entry->generation = index_wal.generation;
+    pthread_mutex_unlock(&index_wal.lock);
+}
+
+// Marcar como deletados os registros cuja alteração do índice já está no log
+// sincronizado (ou nos índices gravados por um checkpoint posterior)
+void apply_pending_deletes() {
+    if (pending_deletes.count == 0) return;
+
+    pthread_mutex_lock(&index_wal.lock);
+    uint64_t synced = index_wal.synced;
+    unsigned long generation = index_wal.generation;
+    pthread_mutex_unlock(&index_wal.lock);
+
+    int kept = 0;
+    for (int i = 0; i < pending_deletes.count; i++) {
+        PendingDelete *entry = &pending_deletes.entries[i];
+        if (entry->generation != generation || entry->position <= synced) {
+            mark_record_deleted(entry->offset);
+            free_list_add(entry->offset);
+        } else {
+            pending_deletes.entries[kept++] = *entry;
+        }
+    }
+    pending_deletes.count = kept;
+}
+
+// Gravar os índices completos e esvaziar o log
+void checkpoint_indices() {
+    uint64_t start = metrics_clock();
+    if (index_wal.fd < 0) {
+        save_primary_indices();
+        save_secondary_indices();
+        save_attribute_index();
+        save_year_index();
+        save_column_store();
+        apply_pending_deletes();
+        metrics_record(METRIC_CHECKPOINT, start);
+        return;
+    }
+
+    wal_commit();
+    apply_pending_deletes();
+    uint32_t dirty = (uint32_t)btree_dirty_pages();
+    if (index_wal.records == 0 && !index_wal.unlogged && dirty == 0) {
+        return;
+    }
+
+    // Primeiro as imagens das páginas no log, depois as páginas no lugar
+    if (dirty > 0) {
+        size_t size = sizeof(uint32_t) + (size_t)dirty * (sizeof(uint32_t) + BTREE_PAGE_SIZE);
+        unsigned char *payload = malloc(size);
+        if (!payload) {
+            printf("Erro: memória insuficiente para o checkpoint!\n");
+            exit(1);
+        }
+        unsigned char *p = payload + sizeof(uint32_t);
+        memcpy(payload, &dirty, sizeof(uint32_t));
+        btree_for_each_dirty(wal_collect_page, &p);
+        wal_append(WAL_PAGES, payload, (uint32_t)size);
+        free(payload);
+        wal_commit();
+        save_primary_indices();
+    }
+    save_primary_hash();
+    save_secondary_indices();
+    save_attribute_index();
+    save_year_index();
+    save_column_store();
+
+    pthread_mutex_lock(&index_wal.lock);
+    while (index_wal.syncing) {
+        pthread_cond_wait(&index_wal.done, &index_wal.lock);
+    }
+    if (ftruncate(index_wal.fd, WAL_HEADER_SIZE) != 0 || io_fsync(index_wal.fd) != 0) {
+        wal_io_error();
+    }
+    index_wal.appended = index_wal.synced = 0;
+    index_wal.records = 0;
+    index_wal.unlogged = 0;
+    index_wal.generation++;
+    pthread_cond_broadcast(&index_wal.done);
+    pthread_mutex_unlock(&index_wal.lock);
+    apply_pending_deletes();
+    metrics_record(METRIC_CHECKPOINT, start);
+}
+
+// Reaplicar as operações lidas por wal_open(); deve ser chamado após carregar os índices
+void wal_replay() {
+    if (!index_wal.replay) return;
+
+    long applied = 0;
+    index_wal.suspended = 1;
+    wal_scan(index_wal.replay, index_wal.replay_size, wal_apply, &applied);
+    index_wal.suspended = 0;
+    free(index_wal.replay);
+    index_wal.replay = NULL;
+
+    if (index_wal.replay_size > 0) {
+        printf("Log de índices: %ld operações reaplicadas.\n", applied);
+        index_wal.unlogged = 1;
+        checkpoint_indices();
+    }
+    index_wal.replay_size = 0;
+}
+
+// Verificar se o log cresceu o suficiente para um checkpoint
+int checkpoint_due() {
+    pthread_mutex_lock(&index_wal.lock);
+    int due = index_wal.records >= WAL_CHECKPOINT_RECORDS || index_wal.appended >= WAL_CHECKPOINT_BYTES;
+    pthread_mutex_unlock(&index_wal.lock);
+    return due || btree_dirty_pages() >= BTREE_CACHE_PAGES;
+}
+
+// Confirmar as alterações de uma operação; faz checkpoint quando o log cresce demais
+void commit_index_changes() {
+    wal_commit();
+    apply_pending_deletes();
+    if (checkpoint_due()) {
+        checkpoint_indices();
+    }
+}
+
+// Alterações em lote (importação, reconstrução) não passam pelo log: os índices
+// completos são gravados no checkpoint ao final
+void begin_unlogged_changes() {
+    checkpoint_indices();
+    index_wal.suspended = 1;
+    index_wal.unlogged = 1;
+}
+
+void end_unlogged_changes() {
+    index_wal.suspended = 0;
+    checkpoint_indices();
+}
+
+// Abrir o log e carregar os índices, reaplicando o que estiver no log
+void load_indices() {
+    if (wal_open() != 0) {
+        printf("Erro ao abrir o log de índices!\n");
+        exit(1);
+    }
+    load_primary_indices();
+    load_secondary_indices();
+    load_attribute_index();
+    load_year_index();
+    load_column_store();
+    wal_replay();
+}
+
+// Apagar os arquivos de índice e o log (antes de uma reconstrução completa)
+void remove_index_files() {
+    static const char *files[] = {
+        "primary_index.dat", "primary_hash.dat", "secondary_index.dat", "secondary_runs.dat", "trigram_index.dat",
+        "attribute_index.dat", "year_index.dat", "column_store.dat", "index.wal"
+    };
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        unlink(files[i]);
+    }
+}
+
+// Checkpoint final e fechamento dos arquivos de índice
+void close_indices() {
+    checkpoint_indices();
+    if (index_wal.fd >= 0) {
+        close(index_wal.fd);
+        index_wal.fd = -1;
+    }
+    btree_close();
+    primary_hash_clear();
+    secondary_clear();
+    trigram_clear();
+    title_cache_clear();
+    attribute_clear();
+    year_clear();
+    column_clear();
+}
+
+// ===================== ARQUIVO DE DADOS (FORMATO V2) =====================
+//
+// mangas.dat começa com um DataHeader e guarda registros de tamanho variável:
+//
+//   u32 slot_size      bytes reservados para o registro (inclui este cabeçalho)
+//   u8  deleted        0 = ativo, 1 = deletado
+//   u8  reserved
+//   u16 record_size    bytes efetivamente usados
+//   i16 start_year, i16 end_year, i16 edition_year
+//   u16 total_volumes
+//   u16 bitmap_bytes   volumes adquiridos: bit (v - 1) ligado = volume v
+//   bitmap
+//   isbn, title, author, genre, magazine, publisher (u8 tamanho + bytes)
+//
+// Volumes fora do intervalo 1..MAX_VOLUME_NUMBER não são representáveis e são
+// descartados na gravação; acquired_volumes é o número de bits ligados.
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t reserved;
+} DataHeader;
+
+// Layout do registro no formato v1 (struct Manga gravada diretamente)
+typedef struct {
+    char isbn[ISBN_SIZE];
+    char title[MAX_TITLE];
+    char author[MAX_AUTHOR];
+    int start_year;
+    int end_year;
+    char genre[MAX_GENRE];
+    char magazine[MAX_MAGAZINE];
+    char publisher[MAX_PUBLISHER];
+    int edition_year;
+    int total_volumes;
+    int acquired_volumes;
+    int volumes_list[LEGACY_MAX_VOLUMES];
+    int deleted;
+} LegacyManga;
+
+#define RECORD_HEADER_SIZE 18
+#define RECORD_DELETED_OFFSET 4
+#define RECORD_MAX_SIZE (RECORD_HEADER_SIZE + MAX_VOLUME_NUMBER / 8 + 6 * 256)
+
+static void put_u16(unsigned char *p, uint16_t v) { memcpy(p, &v, sizeof(v)); }
+static void put_u32(unsigned char *p, uint32_t v) { memcpy(p, &v, sizeof(v)); }
+static uint16_t get_u16(const unsigned char *p) { uint16_t v; memcpy(&v, p, sizeof(v)); return v; }
+static uint32_t get_u32(const unsigned char *p) { uint32_t v; memcpy(&v, p, sizeof(v)); return v; }
+static int16_t get_i16(const unsigned char *p) { int16_t v; memcpy(&v, p, sizeof(v)); return v; }
+
+static unsigned char *put_string(unsigned char *p, const char *str) {
+    size_t len = strlen(str);
+    if (len > 255) len = 255;
+    *p++ = (unsigned char)len;
+    memcpy(p, str, len);
+    return p + len;
+}
+
+static const unsigned char *get_string(const unsigned char *p, const unsigned char *end, char *dest, size_t size) {
+    if (p >= end) return NULL;
+    size_t len = *p++;
+    if (p + len > end) return NULL;
+    size_t copy = len < size ? len : size - 1;
+    memcpy(dest, p, copy);
+    dest[copy] = '\0';
+    return p + len;
+}
+
+// Codificar um mangá no formato v2; retorna o tamanho do registro
+size_t encode_manga(const Manga *manga, unsigned char *buffer) {
+    int bitmap_bytes = VOLUME_BITMAP_BYTES;
+    while (bitmap_bytes > 0 && manga->volumes[bitmap_bytes - 1] == 0) bitmap_bytes--;
+    int total = manga->total_volumes > MAX_VOLUME_NUMBER ? MAX_VOLUME_NUMBER : manga->total_volumes;
+    if ((total + 7) / 8 > bitmap_bytes) bitmap_bytes = (total + 7) / 8;
+
+    memset(buffer, 0, RECORD_HEADER_SIZE + bitmap_bytes);
+    buffer[RECORD_DELETED_OFFSET] = manga->deleted ? 1 : 0;
+    put_u16(buffer + 8, (uint16_t)manga->start_year);
+    put_u16(buffer + 10, (uint16_t)manga->end_year);
+    put_u16(buffer + 12, (uint16_t)manga->edition_year);
+    put_u16(buffer + 14, (uint16_t)(manga->total_volumes > 0 ? manga->total_volumes : 0));
+    put_u16(buffer + 16, (uint16_t)bitmap_bytes);
+
+    unsigned char *bitmap = buffer + RECORD_HEADER_SIZE;
+    memcpy(bitmap, manga->volumes, bitmap_bytes);
+
+    unsigned char *p = bitmap + bitmap_bytes;
+    p = put_string(p, manga->isbn);
+    p = put_string(p, manga->title);
+    p = put_string(p, manga->author);
+    p = put_string(p, manga->genre);
+    p = put_string(p, manga->magazine);
+    p = put_string(p, manga->publisher);
+
+    size_t size = p - buffer;
+    put_u32(buffer, (uint32_t)size);
+    put_u16(buffer + 6, (uint16_t)size);
+    return size;
+}
+
+// Preencher o conjunto de volumes e acquired_volumes (bits ligados) a partir do bitmap
+void volumes_from_bitmap(Manga *manga, const unsigned char *bitmap, int bitmap_bytes) {
+    if (bitmap_bytes > VOLUME_BITMAP_BYTES) bitmap_bytes = VOLUME_BITMAP_BYTES;
+    memset(manga->volumes, 0, sizeof(manga->volumes));
+    memcpy(manga->volumes, bitmap, bitmap_bytes);
+    if (MAX_VOLUME_NUMBER % 8) {
+        manga->volumes[VOLUME_BITMAP_BYTES - 1] &= (1 << (MAX_VOLUME_NUMBER % 8)) - 1;
+    }
+    manga->acquired_volumes = 0;
+    for (int byte = 0; byte < bitmap_bytes; byte++) {
+        for (unsigned bits = manga->volumes[byte]; bits; bits &= bits - 1) {
+            manga->acquired_volumes++;
+        }
+    }
+}
+
+// Decodificar um registro v2; retorna 0 em caso de sucesso
+int decode_manga(const unsigned char *buffer, size_t available, Manga *manga) {
+    if (available < RECORD_HEADER_SIZE) return -1;
+
+    size_t record_size = get_u16(buffer + 6);
+    int bitmap_bytes = get_u16(buffer + 16);
+    if (record_size > available || RECORD_HEADER_SIZE + (size_t)bitmap_bytes > record_size) return -1;
+
+    const unsigned char *end = buffer + record_size;
+    memset(manga, 0, sizeof(Manga));
+    manga->deleted = buffer[RECORD_DELETED_OFFSET];
+    manga->start_year = get_i16(buffer + 8);
+    manga->end_year = get_i16(buffer + 10);
+    manga->edition_year = get_i16(buffer + 12);
+    manga->total_volumes = get_u16(buffer + 14);
+
+    const unsigned char *bitmap = buffer + RECORD_HEADER_SIZE;
+    volumes_from_bitmap(manga, bitmap, bitmap_bytes);
+
+    const unsigned char *p = bitmap + bitmap_bytes;
+    if (!(p = get_string(p, end, manga->isbn, ISBN_SIZE))) return -1;
+    if (!(p = get_string(p, end, manga->title, MAX_TITLE))) return -1;
+    if (!(p = get_string(p, end, manga->author, MAX_AUTHOR))) return -1;
+    if (!(p = get_string(p, end, manga->genre, MAX_GENRE))) return -1;
+    if (!(p = get_string(p, end, manga->magazine, MAX_MAGAZINE))) return -1;
+    if (!(p = get_string(p, end, manga->publisher, MAX_PUBLISHER))) return -1;
+    return 0;
+}
+
+// Verificar o cabeçalho de mangas.dat (criando o arquivo se não existir)
+// Retorna 0 se o arquivo está no formato atual, 1 se está no formato v1, -1 em erro
+int check_data_file() {
+    FILE *file = io_fopen("mangas.dat", "rb");
+    if (!file) {
+        file = io_fopen("mangas.dat", "wb");
+        if (!file) return -1;
+        DataHeader header = { DATA_MAGIC, DATA_VERSION, sizeof(DataHeader), 0 };
+        io_fwrite(&header, sizeof(header), 1, file);
+        fclose(file);
+        return 0;
+    }
+
+    DataHeader header;
+    size_t n = io_fread(&header, 1, sizeof(header), file);
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+
+    if (n == sizeof(header) && memcmp(header.magic, DATA_MAGIC, 4) == 0) {
+        return header.version == DATA_VERSION ? 0 : -1;
+    }
+    if (size == 0) {
+        unlink("mangas.dat");
+        return check_data_file();
+    }
+    return size % sizeof(LegacyManga) == 0 ? 1 : -1;
+}
+
+// Abrir mangas.dat para leitura mapeada e gravação com pwrite
+int open_data_file() {
+    int fd = io_open("mangas.dat", O_RDWR, 0);
+    if (fd < 0 || map_file_attach(&data_map, fd, POSIX_MADV_RANDOM) != 0) {
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return 0;
+}
+
+void close_data_file() {
+    if (data_map.fd >= 0) {
+        int fd = data_map.fd;
+        data_pool_reset();
+        map_file_detach(&data_map);
+        close(fd);
+    }
+}
+
+// Ponteiro para o registro que começa em offset, dentro do mapeamento
+// Retorna NULL se o offset não contém um registro válido
+const unsigned char *data_record(long offset) {
+    if (offset < (long)sizeof(DataHeader) || !map_file_covers(&data_map, offset, RECORD_HEADER_SIZE)) {
+        return NULL;
+    }
+
+    const unsigned char *record = data_map.base + offset;
+    size_t slot_size = get_u32(record);
+    size_t record_size = get_u16(record + 6);
+    if (record_size < RECORD_HEADER_SIZE || slot_size < record_size ||
+        !map_file_covers(&data_map, offset, slot_size)) {
+        return NULL;
+    }
+    return data_map.base + offset;
+}
+
+// Conferir os tamanhos do cabeçalho de um registro lido pelo buffer pool, como data_record
+static int record_header_valid(long offset, const unsigned char *header) {
+    size_t slot_size = get_u32(header);
+    size_t record_size = get_u16(header + 6);
+    return record_size >= RECORD_HEADER_SIZE && record_size <= RECORD_MAX_SIZE && slot_size >= record_size &&
+           map_file_covers(&data_map, offset, slot_size);
+}
+
+// Ler pelo buffer pool o cabeçalho do registro que começa em offset; retorna 0 se é válido
+static int pool_record_header(long offset, unsigned char *header) {
+    if (offset < (long)sizeof(DataHeader) || data_pool_read(offset, header, RECORD_HEADER_SIZE) != 0) {
+        return -1;
+    }
+    return record_header_valid(offset, header) ? 0 : -1;
+}
+
+// Ler (decodificar) o registro que começa em offset; retorna 0 em caso de sucesso
+// Um registro contido em uma página é decodificado direto do quadro, que fica fixado
+int read_record(long offset, Manga *manga) {
+    if (offset < (long)sizeof(DataHeader)) return -1;
+
+    DataFrame *frame;
+    size_t available;
+    const unsigned char *view = data_pool_view(offset, &frame, &available);
+    if (!view) return -1;
+    if (available >= RECORD_HEADER_SIZE && get_u16(view + 6) <= available) {
+        int result = record_header_valid(offset, view) ? decode_manga(view, get_u16(view + 6), manga) : -1;
+        data_pool_unpin(frame);
+        return result;
+    }
+    data_pool_unpin(frame);
+
+    // Registro que atravessa o limite da página: copiado das duas
+    unsigned char record[RECORD_MAX_SIZE];
+    if (pool_record_header(offset, record) != 0) return -1;
+
+    size_t record_size = get_u16(record + 6);
+    if (data_pool_read(offset + RECORD_HEADER_SIZE, record + RECORD_HEADER_SIZE, record_size - RECORD_HEADER_SIZE) != 0) {
+        return -1;
+    }
+    return decode_manga(record, record_size, manga);
+}
+
+// Avançar para o próximo registro de uma varredura sequencial do mapeamento
+// Retorna 1 se leu um registro, 0 no fim do arquivo e -1 se o arquivo estiver corrompido
+int read_next_record(long *offset, Manga *manga) {
+    if ((size_t)*offset >= data_map.size && !map_file_covers(&data_map, *offset, 1)) {
+        return 0;
+    }
+
+    const unsigned char *record = data_record(*offset);
+    if (!record || decode_manga(record, get_u16(record + 6), manga) != 0) {
+        return -1;
+    }
+    *offset += get_u32(record);
+    return 1;
+}
+
+// Acrescentar um registro ao final do arquivo; retorna o offset
+long append_record(const Manga *manga) {
+    unsigned char buffer[RECORD_MAX_SIZE];
+    size_t size = encode_manga(manga, buffer);
+
+    struct stat st;
+    if (fstat(data_map.fd, &st) != 0) return -1;
+    if (io_pwrite(data_map.fd, buffer, size, st.st_size) != (ssize_t)size) return -1;
+    map_file_remap(&data_map);
+    data_pool_appended(st.st_size, buffer, size);
+    return st.st_size;
+}
+
+// Regravar um registro no lugar, se couber no espaço reservado
+// Retorna 0 se gravou, 1 se não coube e -1 em erro
+int rewrite_record(long offset, const Manga *manga) {
+    unsigned char header[RECORD_HEADER_SIZE];
+    unsigned char buffer[RECORD_MAX_SIZE];
+    if (pool_record_header(offset, header) != 0) return -1;
+
+    uint32_t slot_size = get_u32(header);
+    size_t size = encode_manga(manga, buffer);
+    if (size > slot_size) return 1;
+
+    put_u32(buffer, slot_size);
+    return data_pool_write(offset, buffer, size);
+}
+
+// Marcar um registro como deletado (altera apenas o byte do flag)
+int mark_record_deleted(long offset) {
+    unsigned char deleted = 1;
+    return data_pool_write(offset + RECORD_DELETED_OFFSET, &deleted, 1);
+}
+
+// ===================== ESPAÇO LIVRE (REGISTROS DELETADOS) =====================
+//
+// Os espaços de registros deletados ficam em uma lista ordenada por tamanho e
+// são reaproveitados por create_manga() (o menor espaço em que o registro cabe).
+// A lista é montada com uma varredura de mangas.dat na primeira vez em que é
+// usada e depois mantida a cada remoção; compact_data_file() elimina esses espaços.
+
+typedef struct {
+    long offset;
+    uint32_t size;
+} FreeSlot;
+
+FreeSlot *free_slots = NULL;
+int free_slot_count = 0;
+int free_slot_capacity = 0;
+int free_slots_loaded = 0;
+
+static void free_list_insert(long offset, uint32_t size) {
+    if (free_slot_count == free_slot_capacity) {
+        free_slot_capacity = free_slot_capacity ? 2 * free_slot_capacity : 64;
+        free_slots = realloc(free_slots, free_slot_capacity * sizeof(FreeSlot));
+    }
+
+    int lo = 0, hi = free_slot_count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (free_slots[mid].size < size) lo = mid + 1;
+        else hi = mid;
+    }
+    memmove(&free_slots[lo + 1], &free_slots[lo], (free_slot_count - lo) * sizeof(FreeSlot));
+    free_slots[lo].offset = offset;
+    free_slots[lo].size = size;
+    free_slot_count++;
+}
+
+// Montar a lista com os registros deletados de mangas.dat
+static void free_list_load() {
+    long offset = sizeof(DataHeader);
+    free_slot_count = 0;
+    free_slots_loaded = 1;
+    data_pool_flush();
+
+    const unsigned char *record;
+    while ((record = data_record(offset)) != NULL) {
+        if (record[RECORD_DELETED_OFFSET]) {
+            free_list_insert(offset, get_u32(record));
+        }
+        offset += get_u32(record);
+    }
+}
+
+// Descartar a lista (ela é montada de novo quando for necessária)
+void free_list_reset() {
+    free(free_slots);
+    free_slots = NULL;
+    free_slot_count = free_slot_capacity = 0;
+    free_slots_loaded = 0;
+}
+
+// Registrar o espaço de um registro que acabou de ser deletado
+void free_list_add(long offset) {
+    const unsigned char *record = data_record(offset);
+    if (free_slots_loaded && record) {
+        free_list_insert(offset, get_u32(record));
+    }
+}
+
+// Retirar da lista o menor espaço com pelo menos size bytes; -1 se não houver
+static long free_list_take(size_t size) {
+    if (!free_slots_loaded) {
+        free_list_load();
+    }
+
+    int lo = 0, hi = free_slot_count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (free_slots[mid].size < size) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == free_slot_count) return -1;
+
+    long offset = free_slots[lo].offset;
+    memmove(&free_slots[lo], &free_slots[lo + 1], (free_slot_count - lo - 1) * sizeof(FreeSlot));
+    free_slot_count--;
+    return offset;
+}
+
+// Gravar um registro novo, reaproveitando o espaço de um deletado quando possível
+long store_record(const Manga *manga) {
+    unsigned char buffer[RECORD_MAX_SIZE];
+    size_t size = encode_manga(manga, buffer);
+
+    long offset = free_list_take(size);
+    if (offset >= 0) {
+        return rewrite_record(offset, manga) == 0 ? offset : -1;
+    }
+    return append_record(manga);
+}
+
+// ===================== CONSULTAS POR ATRIBUTOS E FAIXAS DE ANOS =====================
+//
+// Combina o índice invertido de atributos com as faixas de anos. Os anos são
+// conferidos direto no cabeçalho do registro mapeado (i16 início, término e edição
+// a partir do byte 8, na ordem de YEAR_START..YEAR_EDITION), sem decodificá-lo:
+//
+//   - com atributos, a interseção das listas guia a consulta e as faixas filtram;
+//   - só com faixas, a mais seletiva pelo índice ordenado, se for pequena; senão
+//     uma varredura de mangas.dat que pula os blocos cujo mapa de zona não atende.
+
+typedef struct {
+    const YearRange *ranges;
+    int count;
+} YearFilter;
+
+// Verificar se os anos do cabeçalho do registro atendem a todas as faixas
+static int record_years_match(const unsigned char *record, const YearRange *ranges, int count) {
+    for (int i = 0; i < count; i++) {
+        int year = get_i16(record + 8 + 2 * ranges[i].field);
+        if (year < ranges[i].min || year > ranges[i].max) return 0;
+    }
+    return 1;
+}
+
+static int year_filter_accept(long offset, void *context) {
+    const YearFilter *filter = context;
+    const unsigned char *record = data_record(offset);
+    return record && record_years_match(record, filter->ranges, filter->count);
+}
+
+static int compare_offsets(const void *a, const void *b) {
+    long x = *(const long*)a, y = *(const long*)b;
+    return (x > y) - (x < y);
+}
+
+// Offsets dos registros com todos os termos e dentro de todas as faixas, em ordem
+// crescente. Guarda até max_results em results e devolve o total encontrado
+long filter_query(const AttributeTerms *terms, const YearRange *ranges, int range_count,
+                  long *results, int max_results) {
+    YearFilter filter = { ranges, range_count };
+
+    // Os anos e o flag de deleção são lidos do mapeamento
+    data_pool_flush();
+    if (terms->count > 0) {
+        return attribute_query(terms, range_count > 0 ? year_filter_accept : NULL, &filter, results, max_results);
+    }
+    if (range_count == 0) {
+        return 0;
+    }
+
+    // Faixa mais seletiva pelo índice ordenado
+    int best = 0;
+    long best_first = 0, best_count = year_index.count + 1;
+    for (int i = 0; i < range_count; i++) {
+        long first, count = year_range_count(&ranges[i], &first);
+        if (count < best_count) {
+            best = i;
+            best_first = first;
+            best_count = count;
+        }
+    }
+    if (best_count == 0) {
+        return 0;
+    }
+
+    // Registros nos blocos que a varredura visitaria (estimativa pela média por bloco)
+    long zones = 0;
+    for (long block = 0; block < year_index.zone_count; block++) {
+        zones += zone_may_match(&year_index.zones[block], ranges, range_count);
+    }
+    long scanned = year_index.zone_count > 0 ? zones * (year_index.count / year_index.zone_count + 1) : 0;
+
+    long total = 0;
+    if (best_count * 4 <= scanned) {
+        // Poucos candidatos: ordenados por offset, conferidos no cabeçalho
+        const YearEntry *entries = year_index.entries[ranges[best].field] + best_first;
+        long *candidates = malloc(best_count * sizeof(long));
+        for (long i = 0; i < best_count; i++) {
+            candidates[i] = entries[i].offset;
+        }
+        sort_array(candidates, best_count, sizeof(long), compare_offsets);
+        for (long i = 0; i < best_count; i++) {
+            if (year_filter_accept(candidates[i], &filter)) {
+                if (total < max_results) results[total] = candidates[i];
+                total++;
+            }
+        }
+        free(candidates);
+        return total;
+    }
+
+    // Varredura dos blocos que podem conter resultados; só entram registros ativos
+    // que estão no índice (uma versão antiga de um registro movido fica de fora)
+    for (long block = 0; block < year_index.zone_count; block++) {
+        const ZoneMap *zone = &year_index.zones[block];
+        if (!zone_may_match(zone, ranges, range_count)) continue;
+
+        long end = (block + 1) * ZONE_BLOCK_SIZE;
+        const unsigned char *record;
+        for (long offset = zone->first; offset < end && (record = data_record(offset)) != NULL; offset += get_u32(record)) {
+            if (record[RECORD_DELETED_OFFSET] || !record_years_match(record, ranges, range_count) ||
+                !year_contains(get_i16(record + 8), offset)) {
+                continue;
+            }
+            if (total < max_results) results[total] = offset;
+            total++;
+        }
+    }
+    return total;
+}
+
+// ===================== OPERAÇÕES SOBRE O CATÁLOGO =====================
+//
+// Usadas pelo menu e pelo modo em lote. Alteram o arquivo de dados e os índices;
+// a confirmação dos índices (commit_index_changes) fica com quem chama.
+
+// Gravar um mangá novo (ISBN ainda não cadastrado); retorna 0 ou -1 em erro de gravação
+int insert_manga(const Manga *manga) {
+    // No espaço de um registro deletado, se houver
+    long offset = store_record(manga);
+    if (offset < 0) {
+        return -1;
+    }
+    add_primary_index(manga->isbn, offset);
+    add_secondary_index(manga->title, manga->isbn);
+    add_attribute_index(manga, offset);
+    add_year_index(manga, offset);
+    add_column_row(manga, offset);
+    return 0;
+}
+
+// Gravar as alterações de um mangá lido de offset (old é o estado anterior)
+// Retorna 0 ou -1 em erro de gravação
+int save_manga(long offset, const Manga *manga, const Manga *old) {
+    // No lugar, ou no fim do arquivo se o registro cresceu. O registro antigo só é
+    // marcado como deletado depois que o log com o novo offset for confirmado por
+    // quem chamou (defer_record_delete)
+    int status = rewrite_record(offset, manga);
+    if (status == 1) {
+        long new_offset = append_record(manga);
+        if (new_offset < 0) {
+            return -1;
+        }
+        add_primary_index(manga->isbn, new_offset);
+        remove_attribute_index(old, offset);
+        add_attribute_index(manga, new_offset);
+        remove_year_index(old, offset);
+        add_year_index(manga, new_offset);
+        remove_column_row(offset);
+        add_column_row(manga, new_offset);
+        defer_record_delete(offset);
+        status = 0;
+    } else if (status == 0) {
+        if (!attribute_terms_equal(old, manga)) {
+            remove_attribute_index(old, offset);
+            add_attribute_index(manga, offset);
+        }
+        if (!year_values_equal(old, manga)) {
+            remove_year_index(old, offset);
+            add_year_index(manga, offset);
+        }
+        if (!column_values_equal(old, manga)) {
+            add_column_row(manga, offset);
+        }
+    }
+    if (status != 0) {
+        return -1;
+    }
+
+    // Atualizar índice secundário se título mudou
+    if (strcmp(old->title, manga->title) != 0) {
+        remove_secondary_index(old->title, manga->isbn);
+        add_secondary_index(manga->title, manga->isbn);
+    }
+    return 0;
+}
+
+// Deletar o mangá lido de offset
+// O registro só é marcado como deletado na confirmação de quem chamou (defer_record_delete)
+void remove_manga(long offset, const Manga *manga) {
+    remove_primary_index(manga->isbn);
+    remove_secondary_index(manga->title, manga->isbn);
+    remove_attribute_index(manga, offset);
+    remove_year_index(manga, offset);
+    remove_column_row(offset);
+    defer_record_delete(offset);
+}
+
+// Alteração incremental dos volumes adquiridos: a faixa first..last (inclusiva)
+// passa a constar como adquirida ou deixa de constar
+typedef struct {
+    int first;
+    int last;
+    int remove;
+} VolumeChange;
+
+// Interpretar alterações como "+5 -3 +10..12" (separadas por espaços ou vírgulas;
+// sem sinal o volume é adquirido). Retorna a quantidade, ou -1 se alguma for inválida
+int parse_volume_changes(const char *text, VolumeChange *changes, int max) {
+    int count = 0;
+    const char *p = text;
+    while (1) {
+        while (isspace((unsigned char)*p) || *p == ',') p++;
+        if (*p == '\0') break;
+
+        int remove = 0;
+        if (*p == '+' || *p == '-') {
+            remove = *p++ == '-';
+        }
+        char *end;
+        if (!isdigit((unsigned char)*p)) return -1;
+        long first = strtol(p, &end, 10), last = first;
+        p = end;
+        if (p[0] == '.' && p[1] == '.') {
+            if (!isdigit((unsigned char)p[2])) return -1;
+            last = strtol(p + 2, &end, 10);
+            p = end;
+        }
+        if ((*p && !isspace((unsigned char)*p) && *p != ',') ||
+            first < 1 || last < first || last > MAX_VOLUME_NUMBER || count == max) {
+            return -1;
+        }
+        changes[count].first = (int)first;
+        changes[count].last = (int)last;
+        changes[count].remove = remove;
+        count++;
+    }
+    return count;
+}
+
+// Aplicar as alterações, na ordem, aos volumes do mangá gravado em offset (manga é o
+// estado lido do registro e recebe o novo). O conjunto de volumes do mangá é o próprio
+// bitmap do registro: só os bytes dele que mudaram são gravados. Um volume além do
+// bitmap gravado exige regravar o registro inteiro com o conjunto já alterado
+// (save_manga, que pode mudá-lo de lugar)
+// Retorna 0 ou -1 em erro de gravação
+int change_volumes(long offset, Manga *manga, const VolumeChange *changes, int count) {
+    unsigned char header[RECORD_HEADER_SIZE];
+    if (pool_record_header(offset, header) != 0) return -1;
+    int bitmap_bytes = get_u16(header + 16);
+    if (bitmap_bytes > VOLUME_BITMAP_BYTES) bitmap_bytes = VOLUME_BITMAP_BYTES;
+
+    Manga old = *manga;
+    for (int i = 0; i < count; i++) {
+        for (int volume = changes[i].first; volume <= changes[i].last; volume++) {
+            if (changes[i].remove) {
+                manga_remove_volume(manga, volume);
+            } else {
+                manga_add_volume(manga, volume);
+            }
+        }
+    }
+
+    int bytes = VOLUME_BITMAP_BYTES;
+    while (bytes > 0 && manga->volumes[bytes - 1] == 0) bytes--;
+    if (bytes > bitmap_bytes) {
+        return save_manga(offset, manga, &old);
+    }
+
+    int first = 0, last = bitmap_bytes - 1;
+    while (first < bitmap_bytes && manga->volumes[first] == old.volumes[first]) first++;
+    while (last > first && manga->volumes[last] == old.volumes[last]) last--;
+    if (first < bitmap_bytes &&
+        data_pool_write(offset + RECORD_HEADER_SIZE + first, manga->volumes + first, last - first + 1) != 0) {
+        return -1;
+    }
+    if (!column_values_equal(&old, manga)) {
+        add_column_row(manga, offset);
+    }
+    return 0;
+}
+
+// Criar novo registro de mangá
+void create_manga() {
+    Manga manga;
+    
+    printf("\n=== CRIAR NOVO MANGÁ ===\n");
+    
+    printf("ISBN: ");
+    scanf("%s", manga.isbn);
+    
+    uint64_t key;
+    if (isbn_key(manga.isbn, &key) != 0) {
+        printf("Erro: ISBN inválido (confira o dígito verificador)!\n");
+        return;
+    }
+
+    // Verificar se ISBN já existe
+    if (find_manga_by_isbn(manga.isbn) != -1) {
+        printf("Erro: ISBN já existe!\n");
+        return;
+    }
+    
+    printf("Título: ");
+    getchar(); // Limpar buffer
+    fgets(manga.title, MAX_TITLE, stdin);
+    manga.title[strcspn(manga.title, "\n")] = 0; // Remover \n
+    
+    printf("Autor(es): ");
+    fgets(manga.author, MAX_AUTHOR, stdin);
+    manga.author[strcspn(manga.author, "\n")] = 0;
+    
+    printf("Ano de início: ");
+    scanf("%d", &manga.start_year);
+    
+    printf("Ano de fim (-1 se ainda em publicação): ");
+    scanf("%d", &manga.end_year);
+    
+    printf("Gênero: ");
+    getchar();
+    fgets(manga.genre, MAX_GENRE, stdin);
+    manga.genre[strcspn(manga.genre, "\n")] = 0;
+    
+    printf("Revista: ");
+    fgets(manga.magazine, MAX_MAGAZINE, stdin);
+    manga.magazine[strcspn(manga.magazine, "\n")] = 0;
+    
+    printf("Editora: ");
+    fgets(manga.publisher, MAX_PUBLISHER, stdin);
+    manga.publisher[strcspn(manga.publisher, "\n")] = 0;
+    
+    printf("Ano da edição: ");
+    scanf("%d", &manga.edition_year);
+    
+    printf("Quantidade total de volumes: ");
+    scanf("%d", &manga.total_volumes);
+    
+    printf("Quantidade de volumes adquiridos: ");
+    int acquired;
+    scanf("%d", &acquired);
+    
+    printf("Digite os volumes adquiridos (separados por espaço): ");
+    manga_clear_volumes(&manga);
+    for (int i = 0; i < acquired; i++) {
+        int volume;
+        scanf("%d", &volume);
+        manga_add_volume(&manga, volume);
+    }
+    
+    manga.deleted = 0;
+    
+    // Salvar no arquivo de dados e atualizar índices
+    uint64_t start = metrics_clock();
+    if (insert_manga(&manga) != 0) {
+        printf("Erro ao gravar no arquivo de dados!\n");
+        return;
+    }
+    commit_index_changes();
+    metrics_record(METRIC_PUT, start);
+    
+    printf("Mangá criado com sucesso!\n");
+}
+
+// Ler mangá por ISBN ou título
+void read_manga() {
+    char search[MAX_TITLE];
+    long offset;
+    
+    printf("\n=== BUSCAR MANGÁ ===\n");
+    printf("Digite o ISBN ou título (pode ser parcial): ");
+    getchar();
+    fgets(search, MAX_TITLE, stdin);
+    search[strcspn(search, "\n")] = 0;
+    
+    // Tentar buscar por ISBN primeiro
+    uint64_t start = metrics_clock();
+    offset = find_manga_by_isbn(search);
+    int by_isbn = offset != -1;
+    
+    if (offset == -1) {
+        // Buscar por título, dos resultados mais relevantes para os menos, 10 por
+        // página; um título igual ao termo (e só um) é aberto direto
+        TitleCursor cursor;
+        TitleHit hits[10];
+        title_cursor_init(&cursor, search);
+        int count = search_titles(&cursor, hits, 10);
+        metrics_record(METRIC_SEARCH, start);
+        if (count > 1 && hits[0].match == MATCH_EXACT && hits[1].match != MATCH_EXACT) {
+            count = 1;
+        }
+        
+        // Nenhum título contém o termo: oferecer os parecidos (erros de digitação)
+        int similar = 0;
+        if (count == 0) {
+            start = metrics_clock();
+            count = find_similar_titles(search, hits, 10);
+            metrics_record(METRIC_FUZZY, start);
+            cursor.remaining = 0;
+            similar = 1;
+        }
+        
+        if (count == 0) {
+            printf("Mangá não encontrado!\n");
+            return;
+        } else if (count == 1 && !similar) {
+            offset = find_manga_by_isbn(hits[0].isbn);
+        } else {
+            int choice = 0;
+            int first = 1;
+            if (similar) {
+                printf("\nNenhum título contém \"%s\". Você quis dizer:\n", search);
+            } else {
+                printf("\nEncontrados %ld mangás:\n", cursor.total);
+            }
+            for (;;) {
+                for (int i = 0; i < count; i++) {
+                    printf("%d. %s (%s)\n", first + i, hits[i].title, hits[i].isbn);
+                }
+                
+                if (cursor.remaining > 0) {
+                    printf("Escolha um mangá (%d-%d) ou 0 para os próximos %ld: ", first, first + count - 1,
+                           cursor.remaining < 10 ? cursor.remaining : 10);
+                } else {
+                    printf("Escolha um mangá (%d-%d): ", first, first + count - 1);
+                }
+                if (scanf("%d", &choice) != 1) choice = -1;
+                if (choice != 0 || cursor.remaining == 0) break;
+                
+                first += count;
+                start = metrics_clock();
+                count = search_titles(&cursor, hits, 10);
+                metrics_record(METRIC_NEXT, start);
+                if (count == 0) break;
+            }
+            
+            if (choice < first || choice >= first + count) {
+                printf("Opção inválida!\n");
+                return;
+            }
+            
+            offset = find_manga_by_isbn(hits[choice - first].isbn);
+        }
+    }
+    
+    if (offset == -1) {
+        printf("Erro ao localizar mangá!\n");
+        return;
+    }
+    
+    // Ler do arquivo (pelo buffer pool)
+    Manga manga;
+    int status = read_record(offset, &manga);
+    if (by_isbn) {
+        metrics_record(METRIC_GET, start);
+    }
+    if (status != 0) {
+        printf("Erro ao ler registro do arquivo de dados!\n");
+        return;
+    }
+    
+    if (manga.deleted) {
+        printf("Mangá foi deletado!\n");
+        return;
+    }
+    
+    display_manga(&manga);
+}
+
+// Atualizar mangá
+void update_manga() {
+    char search[MAX_TITLE];
+    long offset;
+    char *isbn;
+    
+    printf("\n=== ATUALIZAR MANGÁ ===\n");
+    printf("Digite o ISBN ou título do mangá a ser atualizado: ");
+    getchar();
+    fgets(search, MAX_TITLE, stdin);
+    search[strcspn(search, "\n")] = 0;
+    
+    // Buscar mangá
+    offset = find_manga_by_isbn(search);
+    if (offset == -1) {
+        isbn = find_isbn_by_title(search);
+        if (isbn) {
+            offset = find_manga_by_isbn(isbn);
+        }
+    }
+    
+    if (offset == -1) {
+        printf("Mangá não encontrado!\n");
+        return;
+    }
+    
+    // Ler mangá atual
+    Manga manga;
+    if (read_record(offset, &manga) != 0) {
+        printf("Erro ao ler registro do arquivo de dados!\n");
+        return;
+    }
+    
+    if (manga.deleted) {
+        printf("Mangá foi deletado!\n");
+        return;
+    }
+    
+    Manga old = manga;
+    
+    // Atualizar campos
+    printf("Título atual: %s\n", manga.title);
+    printf("Novo título (Enter para manter): ");
+    char new_title[MAX_TITLE];
+    fgets(new_title, MAX_TITLE, stdin);
+    if (strlen(new_title) > 1) {
+        new_title[strcspn(new_title, "\n")] = 0;
+        strcpy(manga.title, new_title);
+    }
+    
+    printf("Volumes adquiridos atual: %d\n", manga.acquired_volumes);
+    printf("Novos volumes adquiridos (-1 para manter): ");
+    int new_acquired;
+    scanf("%d", &new_acquired);
+    if (new_acquired != -1) {
+        printf("Digite os novos volumes adquiridos: ");
+        manga_clear_volumes(&manga);
+        for (int i = 0; i < new_acquired; i++) {
+            int volume;
+            scanf("%d", &volume);
+            manga_add_volume(&manga, volume);
+        }
+    }
+    
+    // Salvar alterações
+    uint64_t start = metrics_clock();
+    if (save_manga(offset, &manga, &old) != 0) {
+        printf("Erro ao gravar no arquivo de dados!\n");
+        return;
+    }
+    commit_index_changes();
+    metrics_record(METRIC_UPDATE, start);
+    
+    printf("Mangá atualizado com sucesso!\n");
+}
+
+// Adicionar ou remover volumes adquiridos sem redigitar a lista inteira
+void update_volumes() {
+    char search[MAX_TITLE];
+    long offset;
+    char *isbn;
+    
+    printf("\n=== VOLUMES ADQUIRIDOS ===\n");
+    printf("Digite o ISBN ou título do mangá: ");
+    getchar();
+    fgets(search, MAX_TITLE, stdin);
+    search[strcspn(search, "\n")] = 0;
+    
+    // Buscar mangá
+    offset = find_manga_by_isbn(search);
+    if (offset == -1) {
+        isbn = find_isbn_by_title(search);
+        if (isbn) {
+            offset = find_manga_by_isbn(isbn);
+        }
+    }
+    
+    if (offset == -1) {
+        printf("Mangá não encontrado!\n");
+        return;
+    }
+    
+    Manga manga;
+    if (read_record(offset, &manga) != 0) {
+        printf("Erro ao ler registro do arquivo de dados!\n");
+        return;
+    }
+    
+    if (manga.deleted) {
+        printf("Mangá foi deletado!\n");
+        return;
+    }
+    
+    printf("%s - volumes adquiridos (%d): ", manga.title, manga.acquired_volumes);
+    for (int v = manga_next_volume(&manga, 0), first = 1; v; v = manga_next_volume(&manga, v), first = 0) {
+        printf(first ? "%d" : ", %d", v);
+    }
+    printf("\n");
+    
+    printf("Alterações (ex.: +5 -3 +10..12): ");
+    char line[IMPORT_LINE_SIZE];
+    VolumeChange changes[MAX_VOLUME_CHANGES];
+    if (!fgets(line, sizeof(line), stdin)) {
+        return;
+    }
+    int count = parse_volume_changes(line, changes, MAX_VOLUME_CHANGES);
+    if (count <= 0) {
+        printf("Alterações inválidas! Use +N, -N, +N..M ou -N..M (volumes de 1 a %d)\n", MAX_VOLUME_NUMBER);
+        return;
+    }
+    
+    uint64_t start = metrics_clock();
+    if (change_volumes(offset, &manga, changes, count) != 0) {
+        printf("Erro ao gravar no arquivo de dados!\n");
+        return;
+    }
+    commit_index_changes();
+    metrics_record(METRIC_VOLUMES, start);
+    
+    printf("Volumes atualizados: %d adquiridos\n", manga.acquired_volumes);
+}
+
+// Deletar mangá
+void delete_manga() {
+    char search[MAX_TITLE];
+    long offset;
+    char *isbn;
+    char confirm;
+    
+    printf("\n=== DELETAR MANGÁ ===\n");
+    printf("Digite o ISBN ou título do mangá a ser deletado: ");
+    getchar();
+    fgets(search, MAX_TITLE, stdin);
+    search[strcspn(search, "\n")] = 0;
+    
+    // Buscar mangá
+    offset = find_manga_by_isbn(search);
+    if (offset == -1) {
+        isbn = find_isbn_by_title(search);
+        if (isbn) {
+            offset = find_manga_by_isbn(isbn);
+        }
+    }
+    
+    if (offset == -1) {
+        printf("Mangá não encontrado!\n");
+        return;
+    }
+    
+    // Ler mangá
+    Manga manga;
+    if (read_record(offset, &manga) != 0) {
+        printf("Erro ao ler registro do arquivo de dados!\n");
+        return;
+    }
+    
+    if (manga.deleted) {
+        printf("Mangá já foi deletado!\n");
+        return;
+    }
+    
+    // Confirmação
+    printf("Deseja realmente deletar o mangá '%s'? (s/N): ", manga.title);
+    scanf(" %c", &confirm);
+    
+    if (confirm == 's' || confirm == 'S') {
+        // Marcar como deletado e remover dos índices
+        uint64_t start = metrics_clock();
+        remove_manga(offset, &manga);
+        commit_index_changes();
+        metrics_record(METRIC_DELETE, start);
+        
+        printf("Mangá deletado com sucesso!\n");
+    } else {
+        printf("Operação cancelada.\n");
+    }
+}
+
+// Filtrar mangás por autor, editora, revista e gênero (todos os filtros informados)
+void filter_mangas() {
+    static const char *labels[ATTRIBUTE_FIELDS] = { "Autor", "Editora", "Revista", "Gênero" };
+    static const char *year_labels[YEAR_FIELDS] = {
+        "Ano de início (ex.: 1990..1999)", "Ano de término (-1 = em publicação)", "Ano da edição"
+    };
+    AttributeTerms terms;
+    YearRange ranges[YEAR_FIELDS];
+    int range_count = 0;
+    terms.count = 0;
+
+    printf("\n=== FILTRAR MANGÁS ===\n");
+    printf("Preencha os filtros desejados (Enter para ignorar).\n");
+    getchar();
+    for (int field = 0; field < ATTRIBUTE_FIELDS; field++) {
+        char value[MAX_AUTHOR];
+        printf("%s: ", labels[field]);
+        if (!fgets(value, MAX_AUTHOR, stdin)) break;
+        value[strcspn(value, "\n")] = 0;
+        attribute_terms_split(&terms, field, value);
+    }
+    for (int field = 0; field < YEAR_FIELDS; field++) {
+        char value[32];
+        printf("%s: ", year_labels[field]);
+        if (!fgets(value, sizeof(value), stdin)) break;
+        value[strcspn(value, "\n")] = 0;
+        if (value[0] == '\0') continue;
+        if (parse_year_range(value, field, &ranges[range_count]) != 0) {
+            printf("Faixa de anos inválida!\n");
+            return;
+        }
+        range_count++;
+    }
+
+    if (terms.count == 0 && range_count == 0) {
+        printf("Nenhum filtro informado!\n");
+        return;
+    }
+
+    long offsets[50];
+    uint64_t start = metrics_clock();
+    long total = filter_query(&terms, ranges, range_count, offsets, 50);
+    metrics_record(METRIC_FILTER, start);
+    if (total == 0) {
+        printf("Nenhum mangá encontrado!\n");
+        return;
+    }
+
+    printf("\nEncontrados %ld mangás", total);
+    if (total > 50) {
+        printf(" (exibindo os 50 primeiros)");
+    }
+    printf(":\n");
+    Manga manga;
+    for (long i = 0; i < total && i < 50; i++) {
+        if (read_record(offsets[i], &manga) == 0 && !manga.deleted) {
+            printf("%ld. %s (%s) - %s\n", i + 1, manga.title, manga.isbn, manga.author);
+        }
+    }
+}
+
+// Estatísticas da coleção: completude geral, editoras e revistas com mais séries
+// e as séries com mais volumes faltantes (calculadas sobre a projeção colunar)
+void collection_stats() {
+    static const char *labels[COLUMN_GROUPS] = { "Editora", "Revista" };
+    ColumnTotals totals;
+    column_totals(&totals);
+
+    printf("\n=== ESTATÍSTICAS DA COLEÇÃO ===\n");
+    printf("Séries: %ld (%ld completas)\n", totals.series, totals.complete);
+    printf("Volumes: %ld adquiridos de %ld (%.1f%%), %ld faltando\n", totals.acquired, totals.volumes,
+           totals.volumes > 0 ? 100.0 * totals.acquired / totals.volumes : 0.0, totals.missing);
+
+    for (int group = 0; group < COLUMN_GROUPS; group++) {
+        uint32_t count;
+        ColumnGroup *groups = column_group_totals(group, &count);
+        printf("\n%-30s %8s %10s %10s %8s\n", labels[group], "Séries", "Volumes", "Faltando", "Compl.");
+        for (uint32_t i = 0; i < count && i < 10; i++) {
+            const ColumnTotals *g = &groups[i].totals;
+            printf("%-30s %8ld %10ld %10ld %7.1f%%\n", column_store.dictionaries[group].values[groups[i].code],
+                   g->series, g->volumes, g->missing, g->volumes > 0 ? 100.0 * g->acquired / g->volumes : 0.0);
+        }
+        free(groups);
+    }
+
+    long offsets[10];
+    int32_t missing[10];
+    int count = column_top_missing(offsets, missing, 10);
+    if (count > 0) {
+        printf("\nSéries com mais volumes faltando:\n");
+    }
+    Manga manga;
+    for (int i = 0; i < count; i++) {
+        if (read_record(offsets[i], &manga) == 0) {
+            printf("%d. %s (%s) - faltam %d de %d\n", i + 1, manga.title, manga.isbn, missing[i], manga.total_volumes);
+        }
+    }
+}
+
+// Listar todos os mangás
+void list_all_mangas() {
+    printf("\n=== LISTA DE MANGÁS ===\n");
+    
+    Manga manga;
+    int count = 0;
+    long offset = sizeof(DataHeader);
+    
+    // Varredura sequencial do mapeamento
+    data_pool_flush();
+    map_file_remap(&data_map);
+    if (data_map.base) {
+        posix_madvise(data_map.base, data_map.size, POSIX_MADV_SEQUENTIAL);
+    }
+    while (read_next_record(&offset, &manga) == 1) {
+        if (!manga.deleted) {
+            printf("%d. %s (%s) - %d volumes adquiridos\n", 
+                   ++count, manga.title, manga.isbn, manga.acquired_volumes);
+        }
+    }
+    
+    if (count == 0) {
+        printf("Nenhum mangá ativo encontrado!\n");
+    }
+    
+    if (data_map.base) {
+        posix_madvise(data_map.base, data_map.size, POSIX_MADV_RANDOM);
+    }
+}
+
+// Copiar campo de texto removendo espaços das pontas e respeitando o tamanho do destino
+static void copy_field(char *dest, const char *src, size_t size) {
+    while (*src && isspace((unsigned char)*src)) {
+        src++;
+    }
+
+    size_t len = strlen(src);
+    while (len > 0 && isspace((unsigned char)src[len - 1])) {
+        len--;
+    }
+
+    if (len >= size) {
+        len = size - 1;
+    }
+    memcpy(dest, src, len);
+    dest[len] = '\0';
+}
+
+// Interpretar uma linha no formato do mangas.txt (thread-safe, usa strtok_r)
+// Retorna 1 se a linha foi interpretada com sucesso, 0 caso contrário
+int parse_manga_line(char *line, Manga *manga) {
+    char *fields[12];
+    char *saveptr;
+    int n = 0;
+
+    line[strcspn(line, "\r\n")] = 0;
+
+    char *token = strtok_r(line, ";", &saveptr);
+    while (token && n < 12) {
+        fields[n++] = token;
+        token = strtok_r(NULL, ";", &saveptr);
+    }
+
+    // A lista de volumes (último campo) é opcional
+    if (n < 11) {
+        return 0;
+    }
+
+    memset(manga, 0, sizeof(Manga));
+    copy_field(manga->isbn, fields[0], ISBN_SIZE);
+    if (manga->isbn[0] == '\0') {
+        return 0;
+    }
+    copy_field(manga->title, fields[1], MAX_TITLE);
+    copy_field(manga->author, fields[2], MAX_AUTHOR);
+    manga->start_year = atoi(fields[3]);
+
+    char end_year[16];
+    copy_field(end_year, fields[4], sizeof(end_year));
+    manga->end_year = strcmp(end_year, "-") == 0 ? -1 : atoi(end_year);
+
+    copy_field(manga->genre, fields[5], MAX_GENRE);
+    copy_field(manga->magazine, fields[6], MAX_MAGAZINE);
+    copy_field(manga->publisher, fields[7], MAX_PUBLISHER);
+    manga->edition_year = atoi(fields[8]);
+    manga->total_volumes = atoi(fields[9]);
+    int acquired = atoi(fields[10]);
+
+    // Parse da lista de volumes (até a quantidade informada; repetidos contam uma vez)
+    if (n == 12) {
+        char *volume_str = strtok_r(fields[11], "[], \t", &saveptr);
+        for (int i = 0; volume_str && i < acquired; i++) {
+            manga_add_volume(manga, atoi(volume_str));
+            volume_str = strtok_r(NULL, "[], \t", &saveptr);
+        }
+    }
+    manga->deleted = 0;
+
+    return 1;
+}
+
+// Conjunto de chaves de ISBN (endereçamento aberto) para detectar duplicatas durante a importação
+typedef struct {
+    uint64_t *keys;
+    int capacity;
+    int count;
+} IsbnSet;
+
+static unsigned long hash_isbn(uint64_t key) {
+    return (unsigned long)((key * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+static void isbn_set_init(IsbnSet *set, int capacity) {
+    set->capacity = 1024;
+    while (set->capacity < capacity * 2) {
+        set->capacity *= 2;
+    }
+    set->keys = calloc(set->capacity, sizeof(uint64_t));
+    set->count = 0;
+}
+
+// Inserir uma chave no conjunto; retorna 0 se já estava presente
+static int isbn_set_insert(IsbnSet *set, uint64_t key) {
+    if ((set->count + 1) * 2 > set->capacity) {
+        IsbnSet bigger;
+        isbn_set_init(&bigger, set->capacity);
+        for (int i = 0; i < set->capacity; i++) {
+            if (set->keys[i]) {
+                isbn_set_insert(&bigger, set->keys[i]);
+            }
+        }
+        free(set->keys);
+        *set = bigger;
+    }
+
+    unsigned long mask = set->capacity - 1;
+    unsigned long pos = hash_isbn(key) & mask;
+    while (set->keys[pos]) {
+        if (set->keys[pos] == key) {
+            return 0;
+        }
+        pos = (pos + 1) & mask;
+    }
+    set->keys[pos] = key;
+    set->count++;
+    return 1;
+}
+
+static int isbn_set_contains(const IsbnSet *set, uint64_t key) {
+    unsigned long mask = set->capacity - 1;
+    for (unsigned long pos = hash_isbn(key) & mask; set->keys[pos]; pos = (pos + 1) & mask) {
+        if (set->keys[pos] == key) return 1;
+    }
+    return 0;
+}
+
+// Trabalho de uma thread de parsing: interpreta as linhas [start, end) do lote
+typedef struct {
+    char (*lines)[IMPORT_LINE_SIZE];
+    Manga *mangas;
+    char (*keys)[MAX_TITLE];
+    uint64_t *isbn_keys;
+    int *valid;
+    int start;
+    int end;
+} ImportWorker;
+
+static void *import_worker(void *arg) {
+    ImportWorker *worker = arg;
+    for (int i = worker->start; i < worker->end; i++) {
+        worker->valid[i] = parse_manga_line(worker->lines[i], &worker->mangas[i]) &&
+                           isbn_key(worker->mangas[i].isbn, &worker->isbn_keys[i]) == 0;
+        if (worker->valid[i]) {
+            make_title_key(worker->mangas[i].title, worker->keys[i]);
+        }
+    }
+    return NULL;
+}
+
+// Número de threads de parsing (um por núcleo, limitado)
+static int import_thread_count() {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) cpus = 1;
+    if (cpus > IMPORT_MAX_THREADS) cpus = IMPORT_MAX_THREADS;
+    return (int)cpus;
+}
+
+static double elapsed_seconds(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// Coletar as entradas da árvore B+ (em ordem) em um vetor
+typedef struct {
+    PrimaryIndex *entries;
+    long count;
+} PrimaryCollector;
+
+static void collect_primary_entry(const PrimaryIndex *entry, void *context) {
+    PrimaryCollector *collector = context;
+    collector->entries[collector->count++] = *entry;
+}
+
+// Incorporar índices novos (já ordenados) à árvore B+. Lotes grandes reconstroem
+// a árvore de uma vez, intercalando com as entradas existentes; lotes pequenos
+// são inseridos um a um, alterando apenas as páginas afetadas
+static void merge_primary_indices(PrimaryIndex *new_entries, int new_count) {
+    long existing = primary_tree.header.entry_count;
+
+    if (new_count <= existing / 8) {
+        for (int i = 0; i < new_count; i++) {
+            btree_insert(new_entries[i].key, new_entries[i].offset);
+            primary_hash_put(new_entries[i].key, new_entries[i].offset);
+        }
+        primary_count = (int)primary_tree.header.entry_count;
+        return;
+    }
+
+    PrimaryCollector collector = { malloc((existing + 1) * sizeof(PrimaryIndex)), 0 };
+    btree_for_each(collect_primary_entry, &collector);
+
+    PrimaryIndex *merged = malloc((existing + new_count + 1) * sizeof(PrimaryIndex));
+    long i = 0, j = 0, k = 0;
+
+    while (i < collector.count && j < new_count) {
+        if (compare_primary(&collector.entries[i], &new_entries[j]) <= 0) {
+            merged[k++] = collector.entries[i++];
+        } else {
+            merged[k++] = new_entries[j++];
+        }
+    }
+    while (i < collector.count) merged[k++] = collector.entries[i++];
+    while (j < new_count) merged[k++] = new_entries[j++];
+    free(collector.entries);
+
+    btree_close();
+    if (btree_build("primary_index.dat", merged, k) != 0) {
+        printf("Erro ao salvar índices primários!\n");
+    }
+    free(merged);
+    load_primary_indices();
+}
+
+static void merge_secondary_indices(SecondaryIndex *new_entries, int new_count) {
+    SecondaryIndex *merged = malloc((secondary_count + new_count + 1) * sizeof(SecondaryIndex));
+    int j = 0, k = 0;
+
+    // O índice atual (base, runs e memtable) é percorrido já intercalado
+    SecondaryCursor cursor;
+    const SecondaryIndex *entry;
+    secondary_cursor_init(&cursor, NULL);
+    while ((entry = secondary_cursor_next(&cursor))) {
+        while (j < new_count && compare_secondary(&new_entries[j], entry) < 0) {
+            merged[k++] = new_entries[j++];
+        }
+        merged[k++] = *entry;
+    }
+    while (j < new_count) merged[k++] = new_entries[j++];
+
+    secondary_set_base(merged, k);
+
+    for (int n = 0; n < new_count; n++) {
+        trigram_add(new_entries[n].key, new_entries[n].isbn);
+    }
+}
+
+// Varredura de mangas.dat que alimenta os índices de atributos (RECORD_ATTRIBUTES)
+// ou os de anos e a projeção colunar (RECORD_YEARS); as duas partes não
+// compartilham estado e podem rodar em threads separadas
+enum {
+    RECORD_ATTRIBUTES = 1,
+    RECORD_YEARS = 2
+};
+
+typedef struct {
+    long offset;
+    int indices;
+} RecordScan;
+
+static void *record_scan(void *arg) {
+    RecordScan *scan = arg;
+    Manga manga;
+    long offset = scan->offset, record_offset = offset;
+
+    while (read_next_record(&offset, &manga) == 1) {
+        if (!manga.deleted && find_manga_by_isbn(manga.isbn) == record_offset) {
+            if (scan->indices & RECORD_ATTRIBUTES) {
+                attribute_add(&manga, record_offset);
+            }
+            if (scan->indices & RECORD_YEARS) {
+                year_append(&manga, record_offset);
+                int32_t total, acquired;
+                column_volumes(&manga, &total, &acquired);
+                column_set(record_offset, total, acquired, manga.publisher, manga.magazine);
+            }
+        }
+        record_offset = offset;
+    }
+    if (scan->indices & RECORD_YEARS) {
+        year_sort();
+    }
+    return NULL;
+}
+
+// Indexar atributos, anos e a projeção colunar dos registros ativos a partir de
+// offset até o fim do arquivo (só os registros para os quais o índice primário aponta).
+// Com mais de um núcleo, os atributos são indexados em uma segunda thread
+static void index_records_from(long offset) {
+    data_pool_flush();
+    map_file_remap(&data_map);
+    if (data_map.base) {
+        posix_madvise(data_map.base, data_map.size, POSIX_MADV_SEQUENTIAL);
+    }
+    RecordScan attributes = { offset, RECORD_ATTRIBUTES }, years = { offset, RECORD_YEARS };
+    pthread_t thread;
+    if (import_thread_count() > 1 && pthread_create(&thread, NULL, record_scan, &attributes) == 0) {
+        record_scan(&years);
+        pthread_join(thread, NULL);
+    } else {
+        years.indices |= RECORD_ATTRIBUTES;
+        record_scan(&years);
+    }
+    if (data_map.base) {
+        posix_madvise(data_map.base, data_map.size, POSIX_MADV_RANDOM);
+    }
+}
+
+// Reconstruir os índices de atributos e de anos e a projeção colunar a partir de mangas.dat
+void rebuild_record_indices() {
+    begin_unlogged_changes();
+    attribute_clear();
+    year_clear();
+    column_clear();
+    index_records_from(sizeof(DataHeader));
+    end_unlogged_changes();
+}
+
+// Importação em massa: lê o arquivo em lotes, interpreta as linhas em paralelo,
+// grava os registros com um único handle bufferizado e constrói os índices
+// com uma única ordenação + intercalação no final
+int bulk_import(const char *filename) {
+    FILE *file = io_fopen(filename, "r");
+    if (!file) {
+        printf("Arquivo %s não encontrado!\n", filename);
+        return -1;
+    }
+
+    FILE *data_file = io_fopen("mangas.dat", "r+b");
+    if (!data_file) {
+        printf("Erro ao abrir arquivo de dados!\n");
+        fclose(file);
+        return -1;
+    }
+    char *write_buffer = malloc(IMPORT_WRITE_BUFFER);
+    setvbuf(data_file, write_buffer, _IOFBF, IMPORT_WRITE_BUFFER);
+    fseek(data_file, 0, SEEK_END);
+    long offset = ftell(data_file);
+    long first_offset = offset;
+    unsigned char record[RECORD_MAX_SIZE];
+
+    char (*lines)[IMPORT_LINE_SIZE] = malloc(IMPORT_BATCH_LINES * sizeof(*lines));
+    Manga *mangas = malloc(IMPORT_BATCH_LINES * sizeof(Manga));
+    char (*keys)[MAX_TITLE] = malloc(IMPORT_BATCH_LINES * sizeof(*keys));
+    uint64_t *isbn_keys = malloc(IMPORT_BATCH_LINES * sizeof(uint64_t));
+    int *valid = malloc(IMPORT_BATCH_LINES * sizeof(int));
+
+    int thread_count = import_thread_count();
+    pthread_t threads[IMPORT_MAX_THREADS];
+    ImportWorker workers[IMPORT_MAX_THREADS];
+
+    int new_capacity = IMPORT_BATCH_LINES;
+    int new_count = 0;
+    PrimaryIndex *new_primary = malloc(new_capacity * sizeof(PrimaryIndex));
+    SecondaryIndex *new_secondary = malloc(new_capacity * sizeof(SecondaryIndex));
+
+    IsbnSet seen;
+    isbn_set_init(&seen, IMPORT_BATCH_LINES);
+
+    long total_lines = 0, skipped = 0;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (;;) {
+        // Ler um lote de linhas
+        int batch = 0;
+        while (batch < IMPORT_BATCH_LINES && fgets(lines[batch], IMPORT_LINE_SIZE, file)) {
+            batch++;
+        }
+        if (batch == 0) break;
+        total_lines += batch;
+
+        // Interpretar o lote em paralelo
+        int per_thread = (batch + thread_count - 1) / thread_count;
+        int started = 0;
+        for (int t = 0; t < thread_count; t++) {
+            workers[t].lines = lines;
+            workers[t].mangas = mangas;
+            workers[t].keys = keys;
+            workers[t].isbn_keys = isbn_keys;
+            workers[t].valid = valid;
+            workers[t].start = t * per_thread;
+            workers[t].end = workers[t].start + per_thread > batch ? batch : workers[t].start + per_thread;
+            if (workers[t].start >= workers[t].end) break;
+            if (pthread_create(&threads[t], NULL, import_worker, &workers[t]) != 0) {
+                import_worker(&workers[t]);
+                continue;
+            }
+            started = t + 1;
+        }
+        for (int t = 0; t < started; t++) {
+            pthread_join(threads[t], NULL);
+        }
+
+        // Gravar o lote na ordem do arquivo, descartando duplicatas
+        for (int i = 0; i < batch; i++) {
+            if (!valid[i]) {
+                skipped++;
+                continue;
+            }
+            if (primary_hash_find(isbn_keys[i]) != -1 || !isbn_set_insert(&seen, isbn_keys[i])) {
+                skipped++;
+                continue;
+            }
+
+            size_t record_size = encode_manga(&mangas[i], record);
+            io_fwrite(record, 1, record_size, data_file);
+
+            if (new_count == new_capacity) {
+                new_capacity *= 2;
+                new_primary = realloc(new_primary, new_capacity * sizeof(PrimaryIndex));
+                new_secondary = realloc(new_secondary, new_capacity * sizeof(SecondaryIndex));
+            }
+            new_primary[new_count].key = isbn_keys[i];
+            new_primary[new_count].offset = offset;
+            strcpy(new_secondary[new_count].title, mangas[i].title);
+            strcpy(new_secondary[new_count].key, keys[i]);
+            strcpy(new_secondary[new_count].isbn, mangas[i].isbn);
+            new_count++;
+
+            offset += record_size;
+        }
+    }
+
+    fclose(file);
+    fclose(data_file);
+    map_file_remap(&data_map);
+    data_pool_reset();
+    free(write_buffer);
+    free(lines);
+    free(mangas);
+    free(keys);
+    free(isbn_keys);
+    free(valid);
+    free(seen.keys);
+
+    // Construir os índices uma única vez
+    sort_array(new_primary, new_count, sizeof(PrimaryIndex), compare_primary);
+    sort_array(new_secondary, new_count, sizeof(SecondaryIndex), compare_secondary);
+    begin_unlogged_changes();
+    merge_primary_indices(new_primary, new_count);
+    merge_secondary_indices(new_secondary, new_count);
+    index_records_from(first_offset);
+    end_unlogged_changes();
+    free(new_primary);
+    free(new_secondary);
+
+    double seconds = elapsed_seconds(&start);
+    printf("Importação concluída: %d registros importados, %ld ignorados (%ld linhas) em %.2fs",
+           new_count, skipped, total_lines, seconds);
+    if (seconds > 0) {
+        printf(" - %.0f registros/s", new_count / seconds);
+    }
+    printf(" [%d threads]\n", thread_count);
+
+    return new_count;
+}
+
+// Evento de volumes de um arquivo (uma alteração de uma linha)
+typedef struct {
+    long offset;
+    long line;
+    VolumeChange change;
+} VolumeEvent;
+
+// Ordenar por offset do registro; eventos do mesmo registro ficam na ordem do arquivo
+static int compare_volume_events(const void *a, const void *b) {
+    const VolumeEvent *x = a, *y = b;
+    if (x->offset != y->offset) return x->offset < y->offset ? -1 : 1;
+    return x->line < y->line ? -1 : x->line > y->line;
+}
+
+// Aplicar um arquivo de eventos de volumes ("ISBN +5 -3 +10..12" por linha).
+// Os eventos são agrupados por registro e aplicados em ordem crescente de offset
+// em mangas.dat, com uma leitura e uma gravação parcial por registro
+// Retorna o número de linhas com erro, ou -1 se o arquivo não abrir
+int apply_volume_events(const char *filename) {
+    FILE *file = io_fopen(filename, "r");
+    if (!file) {
+        printf("Arquivo %s não encontrado!\n", filename);
+        return -1;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    VolumeEvent *events = NULL;
+    long count = 0, capacity = 0, line = 0, failed = 0;
+    char buffer[IMPORT_LINE_SIZE];
+    VolumeChange changes[MAX_VOLUME_CHANGES];
+    while (fgets(buffer, sizeof(buffer), file)) {
+        line++;
+        buffer[strcspn(buffer, "\r\n")] = '\0';
+        char *isbn = buffer;
+        while (isspace((unsigned char)*isbn)) isbn++;
+        if (*isbn == '\0' || *isbn == '#') continue;
+
+        char *list = isbn + strcspn(isbn, " \t;");
+        if (*list) *list++ = '\0';
+        while (isspace((unsigned char)*list) || *list == ';') list++;
+        int n = parse_volume_changes(list, changes, MAX_VOLUME_CHANGES);
+        if (n <= 0) {
+            printf("Linha %ld: alterações de volumes inválidas!\n", line);
+            failed++;
+            continue;
+        }
+        long offset = find_manga_by_isbn(isbn);
+        if (offset == -1) {
+            printf("Linha %ld: ISBN %s não encontrado!\n", line, isbn);
+            failed++;
+            continue;
+        }
+
+        if (count + n > capacity) {
+            capacity = capacity ? 2 * capacity : 1024;
+            if (capacity < count + n) capacity = count + n;
+            events = realloc(events, capacity * sizeof(VolumeEvent));
+        }
+        for (int i = 0; i < n; i++) {
+            events[count].offset = offset;
+            events[count].line = line;
+            events[count].change = changes[i];
+            count++;
+        }
+    }
+    fclose(file);
+
+    sort_array(events, count, sizeof(VolumeEvent), compare_volume_events);
+
+    VolumeChange *group = malloc((count > 0 ? count : 1) * sizeof(VolumeChange));
+    long records = 0;
+    for (long i = 0; i < count; ) {
+        long offset = events[i].offset;
+        int n = 0;
+        for (; i < count && events[i].offset == offset; i++) {
+            group[n++] = events[i].change;
+        }
+
+        uint64_t op_start = metrics_clock();
+        Manga manga;
+        if (read_record(offset, &manga) != 0 || manga.deleted ||
+            change_volumes(offset, &manga, group, n) != 0) {
+            printf("Erro ao gravar os volumes do registro em %ld!\n", offset);
+            failed++;
+            continue;
+        }
+        metrics_record(METRIC_VOLUMES, op_start);
+        records++;
+
+        // Cada mangá acrescenta ao log só a sua linha da projeção colunar: o log é
+        // confirmado a cada VOLUME_EVENTS_COMMIT mangás e o checkpoint (que grava os
+        // índices inteiros) espera o log passar de WAL_CHECKPOINT_BYTES
+        if (records % VOLUME_EVENTS_COMMIT == 0) {
+            wal_commit();
+            apply_pending_deletes();
+            pthread_mutex_lock(&index_wal.lock);
+            int due = index_wal.appended >= WAL_CHECKPOINT_BYTES;
+            pthread_mutex_unlock(&index_wal.lock);
+            if (due || btree_dirty_pages() >= BTREE_CACHE_PAGES) {
+                checkpoint_indices();
+            }
+        }
+    }
+    commit_index_changes();
+    free(group);
+    free(events);
+
+    double seconds = elapsed_seconds(&start);
+    printf("Eventos de volumes aplicados: %ld alterações em %ld mangás, %ld erros em %.2fs",
+           count, records, failed, seconds);
+    if (seconds > 0) {
+        printf(" - %.0f alterações/s", count / seconds);
+    }
+    printf("\n");
+    return (int)failed;
+}
+
+// ===================== RECONSTRUÇÃO PARALELA DOS ÍNDICES =====================
+//
+// A reconstrução a partir de mangas.dat divide o arquivo em uma faixa contínua de
+// registros por thread. Como os registros têm tamanho variável, as fronteiras
+// são encontradas por uma passada que só lê o cabeçalho de cada registro (tamanho
+// do espaço e flag de deletado) e conta os registros ativos de cada faixa. Cada
+// thread decodifica a sua faixa e grava as entradas primárias e secundárias na
+// sua parte de vetores compartilhados, sem travas; os vetores são então ordenados
+// com parallel_sort.
+
+// Fatia de uma ordenação paralela ou par de fatias a intercalar
+typedef struct {
+    const unsigned char *left;
+    size_t left_count;
+    const unsigned char *right;
+    size_t right_count;
+    unsigned char *out;
+    size_t size;
+    int (*compare)(const void *, const void *);
+} SortTask;
+
+static void *sort_task(void *arg) {
+    SortTask *task = arg;
+    sort_array(task->out, task->left_count, task->size, task->compare);
+    return NULL;
+}
+
+static void *merge_task(void *arg) {
+    SortTask *task = arg;
+    const unsigned char *left = task->left, *left_end = left + task->left_count * task->size;
+    const unsigned char *right = task->right, *right_end = right + task->right_count * task->size;
+    unsigned char *out = task->out;
+
+    while (left < left_end && right < right_end) {
+        if (task->compare(left, right) <= 0) {
+            memcpy(out, left, task->size);
+            left += task->size;
+        } else {
+            memcpy(out, right, task->size);
+            right += task->size;
+        }
+        out += task->size;
+    }
+    memcpy(out, left, left_end - left);
+    memcpy(out + (left_end - left), right, right_end - right);
+    return NULL;
+}
+
+// Executar as tarefas, uma por thread (na thread atual se não for possível criá-la)
+static void run_sort_tasks(void *(*function)(void *), SortTask *tasks, int count) {
+    pthread_t threads[IMPORT_MAX_THREADS];
+    int started[IMPORT_MAX_THREADS];
+    for (int i = 0; i < count; i++) {
+        started[i] = pthread_create(&threads[i], NULL, function, &tasks[i]) == 0;
+        if (!started[i]) function(&tasks[i]);
+    }
+    for (int i = 0; i < count; i++) {
+        if (started[i]) pthread_join(threads[i], NULL);
+    }
+}
+
+// Ordenar um vetor em paralelo: cada thread ordena uma fatia com qsort e as
+// fatias são intercaladas duas a duas, também em paralelo, até restar uma
+void parallel_sort(void *base, size_t count, size_t size, int (*compare)(const void *, const void *), int parts) {
+    if (parts > IMPORT_MAX_THREADS) parts = IMPORT_MAX_THREADS;
+    if (parts < 2 || count < (size_t)parts * 1024) {
+        sort_array(base, count, size, compare);
+        return;
+    }
+    unsigned char *buffer = malloc(count * size);
+    if (!buffer) {
+        sort_array(base, count, size, compare);
+        return;
+    }
+
+    SortTask tasks[IMPORT_MAX_THREADS];
+    size_t bounds[IMPORT_MAX_THREADS + 1];
+    for (int i = 0; i <= parts; i++) {
+        bounds[i] = count * i / parts;
+    }
+    for (int i = 0; i < parts; i++) {
+        tasks[i] = (SortTask){ NULL, bounds[i + 1] - bounds[i], NULL, 0, (unsigned char *)base + bounds[i] * size, size, compare };
+    }
+    run_sort_tasks(sort_task, tasks, parts);
+
+    unsigned char *from = base, *to = buffer;
+    while (parts > 1) {
+        int merged = 0;
+        for (int i = 0; i < parts; i += 2) {
+            size_t middle = bounds[i + 1];
+            size_t end = i + 1 < parts ? bounds[i + 2] : middle;
+            tasks[merged] = (SortTask){ from + bounds[i] * size, middle - bounds[i], from + middle * size, end - middle,
+                                        to + bounds[i] * size, size, compare };
+            bounds[merged++] = bounds[i];
+        }
+        bounds[merged] = count;
+        run_sort_tasks(merge_task, tasks, merged);
+        parts = merged;
+        unsigned char *swap = from;
+        from = to;
+        to = swap;
+    }
+    if (from != base) {
+        memcpy(base, from, count * size);
+    }
+    free(buffer);
+}
+
+// Faixa de mangas.dat indexada por uma thread
+typedef struct {
+    long start;            // primeiro registro da faixa
+    long end;              // fim da faixa (início do próximo registro)
+    long first;            // posição da faixa nos vetores compartilhados
+    long count;            // entradas gravadas
+    long error;            // registro que não pôde ser decodificado (-1 = nenhum)
+    PrimaryIndex *primary;
+    SecondaryIndex *secondary;
+} RebuildWorker;
+
+static void *rebuild_worker(void *arg) {
+    RebuildWorker *worker = arg;
+    Manga manga;
+    long offset = worker->start;
+
+    while (offset < worker->end) {
+        long record_offset = offset;
+        if (read_next_record(&offset, &manga) != 1) {
+            worker->error = record_offset;
+            break;
+        }
+        long i = worker->first + worker->count;
+        if (!manga.deleted && isbn_stored_key(manga.isbn, &worker->primary[i].key) == 0) {
+            worker->primary[i].offset = record_offset;
+            strcpy(worker->secondary[i].title, manga.title);
+            make_title_key(manga.title, worker->secondary[i].key);
+            strcpy(worker->secondary[i].isbn, manga.isbn);
+            worker->count++;
+        }
+    }
+    return NULL;
+}
+
+// Dividir [sizeof(DataHeader), fim) em até thread_count faixas de tamanho parecido,
+// lendo só o cabeçalho de cada registro. Retorna o número de faixas; em *corrupted
+// fica o offset do primeiro registro inválido (-1 = nenhum)
+static int rebuild_split(RebuildWorker *workers, int thread_count, long *active, long *corrupted) {
+    long offset = sizeof(DataHeader), size = (long)data_map.size;
+    long span = size > offset ? size - offset : 0;
+    int count = 0;
+
+    *active = 0;
+    *corrupted = -1;
+    workers[0].start = offset;
+    workers[0].first = 0;
+    while (offset < size) {
+        const unsigned char *record = data_record(offset);
+        if (!record) {
+            *corrupted = offset;
+            break;
+        }
+        // Começar a próxima faixa quando esta atingir a sua parte do arquivo
+        if (offset - (long)sizeof(DataHeader) >= span / thread_count * (count + 1) && count + 1 < thread_count) {
+            workers[count].end = offset;
+            count++;
+            workers[count].start = offset;
+            workers[count].first = *active;
+        }
+        if (!record[RECORD_DELETED_OFFSET]) {
+            (*active)++;
+        }
+        offset += get_u32(record);
+    }
+    workers[count].end = offset;
+    return count + 1;
+}
+
+// Se houver mais de um registro ativo com o mesmo ISBN (uma atualização que moveu
+// o registro e foi interrompida antes de marcar o antigo como deletado), manter o
+// mais recente, de maior offset. Retorna o novo número de entradas primárias
+static long rebuild_drop_duplicates(PrimaryIndex *primary, long count, SecondaryIndex *secondary, long *secondary_count) {
+    IsbnSet duplicates;
+    long kept = 0;
+    isbn_set_init(&duplicates, 16);
+
+    for (long i = 0; i < count; i++) {
+        if (kept > 0 && primary[kept - 1].key == primary[i].key) {
+            if (primary[i].offset > primary[kept - 1].offset) primary[kept - 1].offset = primary[i].offset;
+            isbn_set_insert(&duplicates, primary[i].key);
+        } else {
+            primary[kept++] = primary[i];
+        }
+    }
+
+    // Títulos dos registros descartados: só fica o título do registro mantido
+    if (duplicates.count > 0) {
+        long j = 0;
+        for (long i = 0; i < *secondary_count; i++) {
+            uint64_t key;
+            if (isbn_stored_key(secondary[i].isbn, &key) == 0 && isbn_set_contains(&duplicates, key)) {
+                PrimaryIndex probe = { key, 0 };
+                PrimaryIndex *entry = bsearch(&probe, primary, kept, sizeof(PrimaryIndex), compare_primary);
+                Manga manga;
+                if (!entry || read_record(entry->offset, &manga) != 0 || strcmp(manga.title, secondary[i].title) != 0 ||
+                    (j > 0 && compare_secondary(&secondary[j - 1], &secondary[i]) == 0)) {
+                    continue;
+                }
+            }
+            secondary[j++] = secondary[i];
+        }
+        *secondary_count = j;
+    }
+    free(duplicates.keys);
+    return kept;
+}
+
+static void *trigram_rebuild_worker(void *arg) {
+    (void)arg;
+    trigram_rebuild();
+    return NULL;
+}
+
+// Reconstruir todos os índices a partir de mangas.dat, lendo o arquivo em paralelo
+int rebuild_indices_from_data() {
+    int thread_count = import_thread_count();
+    RebuildWorker workers[IMPORT_MAX_THREADS];
+    pthread_t threads[IMPORT_MAX_THREADS];
+    long active, corrupted;
+
+    data_pool_flush();
+    map_file_remap(&data_map);
+    if (data_map.base) {
+        posix_madvise(data_map.base, data_map.size, POSIX_MADV_SEQUENTIAL);
+    }
+    int parts = rebuild_split(workers, thread_count, &active, &corrupted);
+    PrimaryIndex *primary = calloc(active + 1, sizeof(PrimaryIndex));
+    SecondaryIndex *secondary = calloc(active + 1, sizeof(SecondaryIndex));
+    if (!primary || !secondary) {
+        printf("Erro: memória insuficiente para reconstruir os índices!\n");
+        free(primary);
+        free(secondary);
+        return -1;
+    }
+
+    for (int t = 0; t < parts; t++) {
+        workers[t].count = 0;
+        workers[t].error = -1;
+        workers[t].primary = primary;
+        workers[t].secondary = secondary;
+    }
+    int started[IMPORT_MAX_THREADS];
+    for (int t = 0; t < parts; t++) {
+        started[t] = pthread_create(&threads[t], NULL, rebuild_worker, &workers[t]) == 0;
+        if (!started[t]) rebuild_worker(&workers[t]);
+    }
+    for (int t = 0; t < parts; t++) {
+        if (started[t]) pthread_join(threads[t], NULL);
+    }
+    if (data_map.base) {
+        posix_madvise(data_map.base, data_map.size, POSIX_MADV_RANDOM);
+    }
+
+    // Juntar as partes (registros com ISBN inválido deixam lacunas); um registro
+    // corrompido encerra a reconstrução nele, como em uma leitura sequencial
+    long count = 0;
+    for (int t = 0; t < parts; t++) {
+        memmove(&primary[count], &primary[workers[t].first], workers[t].count * sizeof(PrimaryIndex));
+        memmove(&secondary[count], &secondary[workers[t].first], workers[t].count * sizeof(SecondaryIndex));
+        count += workers[t].count;
+        if (workers[t].error != -1) {
+            corrupted = workers[t].error;
+            break;
+        }
     }
-    printf("\n");
+    if (corrupted != -1) {
+        printf("Aviso: registro corrompido no offset %ld; índices reconstruídos até esse ponto.\n", corrupted);
+    }
+
+    parallel_sort(primary, count, sizeof(PrimaryIndex), compare_primary, thread_count);
+    parallel_sort(secondary, count, sizeof(SecondaryIndex), compare_secondary, thread_count);
+    long secondary_total = count;
+    count = rebuild_drop_duplicates(primary, count, secondary, &secondary_total);
+
+    begin_unlogged_changes();
+    btree_close();
+    if (btree_build("primary_index.dat", primary, count) != 0) {
+        printf("Erro ao salvar índices primários!\n");
+    }
+    free(primary);
+    load_primary_indices();
+
+    // O índice de trigramas só lê o índice secundário e é montado em paralelo
+    // com a varredura dos atributos, anos e colunas
+    secondary_set_base(secondary, (int)secondary_total);
+    pthread_t trigram_thread;
+    int trigram_started = thread_count > 1 && pthread_create(&trigram_thread, NULL, trigram_rebuild_worker, NULL) == 0;
+    if (!trigram_started) {
+        trigram_rebuild();
+    }
+    attribute_clear();
+    year_clear();
+    column_clear();
+    index_records_from(sizeof(DataHeader));
+    if (trigram_started) {
+        pthread_join(trigram_thread, NULL);
+    }
+    end_unlogged_changes();
+
+    return (int)count;
 }
 
-// Criar novo registro de mangá
-void create_manga() {
+// Reconstruir os índices a pedido (menu ou --rebuild-indexes), informando o tempo
+int rebuild_indexes() {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int count = rebuild_indices_from_data();
+    if (count < 0) {
+        return -1;
+    }
+    printf("Reconstrução concluída: %d registros indexados em %.2fs [%d threads]\n",
+           count, elapsed_seconds(&start), import_thread_count());
+    return count;
+}
+
+// Converter mangas.dat do formato v1 (struct Manga de tamanho fixo) para o v2
+int migrate_data_file() {
+    if (check_data_file() != 1) {
+        printf("mangas.dat já está no formato atual (v%d).\n", DATA_VERSION);
+        return 0;
+    }
+
+    FILE *old_file = io_fopen("mangas.dat", "rb");
+    FILE *new_file = io_fopen("mangas.dat.tmp", "wb");
+    if (!old_file || !new_file) {
+        printf("Erro ao abrir arquivo de dados!\n");
+        if (old_file) fclose(old_file);
+        if (new_file) fclose(new_file);
+        return -1;
+    }
+
+    DataHeader header = { DATA_MAGIC, DATA_VERSION, sizeof(DataHeader), 0 };
+    io_fwrite(&header, sizeof(header), 1, new_file);
+
+    LegacyManga legacy;
     Manga manga;
-    
-    printf("\n=== CRIAR NOVO MANGÁ ===\n");
-    
-    printf("ISBN: ");
-    scanf("%s", manga.isbn);
-    
-    // Verificar se ISBN já existe
-    if (find_manga_by_isbn(manga.isbn) != -1) {
-        printf("Erro: ISBN já existe!\n");
-        return;
+    long converted = 0, dropped = 0;
+    long old_size = 0;
+    unsigned char buffer[RECORD_MAX_SIZE];
+
+    while (io_fread(&legacy, sizeof(LegacyManga), 1, old_file) == 1) {
+        old_size += sizeof(LegacyManga);
+        if (legacy.deleted) {
+            dropped++;
+            continue;
+        }
+
+        memset(&manga, 0, sizeof(manga));
+        copy_field(manga.isbn, legacy.isbn, ISBN_SIZE);
+        copy_field(manga.title, legacy.title, MAX_TITLE);
+        copy_field(manga.author, legacy.author, MAX_AUTHOR);
+        copy_field(manga.genre, legacy.genre, MAX_GENRE);
+        copy_field(manga.magazine, legacy.magazine, MAX_MAGAZINE);
+        copy_field(manga.publisher, legacy.publisher, MAX_PUBLISHER);
+        manga.start_year = legacy.start_year;
+        manga.end_year = legacy.end_year;
+        manga.edition_year = legacy.edition_year;
+        manga.total_volumes = legacy.total_volumes;
+        for (int i = 0; i < legacy.acquired_volumes && i < LEGACY_MAX_VOLUMES; i++) {
+            manga_add_volume(&manga, legacy.volumes_list[i]);
+        }
+
+        size_t size = encode_manga(&manga, buffer);
+        io_fwrite(buffer, 1, size, new_file);
+        converted++;
     }
-    
-    printf("Título: ");
-    getchar(); // Limpar buffer
-    fgets(manga.title, MAX_TITLE, stdin);
-    manga.title[strcspn(manga.title, "\n")] = 0; // Remover \n
-    
-    printf("Autor(es): ");
-    fgets(manga.author, MAX_AUTHOR, stdin);
-    manga.author[strcspn(manga.author, "\n")] = 0;
-    
-    printf("Ano de início: ");
-    scanf("%d", &manga.start_year);
-    
-    printf("Ano de fim (-1 se ainda em publicação): ");
-    scanf("%d", &manga.end_year);
-    
-    printf("Gênero: ");
-    getchar();
-    fgets(manga.genre, MAX_GENRE, stdin);
-    manga.genre[strcspn(manga.genre, "\n")] = 0;
-    
-    printf("Revista: ");
-    fgets(manga.magazine, MAX_MAGAZINE, stdin);
-    manga.magazine[strcspn(manga.magazine, "\n")] = 0;
-    
-    printf("Editora: ");
-    fgets(manga.publisher, MAX_PUBLISHER, stdin);
-    manga.publisher[strcspn(manga.publisher, "\n")] = 0;
-    
-    printf("Ano da edição: ");
-    scanf("%d", &manga.edition_year);
-    
-    printf("Quantidade total de volumes: ");
-    scanf("%d", &manga.total_volumes);
-    
-    printf("Quantidade de volumes adquiridos: ");
-    scanf("%d", &manga.acquired_volumes);
-    
-    printf("Digite os volumes adquiridos (separados por espaço): ");
-    for (int i = 0; i < manga.acquired_volumes; i++) {
-        scanf("%d", &manga.volumes_list[i]);
+
+    long new_size = ftell(new_file);
+    fclose(old_file);
+    if (fclose(new_file) != 0) {
+        printf("Erro ao gravar mangas.dat.tmp!\n");
+        return -1;
     }
-    
-    manga.deleted = 0;
-    
-    // Salvar no arquivo de dados
-    FILE *file = fopen("mangas.dat", "ab");
-    if (!file) {
+
+    // O arquivo antigo é preservado como cópia de segurança
+    if (rename("mangas.dat", "mangas.dat.v1") != 0 || rename("mangas.dat.tmp", "mangas.dat") != 0) {
+        printf("Erro ao substituir mangas.dat!\n");
+        return -1;
+    }
+    close_data_file();
+    if (open_data_file() != 0) {
         printf("Erro ao abrir arquivo de dados!\n");
-        return;
+        return -1;
     }
-    
-    long offset = ftell(file);
-    fwrite(&manga, sizeof(Manga), 1, file);
-    fclose(file);
-    
-    // Atualizar índices
-    add_primary_index(manga.isbn, offset);
-    add_secondary_index(manga.title, manga.isbn);
-    
-    save_primary_indices();
-    save_secondary_indices();
-    
-    printf("Mangá criado com sucesso!\n");
+
+    rebuild_indices_from_data();
+
+    printf("Migração concluída: %ld registros convertidos, %ld deletados descartados.\n", converted, dropped);
+    printf("Tamanho: %ld -> %ld bytes (cópia do original em mangas.dat.v1)\n", old_size, new_size);
+    return 0;
 }
 
-// Ler mangá por ISBN ou título
-void read_manga() {
-    char search[MAX_TITLE];
-    long offset;
-    char *isbn;
-    
-    printf("\n=== BUSCAR MANGÁ ===\n");
-    printf("Digite o ISBN ou título (pode ser parcial): ");
-    getchar();
-    fgets(search, MAX_TITLE, stdin);
-    search[strcspn(search, "\n")] = 0;
-    
-    // Tentar buscar por ISBN primeiro
-    offset = find_manga_by_isbn(search);
-    
-    // Se não encontrar, buscar por título
-    if (offset == -1) {
-        isbn = find_isbn_by_title(search);
-        if (isbn) {
-            offset = find_manga_by_isbn(isbn);
+// Concluir uma compactação interrompida. A troca de mangas.dat é o ponto de
+// confirmação: se a cópia compactada ainda existe, a troca não aconteceu e os
+// arquivos novos são descartados; senão, falta apenas instalar o índice novo
+void finish_interrupted_compaction() {
+    if (access("mangas.dat.compact", F_OK) == 0) {
+        unlink("mangas.dat.compact");
+        unlink("primary_index.dat.compact");
+    } else if (access("primary_index.dat.compact", F_OK) == 0) {
+        printf("Concluindo compactação interrompida...\n");
+        rename("primary_index.dat.compact", "primary_index.dat");
+    }
+}
+
+// Reescrever mangas.dat apenas com os registros ativos, sem espaços livres,
+// e trocar os offsets do índice primário pelos novos
+int compact_data_file() {
+    begin_unlogged_changes();
+
+    FILE *file = io_fopen("mangas.dat.compact", "wb");
+    if (!file) {
+        printf("Erro ao criar mangas.dat.compact!\n");
+        end_unlogged_changes();
+        return -1;
+    }
+    setvbuf(file, NULL, _IOFBF, IMPORT_WRITE_BUFFER);
+
+    DataHeader header = { DATA_MAGIC, DATA_VERSION, sizeof(DataHeader), 0 };
+    io_fwrite(&header, sizeof(header), 1, file);
+
+    long capacity = 1024, count = 0, removed = 0;
+    PrimaryIndex *entries = malloc(capacity * sizeof(PrimaryIndex));
+    long offset = sizeof(DataHeader), new_offset = sizeof(DataHeader);
+    long old_size = 0;
+    Manga manga;
+
+    data_pool_flush();
+    map_file_remap(&data_map);
+    old_size = data_map.size;
+    posix_madvise(data_map.base, data_map.size, POSIX_MADV_SEQUENTIAL);
+
+    const unsigned char *record;
+    while ((record = data_record(offset)) != NULL) {
+        uint32_t slot_size = get_u32(record);
+        uint16_t record_size = get_u16(record + 6);
+
+        // Só são mantidos os registros para os quais o índice aponta
+        if (!record[RECORD_DELETED_OFFSET] && decode_manga(record, record_size, &manga) == 0 &&
+            find_manga_by_isbn(manga.isbn) == offset) {
+            if (count == capacity) {
+                capacity *= 2;
+                entries = realloc(entries, capacity * sizeof(PrimaryIndex));
+            }
+            isbn_stored_key(manga.isbn, &entries[count].key);
+            entries[count].offset = new_offset;
+            count++;
+
+            unsigned char slot[4];
+            put_u32(slot, record_size);
+            io_fwrite(slot, 1, 4, file);
+            io_fwrite(record + 4, 1, record_size - 4, file);
+            new_offset += record_size;
+        } else {
+            removed++;
         }
+        offset += slot_size;
     }
-    
-    if (offset == -1) {
-        // Buscar múltiplos resultados para busca parcial
-        char results[10][ISBN_SIZE];
-        int count;
-        find_multiple_by_partial_title(search, results, &count, 10);
-        
-        if (count == 0) {
-            printf("Mangá não encontrado!\n");
-            return;
-        } else if (count == 1) {
-            offset = find_manga_by_isbn(results[0]);
+    posix_madvise(data_map.base, data_map.size, POSIX_MADV_RANDOM);
+
+    int failed = (size_t)offset != data_map.size;
+    if (failed) {
+        printf("Erro: registro corrompido no offset %ld; compactação cancelada.\n", offset);
+    }
+    failed |= fflush(file) != 0 || io_fsync(fileno(file)) != 0;
+    failed |= fclose(file) != 0;
+
+    sort_array(entries, count, sizeof(PrimaryIndex), compare_primary);
+    if (!failed && btree_build("primary_index.dat.compact", entries, count) != 0) {
+        failed = 1;
+    }
+    free(entries);
+
+    if (failed) {
+        unlink("mangas.dat.compact");
+        unlink("primary_index.dat.compact");
+        end_unlogged_changes();
+        return -1;
+    }
+
+    // A troca de mangas.dat confirma a compactação (ver finish_interrupted_compaction)
+    close_data_file();
+    btree_close();
+    if (rename("mangas.dat.compact", "mangas.dat") != 0) {
+        printf("Erro ao substituir mangas.dat!\n");
+        unlink("mangas.dat.compact");
+        unlink("primary_index.dat.compact");
+    } else {
+        sync_directory(".");
+        rename("primary_index.dat.compact", "primary_index.dat");
+        sync_directory(".");
+    }
+
+    if (open_data_file() != 0) {
+        printf("Erro ao abrir arquivo de dados!\n");
+        exit(1);
+    }
+    load_primary_indices();
+    free_list_reset();
+
+    // Os offsets mudaram: os índices de atributos e de anos e a projeção colunar são
+    // refeitos sobre o novo arquivo
+    attribute_clear();
+    year_clear();
+    column_clear();
+    index_records_from(sizeof(DataHeader));
+    end_unlogged_changes();
+
+    printf("Compactação concluída: %ld registros ativos, %ld removidos.\n", count, removed);
+    printf("Tamanho: %ld -> %ld bytes (%ld bytes recuperados)\n", old_size, new_offset, old_size - new_offset);
+    return 0;
+}
+
+// ===================== MODO EM LOTE =====================
+//
+// Lê um comando por linha (da entrada padrão ou de um arquivo) e escreve um
+// resultado JSON por linha na saída padrão:
+//
+//   get <isbn>
+//   search <título ou parte do título>          (os mais relevantes primeiro)
+//   next <cursor>                               (página seguinte de um search)
+//   fuzzy <título com erros de digitação>
+//   filter author=<autor>; publisher=<editora>; magazine=<revista>; genre=<gênero>
+//   put <registro no formato do mangas.txt>
+//   update <registro no formato do mangas.txt>   (substitui o mangá com o mesmo ISBN)
+//   delete <isbn>
+//
+// Linhas vazias e iniciadas por # são ignoradas. As alterações dos índices são
+// confirmadas a cada N operações (--commit-every) ou apenas no fim do lote.
+
+// Escrever uma string JSON (com aspas e escapes)
+void print_json_string(FILE *out, const char *str) {
+    fputc('"', out);
+    for (const unsigned char *p = (const unsigned char *)str; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fputc('\\', out);
+            fputc(*p, out);
+        } else if (*p < 0x20) {
+            fprintf(out, "\\u%04x", *p);
         } else {
-            printf("\nEncontrados %d mangás:\n", count);
-            for (int i = 0; i < count; i++) {
-                // Buscar e exibir título para cada resultado
-                for (int j = 0; j < secondary_count; j++) {
-                    if (strcmp(secondary_indices[j].isbn, results[i]) == 0) {
-                        printf("%d. %s (%s)\n", i+1, secondary_indices[j].title, results[i]);
-                        break;
-                    }
+            fputc(*p, out);
+        }
+    }
+    fputc('"', out);
+}
+
+void print_manga_json(FILE *out, const Manga *manga) {
+    fprintf(out, "{\"isbn\":");
+    print_json_string(out, manga->isbn);
+    fprintf(out, ",\"title\":");
+    print_json_string(out, manga->title);
+    fprintf(out, ",\"author\":");
+    print_json_string(out, manga->author);
+    fprintf(out, ",\"start_year\":%d,\"end_year\":%d,\"genre\":", manga->start_year, manga->end_year);
+    print_json_string(out, manga->genre);
+    fprintf(out, ",\"magazine\":");
+    print_json_string(out, manga->magazine);
+    fprintf(out, ",\"publisher\":");
+    print_json_string(out, manga->publisher);
+    fprintf(out, ",\"edition_year\":%d,\"total_volumes\":%d,\"volumes\":[",
+            manga->edition_year, manga->total_volumes);
+    for (int v = manga_next_volume(manga, 0), first = 1; v; v = manga_next_volume(manga, v), first = 0) {
+        fprintf(out, first ? "%d" : ",%d", v);
+    }
+    fprintf(out, "]}");
+}
+
+// Totais de um relatório de estatísticas (sem as chaves do objeto)
+static void print_totals_json(FILE *out, const ColumnTotals *totals) {
+    fprintf(out, "\"series\":%ld,\"volumes\":%ld,\"acquired\":%ld,\"missing\":%ld,\"complete\":%ld,\"completion\":%.4f",
+            totals->series, totals->volumes, totals->acquired, totals->missing, totals->complete,
+            totals->volumes > 0 ? (double)totals->acquired / totals->volumes : 0.0);
+}
+
+static void batch_status(FILE *out, long line, const char *op, const char *status) {
+    fprintf(out, "{\"line\":%ld,\"op\":\"%s\",\"status\":\"%s\"", line, op, status);
+}
+
+static const char *title_match_names[] = { "exact", "prefix", "word", "substring", "similar" };
+
+static int batch_error(FILE *out, long line, const char *op, const char *message) {
+    batch_status(out, line, op, "error");
+    fprintf(out, ",\"message\":");
+    print_json_string(out, message);
+    fprintf(out, "}\n");
+    return -1;
+}
+
+// Localizar um mangá ativo pelo ISBN; retorna o offset ou -1
+static long batch_lookup(const char *isbn, Manga *manga) {
+    long offset = find_manga_by_isbn(isbn);
+    if (offset == -1 || read_record(offset, manga) != 0 || manga->deleted) {
+        return -1;
+    }
+    return offset;
+}
+
+// Executar um comando; retorna 0 se deu certo, 1 se não encontrou e -1 em erro
+// *changed indica se o comando alterou o catálogo
+static int batch_command(FILE *out, long line, char *command, int *changed) {
+    char *argument = command + strcspn(command, " \t");
+    if (*argument) {
+        *argument++ = '\0';
+        while (isspace((unsigned char)*argument)) argument++;
+    }
+
+    Manga manga, current;
+    *changed = 0;
+
+    if (strcmp(command, "get") == 0) {
+        char isbn[ISBN_SIZE];
+        copy_field(isbn, argument, ISBN_SIZE);
+        if (batch_lookup(isbn, &manga) == -1) {
+            batch_status(out, line, command, "not_found");
+            fprintf(out, "}\n");
+            return 1;
+        }
+        batch_status(out, line, command, "ok");
+        fprintf(out, ",\"manga\":");
+        print_manga_json(out, &manga);
+        fprintf(out, "}\n");
+        return 0;
+    }
+
+    if (strcmp(command, "search") == 0 || strcmp(command, "next") == 0) {
+        TitleCursor cursor;
+        TitleHit hits[BATCH_MAX_RESULTS];
+        if (command[0] == 's') {
+            title_cursor_init(&cursor, argument);
+        } else if (title_cursor_parse(argument, &cursor) != 0) {
+            return batch_error(out, line, command, "cursor inválido (use o campo next de uma busca anterior)");
+        }
+        int count = search_titles(&cursor, hits, BATCH_MAX_RESULTS);
+
+        batch_status(out, line, command, count > 0 ? "ok" : "not_found");
+        fprintf(out, ",\"results\":[");
+        for (int i = 0; i < count; i++) {
+            fprintf(out, i ? ",{\"isbn\":" : "{\"isbn\":");
+            print_json_string(out, hits[i].isbn);
+            fprintf(out, ",\"title\":");
+            print_json_string(out, hits[i].title);
+            fprintf(out, ",\"match\":\"%s\"}", title_match_names[hits[i].match]);
+        }
+        fprintf(out, "],\"count\":%d,\"total\":%ld", count, cursor.total);
+        if (cursor.remaining > 0) {
+            char next[TITLE_CURSOR_SIZE];
+            title_cursor_format(&cursor, next);
+            fprintf(out, ",\"remaining\":%ld,\"next\":\"%s\"", cursor.remaining, next);
+        }
+        fprintf(out, "}\n");
+        return count > 0 ? 0 : 1;
+    }
+
+    if (strcmp(command, "fuzzy") == 0) {
+        TitleHit hits[BATCH_MAX_RESULTS];
+        int count = find_similar_titles(argument, hits, BATCH_MAX_RESULTS);
+
+        batch_status(out, line, command, count > 0 ? "ok" : "not_found");
+        fprintf(out, ",\"results\":[");
+        for (int i = 0; i < count; i++) {
+            fprintf(out, i ? ",{\"isbn\":" : "{\"isbn\":");
+            print_json_string(out, hits[i].isbn);
+            fprintf(out, ",\"title\":");
+            print_json_string(out, hits[i].title);
+            fprintf(out, ",\"distance\":%d}", hits[i].distance);
+        }
+        fprintf(out, "],\"count\":%d}\n", count);
+        return count > 0 ? 0 : 1;
+    }
+
+    if (strcmp(command, "filter") == 0) {
+        AttributeTerms terms;
+        YearRange ranges[YEAR_FIELDS * 2];
+        int range_count = 0;
+        terms.count = 0;
+        for (char *part = argument; *part; ) {
+            char *next = part + strcspn(part, ";");
+            if (*next) *next++ = '\0';
+            char *value = strchr(part, '=');
+            if (value) *value++ = '\0';
+
+            char name[MAX_GENRE];
+            copy_field(name, part, sizeof(name));
+            int field = attribute_field(name);
+            int year = year_field(name);
+            if (value && year >= 0 && range_count < YEAR_FIELDS * 2) {
+                if (parse_year_range(value, year, &ranges[range_count]) != 0) {
+                    return batch_error(out, line, command, "faixa de anos inválida (use ano, inicio..fim, inicio.. ou ..fim)");
                 }
+                range_count++;
+            } else if (!value || field < 0) {
+                return batch_error(out, line, command, "filtro inválido (use campo=valor; campos: author, publisher, magazine, genre, start_year, end_year, edition_year)");
+            } else {
+                attribute_terms_split(&terms, field, value);
             }
-            
-            int choice;
-            printf("Escolha um mangá (1-%d): ", count);
-            scanf("%d", &choice);
-            
-            if (choice < 1 || choice > count) {
-                printf("Opção inválida!\n");
-                return;
+            part = next;
+        }
+        if (terms.count == 0 && range_count == 0) {
+            return batch_error(out, line, command, "nenhum filtro informado");
+        }
+
+        long offsets[BATCH_MAX_RESULTS];
+        long total = filter_query(&terms, ranges, range_count, offsets, BATCH_MAX_RESULTS);
+        int found = 0;
+        batch_status(out, line, command, total > 0 ? "ok" : "not_found");
+        fprintf(out, ",\"results\":[");
+        for (long i = 0; i < total && i < BATCH_MAX_RESULTS; i++) {
+            if (read_record(offsets[i], &manga) != 0 || manga.deleted) continue;
+            fprintf(out, found++ ? ",{\"isbn\":" : "{\"isbn\":");
+            print_json_string(out, manga.isbn);
+            fprintf(out, ",\"title\":");
+            print_json_string(out, manga.title);
+            fprintf(out, "}");
+        }
+        fprintf(out, "],\"count\":%d,\"total\":%ld}\n", found, total);
+        return total > 0 ? 0 : 1;
+    }
+
+    if (strcmp(command, "stats") == 0) {
+        char name[MAX_GENRE];
+        copy_field(name, argument, sizeof(name));
+        int group = column_group(name);
+
+        if (name[0] == '\0') {
+            ColumnTotals totals;
+            column_totals(&totals);
+            batch_status(out, line, command, "ok");
+            fprintf(out, ",");
+            print_totals_json(out, &totals);
+            fprintf(out, "}\n");
+            return 0;
+        }
+
+        if (group >= 0) {
+            uint32_t count;
+            ColumnGroup *groups = column_group_totals(group, &count);
+            batch_status(out, line, command, "ok");
+            fprintf(out, ",\"groups\":[");
+            for (uint32_t i = 0; i < count; i++) {
+                fprintf(out, i ? ",{\"name\":" : "{\"name\":");
+                print_json_string(out, column_store.dictionaries[group].values[groups[i].code]);
+                fprintf(out, ",");
+                print_totals_json(out, &groups[i].totals);
+                fprintf(out, "}");
             }
-            
-            offset = find_manga_by_isbn(results[choice-1]);
+            fprintf(out, "],\"count\":%u}\n", count);
+            free(groups);
+            return 0;
+        }
+
+        if (strcmp(name, "cache") == 0) {
+            long hits, misses, evictions;
+            int entries;
+            title_cache_stats(&hits, &misses, &evictions, &entries);
+            batch_status(out, line, command, "ok");
+            fprintf(out, ",\"hits\":%ld,\"misses\":%ld,\"hit_rate\":%.4f,\"entries\":%d,\"capacity\":%d,"
+                    "\"evictions\":%ld,\"generation\":%llu}\n", hits, misses,
+                    hits + misses > 0 ? (double)hits / (hits + misses) : 0.0, entries, TITLE_CACHE_SIZE,
+                    evictions, (unsigned long long)catalog_generation);
+            return 0;
+        }
+
+        if (strcmp(name, "pool") == 0) {
+            long hits, misses, evictions, writebacks;
+            int pages, dirty;
+            data_pool_stats(&hits, &misses, &evictions, &writebacks, &pages, &dirty);
+            batch_status(out, line, command, "ok");
+            fprintf(out, ",\"hits\":%ld,\"misses\":%ld,\"hit_rate\":%.4f,\"pages\":%d,\"capacity\":%d,"
+                    "\"dirty\":%d,\"evictions\":%ld,\"writebacks\":%ld}\n", hits, misses,
+                    hits + misses > 0 ? (double)hits / (hits + misses) : 0.0, pages, data_pool.capacity,
+                    dirty, evictions, writebacks);
+            return 0;
         }
+
+        if (strcmp(name, "metrics") == 0) {
+            batch_status(out, line, command, "ok");
+            fprintf(out, ",");
+            metrics_print_json(out);
+            fprintf(out, "}\n");
+            return 0;
+        }
+
+        if (strcmp(name, "missing") == 0) {
+            long offsets[BATCH_MAX_RESULTS];
+            int32_t missing[BATCH_MAX_RESULTS];
+            int count = column_top_missing(offsets, missing, BATCH_MAX_RESULTS);
+            int found = 0;
+            batch_status(out, line, command, "ok");
+            fprintf(out, ",\"results\":[");
+            for (int i = 0; i < count; i++) {
+                if (read_record(offsets[i], &manga) != 0 || manga.deleted) continue;
+                fprintf(out, found++ ? ",{\"isbn\":" : "{\"isbn\":");
+                print_json_string(out, manga.isbn);
+                fprintf(out, ",\"title\":");
+                print_json_string(out, manga.title);
+                fprintf(out, ",\"total_volumes\":%d,\"acquired_volumes\":%d,\"missing\":%d}",
+                        manga.total_volumes, manga.acquired_volumes, missing[i]);
+            }
+            fprintf(out, "],\"count\":%d}\n", found);
+            return 0;
+        }
+        return batch_error(out, line, command, "relatório inválido (use stats, stats publisher, stats magazine, stats missing, stats cache, stats pool ou stats metrics)");
     }
-    
-    if (offset == -1) {
-        printf("Erro ao localizar mangá!\n");
-        return;
+
+    if (strcmp(command, "put") == 0 || strcmp(command, "update") == 0) {
+        if (!parse_manga_line(argument, &manga)) {
+            return batch_error(out, line, command, "registro inválido");
+        }
+
+        long offset = batch_lookup(manga.isbn, &current);
+        if (command[0] == 'p') {
+            uint64_t key;
+            if (isbn_key(manga.isbn, &key) != 0) {
+                return batch_error(out, line, command, "ISBN inválido");
+            }
+            if (offset != -1) {
+                return batch_error(out, line, command, "ISBN já existe");
+            }
+            if (insert_manga(&manga) != 0) {
+                return batch_error(out, line, command, "erro ao gravar no arquivo de dados");
+            }
+        } else {
+            if (offset == -1) {
+                batch_status(out, line, command, "not_found");
+                fprintf(out, "}\n");
+                return 1;
+            }
+            // O ISBN pode ter sido digitado com outra formatação; fica o cadastrado
+            strcpy(manga.isbn, current.isbn);
+            if (save_manga(offset, &manga, &current) != 0) {
+                return batch_error(out, line, command, "erro ao gravar no arquivo de dados");
+            }
+        }
+        *changed = 1;
+        batch_status(out, line, command, "ok");
+        fprintf(out, ",\"isbn\":");
+        print_json_string(out, manga.isbn);
+        fprintf(out, "}\n");
+        return 0;
     }
-    
-    // Ler do arquivo
-    FILE *file = fopen("mangas.dat", "rb");
-    if (!file) {
-        printf("Erro ao abrir arquivo de dados!\n");
-        return;
+
+    if (strcmp(command, "delete") == 0) {
+        char isbn[ISBN_SIZE];
+        copy_field(isbn, argument, ISBN_SIZE);
+        long offset = batch_lookup(isbn, &manga);
+        if (offset == -1) {
+            batch_status(out, line, command, "not_found");
+            fprintf(out, "}\n");
+            return 1;
+        }
+        remove_manga(offset, &manga);
+        *changed = 1;
+        batch_status(out, line, command, "ok");
+        fprintf(out, "}\n");
+        return 0;
+    }
+
+    if (strcmp(command, "volumes") == 0) {
+        char isbn[ISBN_SIZE];
+        VolumeChange changes[MAX_VOLUME_CHANGES];
+        char *list = argument + strcspn(argument, " \t");
+        if (*list) *list++ = '\0';
+        copy_field(isbn, argument, ISBN_SIZE);
+        int count = parse_volume_changes(list, changes, MAX_VOLUME_CHANGES);
+        if (count <= 0) {
+            return batch_error(out, line, command, "alterações de volumes inválidas (use +N, -N, +N..M ou -N..M)");
+        }
+        long offset = batch_lookup(isbn, &manga);
+        if (offset == -1) {
+            batch_status(out, line, command, "not_found");
+            fprintf(out, "}\n");
+            return 1;
+        }
+        if (change_volumes(offset, &manga, changes, count) != 0) {
+            return batch_error(out, line, command, "erro ao gravar no arquivo de dados");
+        }
+        *changed = 1;
+        batch_status(out, line, command, "ok");
+        fprintf(out, ",\"isbn\":");
+        print_json_string(out, manga.isbn);
+        fprintf(out, ",\"acquired_volumes\":%d,\"volumes\":[", manga.acquired_volumes);
+        for (int v = manga_next_volume(&manga, 0), first = 1; v; v = manga_next_volume(&manga, v), first = 0) {
+            fprintf(out, first ? "%d" : ",%d", v);
+        }
+        fprintf(out, "]}\n");
+        return 0;
+    }
+
+    return batch_error(out, line, command, "comando desconhecido");
+}
+
+// Executar um comando registrando sua latência (o nome do comando fica em command)
+static int batch_execute(FILE *out, long line, char *command, int *changed) {
+    uint64_t start = metrics_clock();
+    int result = batch_command(out, line, command, changed);
+    metrics_record_command(command, start);
+    return result;
+}
+
+// Executar os comandos de filename ("-" = entrada padrão), escrevendo os resultados
+// em out; retorna o número de erros
+int run_batch(const char *filename, long commit_every, FILE *out) {
+    FILE *in = strcmp(filename, "-") == 0 ? stdin : io_fopen(filename, "r");
+    if (!in) {
+        fprintf(stderr, "Erro ao abrir o arquivo %s!\n", filename);
+        return -1;
+    }
+
+    char buffer[IMPORT_LINE_SIZE];
+    long line = 0, executed = 0, failed = 0, pending = 0;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while (fgets(buffer, sizeof(buffer), in)) {
+        line++;
+        buffer[strcspn(buffer, "\r\n")] = '\0';
+
+        char *command = buffer;
+        while (isspace((unsigned char)*command)) command++;
+        if (*command == '\0' || *command == '#') continue;
+
+        int changed;
+        if (batch_execute(out, line, command, &changed) < 0) {
+            failed++;
+        }
+        executed++;
+
+        if (changed && commit_every > 0 && ++pending >= commit_every) {
+            commit_index_changes();
+            pending = 0;
+        }
+    }
+
+    if (in != stdin) {
+        fclose(in);
     }
-    
-    Manga manga;
-    fseek(file, offset, SEEK_SET);
-    fread(&manga, sizeof(Manga), 1, file);
-    fclose(file);
-    
-    if (manga.deleted) {
-        printf("Mangá foi deletado!\n");
-        return;
+    fflush(out);
+
+    // Os índices são confirmados no checkpoint final (close_indices)
+    double seconds = elapsed_seconds(&start);
+    fprintf(stderr, "Lote concluído: %ld comandos, %ld erros em %.2fs", executed, failed, seconds);
+    if (seconds > 0) {
+        fprintf(stderr, " - %.0f comandos/s", executed / seconds);
     }
-    
-    display_manga(&manga);
+    fprintf(stderr, "\n");
+    return (int)failed;
 }
 
-// Atualizar mangá
-void update_manga() {
-    char search[MAX_TITLE];
-    long offset;
-    char *isbn;
-    
-    printf("\n=== ATUALIZAR MANGÁ ===\n");
-    printf("Digite o ISBN ou título do mangá a ser atualizado: ");
-    getchar();
-    fgets(search, MAX_TITLE, stdin);
-    search[strcspn(search, "\n")] = 0;
-    
-    // Buscar mangá
-    offset = find_manga_by_isbn(search);
-    if (offset == -1) {
-        isbn = find_isbn_by_title(search);
-        if (isbn) {
-            offset = find_manga_by_isbn(isbn);
+// ===================== MODO SERVIDOR =====================
+//
+// Atende os comandos do modo em lote em um socket Unix local: cada conexão envia
+// um comando por linha e recebe um resultado JSON por linha ("quit" encerra a
+// conexão). Uma thread aceita as conexões e as entrega a um grupo fixo de workers.
+//
+// Consultas (get/search/filter) rodam em paralelo sob a trava de leitura do catálogo;
+// alterações são serializadas sob a trava de escrita. A confirmação no log de
+// índices acontece depois de liberar a trava, para que o group commit junte as
+// confirmações de clientes diferentes em uma única sincronização. A resposta só
+// é enviada depois da confirmação.
+
+typedef struct {
+    int listen_fd;
+    int queue[SERVER_QUEUE_SIZE];  // conexões aceitas aguardando um worker
+    int head;
+    int count;
+    int clients[SERVER_MAX_THREADS]; // conexão atendida por cada worker (-1 = nenhuma)
+    int stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} Server;
+
+static Server server = {
+    .listen_fd = -1,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .not_empty = PTHREAD_COND_INITIALIZER,
+    .not_full = PTHREAD_COND_INITIALIZER
+};
+static pthread_rwlock_t catalog_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+// Verificar se o comando apenas consulta o catálogo
+static int server_read_only(const char *command) {
+    size_t len = strcspn(command, " \t");
+    return (len == 3 && strncmp(command, "get", 3) == 0) ||
+           (len == 6 && strncmp(command, "search", 6) == 0) ||
+           (len == 4 && strncmp(command, "next", 4) == 0) ||
+           (len == 5 && strncmp(command, "fuzzy", 5) == 0) ||
+           (len == 6 && strncmp(command, "filter", 6) == 0) ||
+           (len == 5 && strncmp(command, "stats", 5) == 0);
+}
+
+// Confirmar as alterações de um comando; due indica que o log já cresceu demais e
+// pending que há registros removidos ou movidos a marcar (ambos verificados pelo
+// escritor ainda com a trava): o checkpoint e a marcação voltam a pegar a trava
+static void server_commit(int due, int pending) {
+    wal_commit();
+    if (due || pending) {
+        pthread_rwlock_wrlock(&catalog_lock);
+        apply_pending_deletes();
+        if (due && checkpoint_due()) {
+            checkpoint_indices();
         }
+        pthread_rwlock_unlock(&catalog_lock);
     }
-    
-    if (offset == -1) {
-        printf("Mangá não encontrado!\n");
-        return;
-    }
-    
-    // Ler mangá atual
-    FILE *file = fopen("mangas.dat", "r+b");
-    if (!file) {
-        printf("Erro ao abrir arquivo de dados!\n");
-        return;
+}
+
+static int send_all(int fd, const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+        if (sent <= 0) return -1;
+        data += sent;
+        size -= (size_t)sent;
     }
-    
-    Manga manga;
-    fseek(file, offset, SEEK_SET);
-    fread(&manga, sizeof(Manga), 1, file);
-    
-    if (manga.deleted) {
-        printf("Mangá foi deletado!\n");
-        fclose(file);
+    return 0;
+}
+
+// Atender uma conexão até o cliente fechar ou enviar "quit"
+static void server_session(int fd) {
+    FILE *in = fdopen(fd, "r");
+    char *response = NULL;
+    size_t response_size = 0;
+    FILE *out = open_memstream(&response, &response_size);
+    if (!in || !out) {
+        if (in) fclose(in); else close(fd);
+        if (out) fclose(out);
+        free(response);
         return;
     }
-    
-    char old_title[MAX_TITLE];
-    strcpy(old_title, manga.title);
-    
-    // Atualizar campos
-    printf("Título atual: %s\n", manga.title);
-    printf("Novo título (Enter para manter): ");
-    char new_title[MAX_TITLE];
-    fgets(new_title, MAX_TITLE, stdin);
-    if (strlen(new_title) > 1) {
-        new_title[strcspn(new_title, "\n")] = 0;
-        strcpy(manga.title, new_title);
-    }
-    
-    printf("Volumes adquiridos atual: %d\n", manga.acquired_volumes);
-    printf("Novos volumes adquiridos (-1 para manter): ");
-    int new_acquired;
-    scanf("%d", &new_acquired);
-    if (new_acquired != -1) {
-        manga.acquired_volumes = new_acquired;
-        printf("Digite os novos volumes adquiridos: ");
-        for (int i = 0; i < manga.acquired_volumes; i++) {
-            scanf("%d", &manga.volumes_list[i]);
+
+    char buffer[IMPORT_LINE_SIZE];
+    long line = 0;
+    while (fgets(buffer, sizeof(buffer), in)) {
+        line++;
+        buffer[strcspn(buffer, "\r\n")] = '\0';
+
+        char *command = buffer;
+        while (isspace((unsigned char)*command)) command++;
+        if (*command == '\0' || *command == '#') continue;
+        if (strcmp(command, "quit") == 0) break;
+
+        // A resposta é montada em memória para não enviar com a trava presa
+        rewind(out);
+        int changed, due = 0, pending = 0;
+        if (server_read_only(command)) {
+            pthread_rwlock_rdlock(&catalog_lock);
+            batch_execute(out, line, command, &changed);
+        } else {
+            pthread_rwlock_wrlock(&catalog_lock);
+            batch_execute(out, line, command, &changed);
+            due = changed && checkpoint_due();
+            pending = pending_deletes.count > 0;
+        }
+        pthread_rwlock_unlock(&catalog_lock);
+        fflush(out);
+
+        if (changed) {
+            server_commit(due, pending);
         }
+        if (send_all(fd, response, response_size) != 0) break;
     }
-    
-    // Salvar alterações
-    fseek(file, offset, SEEK_SET);
-    fwrite(&manga, sizeof(Manga), 1, file);
-    fclose(file);
-    
-    // Atualizar índice secundário se título mudou
-    if (strcmp(old_title, manga.title) != 0) {
-        remove_secondary_index(old_title);
-        add_secondary_index(manga.title, manga.isbn);
-        save_secondary_indices();
+
+    fclose(out);
+    free(response);
+    fclose(in);
+}
+
+static void *server_worker(void *arg) {
+    int id = (int)(intptr_t)arg;
+
+    for (;;) {
+        pthread_mutex_lock(&server.lock);
+        while (server.count == 0 && !server.stopping) {
+            pthread_cond_wait(&server.not_empty, &server.lock);
+        }
+        if (server.stopping) {
+            // Conexões ainda na fila são fechadas sem atendimento
+            while (server.count > 0) {
+                close(server.queue[server.head]);
+                server.head = (server.head + 1) % SERVER_QUEUE_SIZE;
+                server.count--;
+            }
+            pthread_mutex_unlock(&server.lock);
+            return NULL;
+        }
+        int fd = server.queue[server.head];
+        server.head = (server.head + 1) % SERVER_QUEUE_SIZE;
+        server.count--;
+        server.clients[id] = fd;
+        pthread_cond_signal(&server.not_full);
+        pthread_mutex_unlock(&server.lock);
+
+        server_session(fd);
+
+        pthread_mutex_lock(&server.lock);
+        server.clients[id] = -1;
+        pthread_mutex_unlock(&server.lock);
     }
-    
-    printf("Mangá atualizado com sucesso!\n");
 }
 
-// Deletar mangá
-void delete_manga() {
-    char search[MAX_TITLE];
-    long offset;
-    char *isbn;
-    char confirm;
-    
-    printf("\n=== DELETAR MANGÁ ===\n");
-    printf("Digite o ISBN ou título do mangá a ser deletado: ");
-    getchar();
-    fgets(search, MAX_TITLE, stdin);
-    search[strcspn(search, "\n")] = 0;
-    
-    // Buscar mangá
-    offset = find_manga_by_isbn(search);
-    if (offset == -1) {
-        isbn = find_isbn_by_title(search);
-        if (isbn) {
-            offset = find_manga_by_isbn(isbn);
+static void *server_acceptor(void *arg) {
+    (void)arg;
+
+    for (;;) {
+        int fd = accept(server.listen_fd, NULL, NULL);
+        if (fd < 0) {
+            pthread_mutex_lock(&server.lock);
+            int stopping = server.stopping;
+            pthread_mutex_unlock(&server.lock);
+            if (stopping) return NULL;
+            continue;
         }
+
+        pthread_mutex_lock(&server.lock);
+        while (server.count == SERVER_QUEUE_SIZE && !server.stopping) {
+            pthread_cond_wait(&server.not_full, &server.lock);
+        }
+        if (server.stopping) {
+            pthread_mutex_unlock(&server.lock);
+            close(fd);
+            return NULL;
+        }
+        server.queue[(server.head + server.count) % SERVER_QUEUE_SIZE] = fd;
+        server.count++;
+        pthread_cond_signal(&server.not_empty);
+        pthread_mutex_unlock(&server.lock);
     }
-    
-    if (offset == -1) {
-        printf("Mangá não encontrado!\n");
-        return;
+}
+
+// Atender conexões em socket_path até receber SIGINT ou SIGTERM
+// threads = 0 usa um worker por núcleo (no mínimo 4); retorna 0 ao encerrar normalmente
+int run_server(const char *socket_path, int threads) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        printf("Erro: caminho do socket muito longo!\n");
+        return -1;
     }
-    
-    // Ler mangá
-    FILE *file = fopen("mangas.dat", "r+b");
-    if (!file) {
-        printf("Erro ao abrir arquivo de dados!\n");
-        return;
+    strcpy(address.sun_path, socket_path);
+
+    // Cada worker atende uma conexão por vez, então há um mínimo mesmo com poucos núcleos
+    if (threads <= 0) threads = import_thread_count() < 4 ? 4 : import_thread_count();
+    if (threads > SERVER_MAX_THREADS) threads = SERVER_MAX_THREADS;
+
+    // Um socket deixado por uma execução anterior impediria o bind
+    unlink(socket_path);
+    server.listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server.listen_fd < 0 ||
+        bind(server.listen_fd, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(server.listen_fd, SERVER_QUEUE_SIZE) != 0) {
+        printf("Erro ao abrir o socket %s!\n", socket_path);
+        if (server.listen_fd >= 0) close(server.listen_fd);
+        return -1;
     }
-    
-    Manga manga;
-    fseek(file, offset, SEEK_SET);
-    fread(&manga, sizeof(Manga), 1, file);
-    
-    if (manga.deleted) {
-        printf("Mangá já foi deletado!\n");
-        fclose(file);
-        return;
+
+    // Os sinais de término são tratados apenas pela thread principal (sigwait)
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    pthread_t acceptor;
+    pthread_t workers[SERVER_MAX_THREADS];
+    for (int i = 0; i < SERVER_MAX_THREADS; i++) {
+        server.clients[i] = -1;
     }
-    
-    // Confirmação
-    printf("Deseja realmente deletar o mangá '%s'? (s/N): ", manga.title);
-    scanf(" %c", &confirm);
-    
-    if (confirm == 's' || confirm == 'S') {
-        // Marcar como deletado
-        manga.deleted = 1;
-        fseek(file, offset, SEEK_SET);
-        fwrite(&manga, sizeof(Manga), 1, file);
-        
-        // Remover dos índices
-        remove_primary_index(manga.isbn);
-        remove_secondary_index(manga.title);
-        
-        save_primary_indices();
-        save_secondary_indices();
-        
-        printf("Mangá deletado com sucesso!\n");
-    } else {
-        printf("Operação cancelada.\n");
+    for (int i = 0; i < threads; i++) {
+        pthread_create(&workers[i], NULL, server_worker, (void*)(intptr_t)i);
     }
-    
-    fclose(file);
-}
+    pthread_create(&acceptor, NULL, server_acceptor, NULL);
 
-// Listar todos os mangás
-void list_all_mangas() {
-    printf("\n=== LISTA DE MANGÁS ===\n");
-    
-    FILE *file = fopen("mangas.dat", "rb");
-    if (!file) {
-        printf("Nenhum mangá encontrado!\n");
-        return;
-    }
-    
-    Manga manga;
-    int count = 0;
-    
-    while (fread(&manga, sizeof(Manga), 1, file)) {
-        if (!manga.deleted) {
-            printf("%d. %s (%s) - %d volumes adquiridos\n", 
-                   ++count, manga.title, manga.isbn, manga.acquired_volumes);
-        }
+    printf("Servidor escutando em %s (%d workers). Encerre com Ctrl+C.\n", socket_path, threads);
+    fflush(stdout);
+
+    int signal_number;
+    sigwait(&signals, &signal_number);
+
+    // Acordar quem estiver bloqueado em accept/leitura; os comandos em andamento terminam
+    pthread_mutex_lock(&server.lock);
+    server.stopping = 1;
+    shutdown(server.listen_fd, SHUT_RDWR);
+    for (int i = 0; i < threads; i++) {
+        if (server.clients[i] >= 0) shutdown(server.clients[i], SHUT_RDWR);
     }
-    
-    if (count == 0) {
-        printf("Nenhum mangá ativo encontrado!\n");
+    pthread_cond_broadcast(&server.not_empty);
+    pthread_cond_broadcast(&server.not_full);
+    pthread_mutex_unlock(&server.lock);
+
+    pthread_join(acceptor, NULL);
+    for (int i = 0; i < threads; i++) {
+        pthread_join(workers[i], NULL);
     }
-    
-    fclose(file);
+    close(server.listen_fd);
+    server.listen_fd = -1;
+    unlink(socket_path);
+
+    printf("Servidor encerrado.\n");
+    return 0;
 }
 
 // Carregar dados iniciais do arquivo de texto
 void load_initial_data() {
-    FILE *file = fopen("mangas.txt", "r");
-    if (!file) {
-        printf("Arquivo mangas.txt não encontrado!\n");
-        return;
-    }
-    
-    char line[1000];
-    Manga manga;
-    
-    while (fgets(line, sizeof(line), file)) {
-        // Parse da linha
-        char *token = strtok(line, ";");
-        if (!token) continue;
-        
-        strcpy(manga.isbn, token);
-        
-        token = strtok(NULL, ";");
-        if (!token) continue;
-        strcpy(manga.title, token);
-        
-        token = strtok(NULL, ";");
-        if (!token) continue;
-        strcpy(manga.author, token);
-        
-        token = strtok(NULL, ";");
-        if (!token) continue;
-        manga.start_year = atoi(token);
-        
-        token = strtok(NULL, ";");
-        if (!token) continue;
-        if (strcmp(token, " -") == 0) {
-            manga.end_year = -1;
-        } else {
-            manga.end_year = atoi(token);
-        }
-        
-        token = strtok(NULL, ";");
-        if (!token) continue;
-        strcpy(manga.genre, token);
-        
-        token = strtok(NULL, ";");
-        if (!token) continue;
-        strcpy(manga.magazine, token);
-        
-        token = strtok(NULL, ";");
-        if (!token) continue;
-        strcpy(manga.publisher, token);
-        
-        token = strtok(NULL, ";");
-        if (!token) continue;
-        manga.edition_year = atoi(token);
-        
-        token = strtok(NULL, ";");
-        if (!token) continue;
-        manga.total_volumes = atoi(token);
-        
-        token = strtok(NULL, ";");
-        if (!token) continue;
-        manga.acquired_volumes = atoi(token);
-        
-        // Parse da lista de volumes
-        token = strtok(NULL, ";");
-        if (token) {
-            char *volume_str = strtok(token, "[,]");
-            int i = 0;
-            while (volume_str && i < manga.acquired_volumes) {
-                manga.volumes_list[i++] = atoi(volume_str);
-                volume_str = strtok(NULL, "[,] ");
-            }
-        }
-        
-        manga.deleted = 0;
-        
-        // Verificar se já existe
-        if (find_manga_by_isbn(manga.isbn) == -1) {
-            // Salvar no arquivo
-            FILE *data_file = fopen("mangas.dat", "ab");
-            if (data_file) {
-                long offset = ftell(data_file);
-                fwrite(&manga, sizeof(Manga), 1, data_file);
-                fclose(data_file);
-                
-                // Atualizar índices
-                add_primary_index(manga.isbn, offset);
-                add_secondary_index(manga.title, manga.isbn);
-            }
-        }
+    if (bulk_import("mangas.txt") >= 0) {
+        printf("Dados iniciais carregados com sucesso!\n");
     }
-    
-    fclose(file);
-    save_primary_indices();
-    save_secondary_indices();
-    printf("Dados iniciais carregados com sucesso!\n");
 }
 
 // Menu principal
@@ -765,11 +9186,19 @@ void menu() {
         printf("5. Listar todos os mangás\n");
         printf("6. Carregar dados iniciais\n");
         printf("7. Debug - Mostrar títulos indexados\n");
+        printf("8. Compactar arquivo de dados\n");
+        printf("9. Filtrar por autor, editora, revista ou gênero\n");
+        printf("10. Estatísticas da coleção\n");
+        printf("11. Reconstruir índices\n");
+        printf("12. Métricas de desempenho (JSON)\n");
+        printf("13. Adicionar ou remover volumes adquiridos\n");
         printf("0. Sair\n");
         printf("Escolha uma opção: ");
         
         scanf("%d", &option);
         
+        // As opções sem perguntas são medidas inteiras; as demais, sem a digitação
+        uint64_t start = metrics_clock();
         switch (option) {
             case 1:
                 create_manga();
@@ -785,13 +9214,38 @@ void menu() {
                 break;
             case 5:
                 list_all_mangas();
+                metrics_record(METRIC_LIST, start);
                 break;
             case 6:
                 load_initial_data();
+                metrics_record(METRIC_IMPORT, start);
                 break;
             case 7:
                 debug_titles();
                 break;
+            case 8:
+                compact_data_file();
+                metrics_record(METRIC_COMPACT, start);
+                break;
+            case 9:
+                filter_mangas();
+                break;
+            case 10:
+                collection_stats();
+                metrics_record(METRIC_STATS, start);
+                break;
+            case 11:
+                rebuild_indexes();
+                metrics_record(METRIC_REBUILD, start);
+                break;
+            case 12:
+                printf("{");
+                metrics_print_json(stdout);
+                printf("}\n");
+                break;
+            case 13:
+                update_volumes();
+                break;
             case 0:
                 printf("Saindo...\n");
                 break;
@@ -801,10 +9255,147 @@ void menu() {
     } while (option != 0);
 }
 
-int main() {
-    // Carregar índices existentes
-    load_primary_indices();
-    load_secondary_indices();
+int main(int argc, char *argv[]) {
+    // No modo em lote a saída padrão recebe apenas os resultados (JSON);
+    // as demais mensagens vão para a saída de erros
+    FILE *batch_out = NULL;
+    metrics.started = metrics_clock();
+
+    // Opções aceitas em qualquer modo: --pool-pages N (quadros do buffer pool) e
+    // --stats-on-exit (relatório de métricas na saída de erros ao terminar)
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--pool-pages") == 0) {
+            if (i + 1 >= argc || data_pool_configure(atol(argv[i + 1])) != 0) {
+                printf("Erro: --pool-pages espera um número de páginas entre 1 e %d!\n", DATA_POOL_MAX_PAGES);
+                return 1;
+            }
+            memmove(&argv[i], &argv[i + 2], (argc - i - 1) * sizeof(char *));
+            argc -= 2;
+            i--;
+        } else if (strcmp(argv[i], "--stats-on-exit") == 0) {
+            if (!metrics.dump_on_exit) atexit(metrics_dump_at_exit);
+            metrics.dump_on_exit = 1;
+            memmove(&argv[i], &argv[i + 1], (argc - i) * sizeof(char *));
+            argc--;
+            i--;
+        }
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "--batch") == 0) {
+        batch_out = fdopen(dup(STDOUT_FILENO), "w");
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+    }
+    
+    finish_interrupted_compaction();
+    
+    // Verificar o formato do arquivo de dados
+    int data_format = check_data_file();
+    if (data_format < 0) {
+        printf("Erro: mangas.dat inválido ou de versão não suportada!\n");
+        return 1;
+    }
+    
+    if (argc == 2 && strcmp(argv[1], "--migrate") == 0) {
+        open_data_file();
+        load_indices();
+        int result = migrate_data_file();
+        close_indices();
+        close_data_file();
+        return result < 0 ? 1 : 0;
+    }
+    
+    if (data_format == 1) {
+        printf("mangas.dat está no formato antigo (v1). Converta com: ./manga_manager --migrate\n");
+        return 1;
+    }
+    
+    if (open_data_file() != 0) {
+        printf("Erro ao abrir arquivo de dados!\n");
+        return 1;
+    }
+    
+    // Reconstrução completa dos índices (não interativa). Os arquivos de índice e o
+    // log são descartados antes da carga, pois podem estar ilegíveis
+    if (argc == 2 && strcmp(argv[1], "--rebuild-indexes") == 0) {
+        remove_index_files();
+        load_indices();
+        uint64_t start = metrics_clock();
+        int result = rebuild_indexes();
+        metrics_record(METRIC_REBUILD, start);
+        close_indices();
+        close_data_file();
+        return result < 0 ? 1 : 0;
+    }
+    
+    // Carregar índices existentes (reaplicando o log de índices)
+    load_indices();
+    if (catalog_indices_stale) {
+        printf("Reconstruindo índices primário e secundário...\n");
+        rebuild_indices_from_data();
+        catalog_indices_stale = 0;
+    }
+    if (attribute_index.stale || year_index.stale || column_store.stale) {
+        printf("Construindo índices de atributos e de anos e projeção colunar...\n");
+        rebuild_record_indices();
+    }
+    
+    // Compactação do arquivo de dados (não interativa)
+    if (argc == 2 && strcmp(argv[1], "--compact") == 0) {
+        uint64_t start = metrics_clock();
+        int result = compact_data_file();
+        metrics_record(METRIC_COMPACT, start);
+        close_indices();
+        close_data_file();
+        return result < 0 ? 1 : 0;
+    }
+    
+    // Modo em lote: --batch [arquivo|-] [--commit-every N]
+    if (batch_out) {
+        const char *filename = "-";
+        long commit_every = 0;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--commit-every") == 0 && i + 1 < argc) {
+                commit_every = atol(argv[++i]);
+            } else {
+                filename = argv[i];
+            }
+        }
+        int failed = run_batch(filename, commit_every, batch_out);
+        fclose(batch_out);
+        close_indices();
+        close_data_file();
+        return failed != 0 ? 1 : 0;
+    }
+    
+    // Modo servidor: --serve <socket> [--threads N]
+    if (argc >= 3 && strcmp(argv[1], "--serve") == 0) {
+        int threads = 0;
+        if (argc == 5 && strcmp(argv[3], "--threads") == 0) {
+            threads = atoi(argv[4]);
+        }
+        int result = run_server(argv[2], threads);
+        close_indices();
+        close_data_file();
+        return result < 0 ? 1 : 0;
+    }
+    
+    // Modo de importação em massa (não interativo)
+    if (argc == 3 && strcmp(argv[1], "--import") == 0) {
+        uint64_t start = metrics_clock();
+        int imported = bulk_import(argv[2]);
+        metrics_record(METRIC_IMPORT, start);
+        close_indices();
+        close_data_file();
+        return imported < 0 ? 1 : 0;
+    }
+    
+    // Aplicação de um arquivo de eventos de volumes (não interativa)
+    if (argc == 3 && strcmp(argv[1], "--volume-events") == 0) {
+        int failed = apply_volume_events(argv[2]);
+        close_indices();
+        close_data_file();
+        return failed != 0 ? 1 : 0;
+    }
     
     printf("Sistema de Gerenciamento de Mangás iniciado!\n");
     printf("Índices carregados: %d primários, %d secundários\n", 
@@ -812,9 +9403,9 @@ int main() {
     
     menu();
     
-    // Liberar memória
-    if (primary_indices) free(primary_indices);
-    if (secondary_indices) free(secondary_indices);
+    // Checkpoint final e liberação da memória
+    close_indices();
+    close_data_file();
     
     return 0;
 }
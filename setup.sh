@@ -107,7 +107,7 @@ if [ ! -f "mangas.txt" ]; then
 978-4-08-871610-7; Hunter x Hunter; Yoshihiro Togashi; 1998; -; Ação; Weekly Shōnen Jump; Shueisha; 2016; 37; 10; [1, 2, 3, 4, 5, 6, 7, 8, 9, 10]
 978-4-08-882173-3; Spy × Family; Tatsuya Endo; 2019; -; Comédia; Shōnen Jump+; Shueisha; 2020; 12; 7; [1, 2, 3, 4, 5, 6, 7]
 978-4-08-880723-2; Demon Slayer; Koyoharu Gotouge; 2016; 2020; Ação; Weekly Shōnen Jump; Shueisha; 2018; 23; 23; [1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23]
-978-4-04-713151-0; Neon Genesis Evangelion; Yoshiyuki Sadamoto; 1994; 2013; Mecha, Drama; Shōnen Ace; Kadokawa Shoten; 2005; 14; 8; [1, 2, 3, 4, 5, 6, 7, 8]
+978-4-04-713151-4; Neon Genesis Evangelion; Yoshiyuki Sadamoto; 1994; 2013; Mecha, Drama; Shōnen Ace; Kadokawa Shoten; 2005; 14; 8; [1, 2, 3, 4, 5, 6, 7, 8]
 978-4-08-881780-4; Chainsaw Man; Tatsuki Fujimoto; 2018; 2020; Ação; Weekly Shōnen Jump; Shueisha; 2019; 11; 6; [1, 2, 3, 4, 5, 6]
 978-4-08-873113-1; Naruto; Masashi Kishimoto; 1999; 2014; Ação; Weekly Shōnen Jump; Shueisha; 2008; 72; 25; [1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25]
 EOF
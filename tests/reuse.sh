@@ -0,0 +1,95 @@
+#!/bin/bash
+
+# Teste do modo em lote: o espaço de um mangá removido só é reaproveitado depois
+# que a remoção foi confirmada no log (--commit-every)
+# Uso: tests/reuse.sh [./manga_manager]
+
+BINARY=$(realpath "${1:-./manga_manager}")
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+cd "$WORK" || exit 1
+
+ISBN_A=978-4-08-883267-8
+ISBN_B=978-4-08-872509-3
+ISBN_C=978-4-08-873125-4
+ISBN_D=978-4-08-851018-7
+FAILED=0
+
+# Conferir se a linha n da saída contém o texto esperado
+check() {
+    local line
+    line=$(sed -n "$1p" out.jsonl)
+    if [[ "$line" != *"$2"* ]]; then
+        echo "FALHOU: linha $1 deveria conter $2"
+        echo "  obtido: $line"
+        FAILED=1
+    fi
+}
+
+# Conferir o tamanho de mangas.dat
+check_size() {
+    local size
+    size=$(stat -c %s mangas.dat)
+    if [ "$size" -ne "$1" ]; then
+        echo "FALHOU: $2 (mangas.dat com $size bytes, esperado $1)"
+        FAILED=1
+    fi
+}
+
+run_batch() {
+    "$BINARY" --batch - "$@" > out.jsonl 2> /dev/null
+}
+
+# Registros do mesmo tamanho, para que um caiba no espaço do outro
+record() {
+    echo "$1; Série $2; Autor; 1990; -; Ação; Revista; Editora; 1995; 10; 0; []"
+}
+
+run_batch <<COMMANDS
+put $(record $ISBN_A A)
+put $(record $ISBN_B B)
+COMMANDS
+SIZE=$(stat -c %s mangas.dat)
+
+# Remoção e cadastro no mesmo lote, sem confirmação entre eles: o novo mangá não
+# pode ocupar o espaço do removido, que o log ainda não registra como livre
+run_batch --commit-every 1000 <<COMMANDS
+delete $ISBN_A
+put $(record $ISBN_C C)
+get $ISBN_A
+get $ISBN_C
+COMMANDS
+check 1 "\"status\":\"ok\""
+check 2 "\"status\":\"ok\""
+check 3 "\"status\":\"not_found\""
+check 4 "\"title\":\"Série C\""
+GROWN=$(stat -c %s mangas.dat)
+if [ "$GROWN" -le "$SIZE" ]; then
+    echo "FALHOU: o espaço removido foi reaproveitado antes da confirmação"
+    FAILED=1
+fi
+
+# Confirmada a remoção, o espaço volta a ser usado
+run_batch --commit-every 1 <<COMMANDS
+put $(record $ISBN_D D)
+COMMANDS
+check 1 "\"status\":\"ok\""
+check_size "$GROWN" "o espaço removido não foi reaproveitado depois da confirmação"
+
+run_batch <<COMMANDS
+get $ISBN_A
+get $ISBN_B
+get $ISBN_C
+get $ISBN_D
+stats
+COMMANDS
+check 1 "\"status\":\"not_found\""
+check 2 "\"title\":\"Série B\""
+check 3 "\"title\":\"Série C\""
+check 4 "\"title\":\"Série D\""
+check 5 "\"series\":3"
+
+if [ $FAILED -eq 0 ]; then
+    echo "reuse: ok"
+fi
+exit $FAILED
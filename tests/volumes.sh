@@ -0,0 +1,67 @@
+#!/bin/bash
+
+# Teste do modo em lote: alterações incrementais de volumes com mais de 100 volumes
+# Uso: tests/volumes.sh [./manga_manager]
+
+BINARY=$(realpath "${1:-./manga_manager}")
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+cd "$WORK" || exit 1
+
+ISBN=978-4-08-883267-8
+FAILED=0
+
+# Conferir se a linha n da saída contém o texto esperado
+check() {
+    local line
+    line=$(sed -n "$1p" out.jsonl)
+    if [[ "$line" != *"$2"* ]]; then
+        echo "FALHOU: linha $1 deveria conter $2"
+        echo "  obtido: $line"
+        FAILED=1
+    fi
+}
+
+run_batch() {
+    "$BINARY" --batch - > out.jsonl 2> /dev/null
+}
+
+volumes() {
+    seq -s, "$1" "$2"
+}
+
+run_batch <<COMMANDS
+put $ISBN; Série Longa; Autor; 1990; -; Ação; Revista; Editora; 1995; 150; 0; []
+volumes $ISBN +1..120
+stats
+volumes $ISBN +200
+volumes $ISBN -1..95
+get $ISBN
+stats
+COMMANDS
+check 2 "\"acquired_volumes\":120,\"volumes\":[$(volumes 1 120)]"
+check 3 "\"acquired\":120"
+check 4 "\"acquired_volumes\":121,\"volumes\":[$(volumes 1 120),200]"
+check 5 "\"acquired_volumes\":26,\"volumes\":[$(volumes 96 120),200]"
+check 6 "\"volumes\":[$(volumes 96 120),200]"
+check 7 "\"acquired\":26"
+
+# Regravação completa (update) e reconstrução dos índices preservam os volumes
+run_batch <<COMMANDS
+update $ISBN; Série Longa; Autor; 1990; -; Ação; Revista; Editora; 1995; 150; 130; [$(volumes 1 130)]
+volumes $ISBN -1..5 +140..141
+get $ISBN
+COMMANDS
+check 2 "\"acquired_volumes\":127,\"volumes\":[$(volumes 6 130),140,141]"
+check 3 "\"volumes\":[$(volumes 6 130),140,141]"
+
+"$BINARY" --rebuild-indexes > /dev/null
+run_batch <<COMMANDS
+stats
+COMMANDS
+check 1 "\"acquired\":127"
+
+if [ $FAILED -eq 0 ]; then
+    echo "volumes: ok"
+fi
+exit $FAILED